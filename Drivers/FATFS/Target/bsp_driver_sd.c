@@ -22,6 +22,10 @@
  */
 /* USER CODE END Header */
 
+#include "driver.h"
+
+#if SDCARD_ENABLE && SDCARD_SDIO
+
 #ifdef OLD_API
 /* kept to avoid issue when migrating old projects. */
 /* USER CODE BEGIN 0 */
@@ -43,9 +47,42 @@ static SD_HandleTypeDef hsd = {
     .Init.ClockPowerSave = SDIO_CLOCK_POWER_SAVE_DISABLE,
     .Init.BusWide = SDIO_BUS_WIDE_1B,
     .Init.HardwareFlowControl = SDIO_HARDWARE_FLOW_CONTROL_DISABLE,
-    .Init.ClockDiv = 4
+    .Init.ClockDiv = 0 // 48 MHz / (ClockDiv + 2) = 24 MHz, default speed
+};
+
+// A single DMA stream is used for both directions, reconfigured as needed before each transfer.
+// DMA2 stream 3 is the alternative but is used by SPI1.
+static DMA_HandleTypeDef hdma_sdio = {
+    .Instance = DMA2_Stream6,
+    .Init.Channel = DMA_CHANNEL_4,
+    .Init.Direction = DMA_PERIPH_TO_MEMORY,
+    .Init.PeriphInc = DMA_PINC_DISABLE,
+    .Init.MemInc = DMA_MINC_ENABLE,
+    .Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD,
+    .Init.MemDataAlignment = DMA_MDATAALIGN_WORD,
+    .Init.Mode = DMA_PFCTRL,
+    .Init.Priority = DMA_PRIORITY_VERY_HIGH,
+    .Init.FIFOMode = DMA_FIFOMODE_ENABLE,
+    .Init.FIFOThreshold = DMA_FIFO_THRESHOLD_FULL,
+    .Init.MemBurst = DMA_MBURST_INC4,
+    .Init.PeriphBurst = DMA_PBURST_INC4
 };
 
+static uint8_t sd_dma_direction (uint32_t direction)
+{
+  if (hdma_sdio.Init.Direction != direction || hdma_sdio.State == HAL_DMA_STATE_RESET)
+  {
+    HAL_DMA_DeInit(&hdma_sdio);
+    hdma_sdio.Init.Direction = direction;
+    if (HAL_DMA_Init(&hdma_sdio) != HAL_OK)
+    {
+      return MSD_ERROR;
+    }
+  }
+
+  return MSD_OK;
+}
+
 /**
 * @brief SD MSP Initialization
 * This function configures the hardware resources used in this example
@@ -85,12 +122,39 @@ void HAL_SD_MspInit(SD_HandleTypeDef* hsd)
     HAL_GPIO_Init(GPIOD, &GPIO_InitStruct);
 
   /* USER CODE BEGIN SDIO_MspInit 1 */
+    __HAL_RCC_DMA2_CLK_ENABLE();
+
+    __HAL_LINKDMA(hsd, hdmarx, hdma_sdio);
+    __HAL_LINKDMA(hsd, hdmatx, hdma_sdio);
+
+    HAL_NVIC_SetPriority(SDIO_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(SDIO_IRQn);
 
+    HAL_NVIC_SetPriority(DMA2_Stream6_IRQn, 0, 1);
+    HAL_NVIC_EnableIRQ(DMA2_Stream6_IRQn);
   /* USER CODE END SDIO_MspInit 1 */
   }
 
 }
 
+/**
+* @brief SD MSP De-Initialization
+* @param hsd: SD handle pointer
+* @retval None
+*/
+void HAL_SD_MspDeInit(SD_HandleTypeDef* hsd)
+{
+  if(hsd->Instance==SDIO)
+  {
+    HAL_NVIC_DisableIRQ(SDIO_IRQn);
+    HAL_NVIC_DisableIRQ(DMA2_Stream6_IRQn);
+
+    HAL_DMA_DeInit(&hdma_sdio);
+
+    __HAL_RCC_SDIO_CLK_DISABLE();
+  }
+}
+
 /* USER CODE BEGIN BeforeInitSection */
 /* can be used to modify / undefine following code or add code */
 /* USER CODE END BeforeInitSection */
@@ -101,6 +165,11 @@ void HAL_SD_MspInit(SD_HandleTypeDef* hsd)
 __weak uint8_t BSP_SD_Init(void)
 {
   uint8_t sd_state = MSD_OK;
+  /* Restart from scratch, the card may have been replaced */
+  if (hsd.State != HAL_SD_STATE_RESET)
+  {
+    HAL_SD_DeInit(&hsd);
+  }
   /* Check if the SD card is plugged in the slot */
   if (BSP_SD_IsDetected() != SD_PRESENT)
   {
@@ -121,7 +190,101 @@ __weak uint8_t BSP_SD_Init(void)
   return sd_state;
 }
 /* USER CODE BEGIN AfterInitSection */
-/* can be used to modify previous code / undefine following code / add code */
+/**
+  * @brief  De-initializes the SD card device, the SDIO peripheral is powered down.
+  * @retval SD status
+  */
+uint8_t BSP_SD_DeInit(void)
+{
+  return hsd.State == HAL_SD_STATE_RESET || HAL_SD_DeInit(&hsd) == HAL_OK ? MSD_OK : MSD_ERROR;
+}
+
+/**
+  * @brief  Aborts an ongoing transfer, e.g. on timeout.
+  * @retval None
+  */
+void BSP_SD_Abort(void)
+{
+  HAL_SD_Abort(&hsd);
+}
+
+/**
+  * @brief  Switches the card to high speed mode (CMD6) and the SDIO clock to 48 MHz,
+  *         or back to the default 24 MHz clock.
+  *         The clock setting is not stored in hsd.Init as HAL_SD_InitCard() must run at default speed.
+  * @param  enable: 1 to switch to high speed, 0 to revert the clock to default speed
+  * @retval SD status
+  */
+uint8_t BSP_SD_HighSpeed(uint8_t enable)
+{
+  uint32_t status[16], n = 0, sta;
+  SDIO_InitTypeDef init = hsd.Init;
+  SDIO_DataInitTypeDef config = {
+    .DataTimeOut = SDMMC_DATATIMEOUT,
+    .DataLength = 64,
+    .DataBlockSize = SDIO_DATABLOCK_SIZE_64B,
+    .TransferDir = SDIO_TRANSFER_DIR_TO_SDIO,
+    .TransferMode = SDIO_TRANSFER_MODE_BLOCK,
+    .DPSM = SDIO_DPSM_ENABLE
+  };
+
+  init.BusWide = SDIO_BUS_WIDE_4B;
+
+  if (enable)
+  {
+    if (hsd.State != HAL_SD_STATE_READY || (hsd.SdCard.CardType == CARD_SDSC && hsd.SdCard.CardVersion == CARD_V1_X))
+    {
+      return MSD_ERROR; /* CMD6 is not supported by version 1.0 cards */
+    }
+
+    if (SDMMC_CmdBlockLength(hsd.Instance, 64) != HAL_SD_ERROR_NONE)
+    {
+      return MSD_ERROR;
+    }
+
+    SDIO_ConfigData(hsd.Instance, &config);
+
+    if (SDMMC_CmdSwitch(hsd.Instance, 0x80FFFFF1) != HAL_SD_ERROR_NONE) /* Switch function group 1 to high speed */
+    {
+      SDMMC_CmdBlockLength(hsd.Instance, BLOCKSIZE);
+      return MSD_ERROR;
+    }
+
+    /* Read the 512 bit switch status */
+    while (!((sta = hsd.Instance->STA) & (SDIO_FLAG_RXOVERR|SDIO_FLAG_DCRCFAIL|SDIO_FLAG_DTIMEOUT|SDIO_FLAG_DATAEND)) || (sta & SDIO_FLAG_RXDAVL))
+    {
+      if ((sta & SDIO_FLAG_RXDAVL) && n < 16)
+      {
+        status[n++] = SDIO_ReadFIFO(hsd.Instance);
+      }
+    }
+
+    __SDIO_CLEAR_FLAG(hsd.Instance, SDIO_STATIC_FLAGS);
+
+    if (SDMMC_CmdBlockLength(hsd.Instance, BLOCKSIZE) != HAL_SD_ERROR_NONE ||
+         (sta & (SDIO_FLAG_RXOVERR|SDIO_FLAG_DCRCFAIL|SDIO_FLAG_DTIMEOUT)) || n < 16 ||
+          (((uint8_t *)status)[16] & 0x0F) != 1) /* Function group 1 switched to function 1 */
+    {
+      return MSD_ERROR;
+    }
+
+    /* Allow 8 clock cycles for the switch to complete before changing the clock */
+    HAL_Delay(1);
+
+    init.ClockBypass = SDIO_CLOCK_BYPASS_ENABLE;
+  }
+
+  return SDIO_Init(hsd.Instance, init) == HAL_OK ? MSD_OK : MSD_ERROR;
+}
+
+/**
+  * @brief  Gets the current SDIO clock.
+  * @retval Clock in kHz
+  */
+uint32_t BSP_SD_GetClockKHz(void)
+{
+  return hsd.Instance->CLKCR & SDIO_CLKCR_BYPASS ? 48000 : 48000 / (hsd.Init.ClockDiv + 2);
+}
 /* USER CODE END AfterInitSection */
 
 /* USER CODE BEGIN InterruptMode */
@@ -205,7 +368,8 @@ __weak uint8_t BSP_SD_ReadBlocks_DMA(uint32_t *pData, uint32_t ReadAddr, uint32_
   uint8_t sd_state = MSD_OK;
 
   /* Read block(s) in DMA transfer mode */
-  if (HAL_SD_ReadBlocks_DMA(&hsd, (uint8_t *)pData, ReadAddr, NumOfBlocks) != HAL_OK)
+  if (sd_dma_direction(DMA_PERIPH_TO_MEMORY) != MSD_OK ||
+       HAL_SD_ReadBlocks_DMA(&hsd, (uint8_t *)pData, ReadAddr, NumOfBlocks) != HAL_OK)
   {
     sd_state = MSD_ERROR;
   }
@@ -228,7 +392,8 @@ __weak uint8_t BSP_SD_WriteBlocks_DMA(uint32_t *pData, uint32_t WriteAddr, uint3
   uint8_t sd_state = MSD_OK;
 
   /* Write block(s) in DMA transfer mode */
-  if (HAL_SD_WriteBlocks_DMA(&hsd, (uint8_t *)pData, WriteAddr, NumOfBlocks) != HAL_OK)
+  if (sd_dma_direction(DMA_MEMORY_TO_PERIPH) != MSD_OK ||
+       HAL_SD_WriteBlocks_DMA(&hsd, (uint8_t *)pData, WriteAddr, NumOfBlocks) != HAL_OK)
   {
     sd_state = MSD_ERROR;
   }
@@ -314,6 +479,32 @@ void HAL_SD_RxCpltCallback(SD_HandleTypeDef *hsd)
   BSP_SD_ReadCpltCallback();
 }
 
+/**
+  * @brief SD error callback
+  * @param hsd: SD handle
+  * @retval None
+  */
+void HAL_SD_ErrorCallback(SD_HandleTypeDef *hsd)
+{
+  BSP_SD_ErrorCallback();
+}
+
+/**
+  * @brief This function handles the SDIO global interrupt.
+  */
+void SDIO_IRQHandler(void)
+{
+  HAL_SD_IRQHandler(&hsd);
+}
+
+/**
+  * @brief This function handles the SDIO DMA stream interrupt.
+  */
+void DMA2_Stream6_IRQHandler(void)
+{
+  HAL_DMA_IRQHandler(&hdma_sdio);
+}
+
 /* USER CODE BEGIN CallBacksSection_C */
 /**
   * @brief BSP SD Abort callback
@@ -343,6 +534,16 @@ __weak void BSP_SD_WriteCpltCallback(void)
 __weak void BSP_SD_ReadCpltCallback(void)
 {
 
+}
+
+/**
+  * @brief BSP transfer error callback
+  * @retval None
+  * @note empty (up to the user to fill it in or to remove it if useless)
+  */
+__weak void BSP_SD_ErrorCallback(void)
+{
+
 }
 /* USER CODE END CallBacksSection_C */
 #endif
@@ -357,7 +558,36 @@ __weak uint8_t BSP_SD_IsDetected(void)
   __IO uint8_t status = SD_PRESENT;
 
   /* USER CODE BEGIN 1 */
-  /* user code can be inserted here */
+#ifdef SD_DETECT_PIN
+  static bool init = false;
+
+  if (!init)
+  {
+    GPIO_InitTypeDef GPIO_InitStruct = {
+      .Pin = 1 << SD_DETECT_PIN,
+      .Mode = GPIO_MODE_INPUT,
+      .Pull = GPIO_PULLUP,
+      .Speed = GPIO_SPEED_FREQ_LOW
+    };
+    HAL_GPIO_Init(SD_DETECT_PORT, &GPIO_InitStruct);
+
+    static const periph_pin_t cd = {
+      .function = Input_SdCardDetect,
+      .group = PinGroup_SdCard,
+      .port = SD_DETECT_PORT,
+      .pin = SD_DETECT_PIN,
+      .mode = { .mask = PINMODE_PULLUP }
+    };
+    hal.periph_port.register_pin(&cd);
+
+    init = true;
+  }
+
+  if (DIGITAL_IN(SD_DETECT_PORT, SD_DETECT_PIN)) /* Switch is closed to ground when a card is inserted */
+  {
+    status = SD_NOT_PRESENT;
+  }
+#endif
   /* USER CODE END 1 */
 
   return status;
@@ -366,3 +596,5 @@ __weak uint8_t BSP_SD_IsDetected(void)
 /* USER CODE BEGIN AdditionalCode */
 /* user code can be inserted here */
 /* USER CODE END AdditionalCode */
+
+#endif // SDCARD_ENABLE && SDCARD_SDIO
@@ -61,6 +61,10 @@
 /* USER CODE BEGIN BSP_H_CODE */
 /* Exported functions --------------------------------------------------------*/
 uint8_t BSP_SD_Init(void);
+uint8_t BSP_SD_DeInit(void);
+void    BSP_SD_Abort(void);
+uint8_t BSP_SD_HighSpeed(uint8_t enable);
+uint32_t BSP_SD_GetClockKHz(void);
 uint8_t BSP_SD_ITConfig(void);
 void    BSP_SD_DetectIT(void);
 void    BSP_SD_DetectCallback(void);
@@ -81,6 +85,7 @@ uint8_t BSP_SD_IsDetected(void);
 void    BSP_SD_AbortCallback(void);
 void    BSP_SD_WriteCpltCallback(void);
 void    BSP_SD_ReadCpltCallback(void);
+void    BSP_SD_ErrorCallback(void);
 /* USER CODE END BSP_H_CODE */
 #endif
 
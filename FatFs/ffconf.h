@@ -4,6 +4,8 @@
 
 #define FFCONF_DEF	86631	/* Revision ID */
 
+#include "my_machine.h"	/* SDCARD_* options */
+
 /*---------------------------------------------------------------------------/
 / Function Configurations
 /---------------------------------------------------------------------------*/
@@ -34,12 +36,23 @@
 /* This option switches f_mkfs() function. (0:Disable or 1:Enable) */
 
 
+#if SDCARD_INDEX_ENABLE || SDCARD_DIRECT_ENABLE
+#define FF_USE_FASTSEEK	1
+#else
 #define FF_USE_FASTSEEK	0
-/* This option switches fast seek function. (0:Disable or 1:Enable) */
+#endif
+/* This option switches fast seek function. (0:Disable or 1:Enable)
+/  Only enabled when the line offset index or direct streaming is, it adds a
+/  link map pointer to each file object. */
 
 
+#if SDCARD_WRITEBEHIND
+#define FF_USE_EXPAND	1
+#else
 #define FF_USE_EXPAND	0
-/* This option switches f_expand function. (0:Disable or 1:Enable) */
+#endif
+/* This option switches f_expand function. (0:Disable or 1:Enable)
+/  Only enabled for preallocating files uploaded by $FY. */
 
 
 #define FF_USE_CHMOD	1
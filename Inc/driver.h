@@ -206,6 +206,12 @@
 #error "Board does not support ethernet!"
 #endif
 
+#if USB_NETWORK_ENABLE
+// Enabled after the board map has been processed as no pins are to be reserved for a WIZnet module.
+#undef ETHERNET_ENABLE
+#define ETHERNET_ENABLE 1
+#endif
+
 // Define timer allocations.
 
 #define STEPPER_TIMER_N             5
@@ -358,6 +364,16 @@
   #ifndef TRINAMIC_MIXED_DRIVERS
     #define TRINAMIC_MIXED_DRIVERS 1
   #endif
+  // SPI timing, for the slowest internal driver clock
+  #define TMC_SPI_CSN_HIGH_NS    250 // CSN high time between datagrams, > 2 tCLK + 10 ns
+  #define TMC_SPI_CSN_HOLD_NS     20 // last SCK edge to CSN high
+  #define TMC_SPI_SCK_HALF_NS    125 // software SPI SCK low and high time, 4 MHz max
+  #if (TRINAMIC_SPI_CHAIN || TRINAMIC_SPI_DMA) && TRINAMIC_ENABLE == 2660
+    #error "TRINAMIC_SPI_CHAIN and TRINAMIC_SPI_DMA are not supported for the TMC2660!"
+  #endif
+  #if TRINAMIC_MONITOR && !(TRINAMIC_SPI_ENABLE && TRINAMIC_SPI_DMA)
+    #error "TRINAMIC_MONITOR requires Trinamic SPI drivers and TRINAMIC_SPI_DMA!"
+  #endif
 #endif
 
 // End configuration
@@ -375,6 +391,67 @@
 #if !SDCARD_SDIO && !defined(SD_CS_PORT)
 #error SD card plugin not supported!
 #endif
+#ifndef SDCARD_READAHEAD
+#define SDCARD_READAHEAD 0
+#endif
+#if SDCARD_READAHEAD && (SDCARD_READAHEAD < 2 || SDCARD_READAHEAD > 32)
+#error SDCARD_READAHEAD must be in the range 2 - 32 sectors!
+#endif
+#ifndef SDCARD_JOB_BUFFER
+#define SDCARD_JOB_BUFFER 0
+#endif
+#ifndef SDCARD_WRITEBEHIND
+#define SDCARD_WRITEBEHIND 0
+#endif
+#ifndef SDCARD_HOTPLUG
+#define SDCARD_HOTPLUG 0
+#endif
+#if SDCARD_HOTPLUG && !defined(SD_DETECT_PIN)
+#error SD card hotplug requires a card detect pin!
+#endif
+#ifndef SDCARD_CACHE
+#define SDCARD_CACHE 0
+#endif
+#if SDCARD_CACHE > 64
+#error SDCARD_CACHE must be in the range 0 - 64 sectors!
+#endif
+#ifndef SDCARD_INDEX_ENABLE
+#define SDCARD_INDEX_ENABLE 0
+#endif
+#ifndef SDCARD_JOBCACHE_ENABLE
+#define SDCARD_JOBCACHE_ENABLE 0
+#endif
+#ifndef SDCARD_DIRECT_ENABLE
+#define SDCARD_DIRECT_ENABLE 0
+#endif
+#endif
+
+#if USB_MSC_ENABLE && !(USB_SERIAL_CDC && SDCARD_ENABLE)
+#error USB mass storage requires USB_SERIAL_CDC and SDCARD_ENABLE!
+#endif
+#if USB_MSC_ENABLE && SDCARD_HOTPLUG
+#error USB mass storage cannot be combined with SDCARD_HOTPLUG, the card would never be released to the host!
+#endif
+
+#if USB_SERIAL_DUAL
+#if !USB_SERIAL_CDC || USB_MSC_ENABLE
+#error Dual USB serial ports requires USB_SERIAL_CDC and cannot be combined with USB_MSC_ENABLE!
+#endif
+#if !(defined(STM32F446xx) || defined(STM32F412Vx))
+#error Dual USB serial ports requires a MCU with six OTG FS endpoints (STM32F412 or STM32F446)!
+#endif
+#ifndef USB_SERIAL2_STREAM
+#define USB_SERIAL2_STREAM 3
+#endif
+#endif
+
+#if USB_NETWORK_ENABLE
+#if !USB_SERIAL_CDC || USB_MSC_ENABLE || USB_SERIAL_DUAL || defined(_WIZCHIP_)
+#error USB networking requires USB_SERIAL_CDC and cannot be combined with USB_MSC_ENABLE, USB_SERIAL_DUAL or a WIZnet module!
+#endif
+#if !(defined(STM32F446xx) || defined(STM32F412Vx))
+#error USB networking requires a MCU with six OTG FS endpoints (STM32F412 or STM32F446)!
+#endif
 #endif
 
 #if I2C_ENABLE && !defined(I2C_PORT)
@@ -457,5 +534,6 @@ void ioports_init(pin_group_pins_t *aux_inputs, pin_group_pins_t *aux_outputs);
 void ioports_init_analog (pin_group_pins_t *aux_inputs, pin_group_pins_t *aux_outputs);
 #endif
 void ioports_event (input_signal_t *input);
+void delay_ns (uint32_t ns);
 
 #endif // __DRIVER_H__
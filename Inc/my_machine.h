@@ -63,7 +63,17 @@
 #if IS_NUCLEO_DEVKIT != 64 && !defined(USB_SERIAL_CDC) // The Nucleo boards has an off-chip UART to USB interface.
 #define USB_SERIAL_CDC         1 // Serial communication via native USB.
 #endif
+//#define USB_SERIAL_TX_BUFFERS 4 // Number of USB output buffers that may be queued for transmission, output blocks only when all are in use.
+//#define USB_MSC_ENABLE       1 // Composite USB device, adds a mass storage interface exposing the SD card. Requires SDCARD_ENABLE.
+                                 // The card is hidden from the host while mounted by grblHAL, use $FU to hand it over.
+//#define USB_SERIAL_DUAL      1 // Composite USB device with a second CDC ACM serial port, STM32F412 and STM32F446 only.
+                                 // It is registered as serial stream instance 3, e.g. for MPG_STREAM or telemetry output.
+//#define USB_NETWORK_ENABLE   1 // Composite USB device with a CDC-NCM network interface for the networking services, STM32F412 and STM32F446 only.
+                                 // Uses a static IP address by default as there is no DHCP server on the link, see below for settings.
 //#define BLUETOOTH_ENABLE     2 // Set to 2 for HC-05 module. Requires and claims one auxillary input pin.
+//#define SERIAL_RTS_ENABLE    1 // Flow control for the primary UART stream, RTS is deasserted when the input buffer is 3/4 full.
+                                 // 1: hardware RTS/CTS, only available for some USARTs - see serial.h for details.
+                                 // 2: GPIO driven RTS, requires SERIAL_RTS_PORT and SERIAL_RTS_PIN to be defined in the board map.
 // Spindle selection:
 // Up to four specific spindle drivers can be instantiated at a time
 // depending on N_SPINDLE and N_SYS_SPINDLE definitions in grbl/config.h.
@@ -81,6 +91,17 @@
                                  // NOTE: Only fully compatible with F412 and F429 MCUs.
 //#define WEBUI_AUTH_ENABLE    1 // Enable ESP3D-WEBUI authentication.
 //#define SDCARD_ENABLE        1 // Run gcode programs from SD card. Set to 2 to enable YModem upload.
+//#define SDCARD_READAHEAD     8 // Number of sectors to read ahead from the SD card when a file is read sequentially.
+                                 // SPI mode only, each sector takes 512 bytes of RAM.
+//#define SDCARD_JOB_BUFFER    8192 // Size of the RAM buffer SD card jobs run by $F=<file> or $FR=<file> are read into ahead of the parser, must be a multiple of 512.
+//#define SDCARD_WRITEBEHIND   8192 // Size of the RAM write-behind buffer of the $FY YModem upload command, must be a multiple of 4096.
+//#define SDCARD_HOTPLUG       1 // Mount the SD card in the background on card insertion and keep a RAM index of the root directory, listed by $FD. Requires a card detect pin.
+//#define SDCARD_CACHE         8 // Number of sectors in the RAM cache for FAT, directory and recently read sectors, hit/miss counts are reported by $I.
+//#define SDCARD_DIRECT_ENABLE 1 // Read contiguous job files directly by sector, bypassing FatFs.
+//#define SDCARD_JOBCACHE_ENABLE 1 // Compacted sidecar files (<file>.gcb) for SD card jobs, built by $FC=<file>.
+                                 // Used by $FR=<file> when up to date, requires SDCARD_JOB_BUFFER.
+//#define SDCARD_INDEX_ENABLE  1 // FatFs fast seek and a persisted line offset index (<file>.idx) for resuming jobs from a line, $FI=<file>[,<line>].
+                                 // Jobs are resumed by $FR=<file>,<line>, requires SDCARD_JOB_BUFFER.
 //#define MPG_ENABLE           1 // Enable MPG interface. Requires a serial port and means to switch between normal and MPG mode.
                                  // 1: Mode switching is by handshake pin input unless the keypad plugin is enabled in mode 2 which
                                  //    uses mode switching by the CMD_MPG_MODE_TOGGLE (0x8B) command character.
@@ -102,6 +123,10 @@
 //#define TRINAMIC_ENABLE   2660 // Trinamic TMC2660 stepper driver support.
 //#define TRINAMIC_R_SENSE   110 // R sense resistance in milliohms, 2130 and 2209 default is 110, 5160 is 75.
 //#define TRINAMIC_I2C         1 // Trinamic I2C - SPI bridge interface.
+//#define TRINAMIC_SPI_CHAIN   1 // Trinamic SPI drivers are daisy-chained on a single chip select.
+//#define TRINAMIC_SPI_DMA     1 // Batched DMA register reads of Trinamic SPI drivers, for monitoring without blocking the CPU.
+//#define TRINAMIC_MONITOR   100 // Poll Trinamic SPI driver status every 100 ms in the background, faults are reported as warnings and listed by $TMON. Requires TRINAMIC_SPI_DMA.
+//#define TRINAMIC_SOFT_SPI_DMA 1 // Clock software SPI Trinamic drivers by timer paced DMA (TIM8, DMA2 stream 1 and 4) instead of by the CPU. BTT SKR 2.0 only.
 //#define TRINAMIC_DEV         1 // Development mode, adds a few M-codes to aid debugging. Do not enable in production code.
 //#define FANS_ENABLE          1 // Enable fan control via M106/M107. Enables fans plugin.
 //#define EEPROM_ENABLE       16 // I2C EEPROM/FRAM support. Set to 16 for 2K, 32 for 4K, 64 for 8K, 128 for 16K and 256 for 32K capacity.
@@ -111,6 +136,7 @@
 //#define ESTOP_ENABLE         0 // When enabled only real-time report requests will be executed when the reset pin is asserted.
                                  // Note: if left commented out the default setting is determined from COMPATIBILITY_LEVEL.
 //#define MCP3221_ENABLE    0x4D // Enable MCP3221 I2C ADC input with address 0x4D (0b01001101).
+//#define STREAM_STATS_ENABLE  1 // Per stream throughput and health counters, reported by $STREAMS and reset by $STREAMS=R.
 
 // Optional control signals:
 // These will be assigned to aux input pins. Use the $pins command to check which pins are assigned.
@@ -145,7 +171,7 @@
 #define ETHERNET_ENABLE 1
 #endif
 
-#if ETHERNET_ENABLE || WEBUI_ENABLE
+#if ETHERNET_ENABLE || WEBUI_ENABLE || USB_NETWORK_ENABLE
 #define TELNET_ENABLE       1 // Telnet daemon - requires Ethernet streaming enabled.
 #define WEBSOCKET_ENABLE    1 // Websocket daemon - requires Ethernet streaming enabled.
 //#define MDNS_ENABLE         1 // mDNS daemon.
@@ -163,6 +189,7 @@
 //#define NETWORK_IP              "192.168.5.1"
 //#define NETWORK_GATEWAY         "192.168.5.1"
 //#define NETWORK_MASK            "255.255.255.0"
+//#define USB_NETWORK_IPMODE      0 // USB networking: 0 = static, 1 = DHCP, 2 = AutoIP
 //#define NETWORK_FTP_PORT        21
 //#define NETWORK_TELNET_PORT     23
 //#define NETWORK_HTTP_PORT       80
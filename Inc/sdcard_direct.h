@@ -0,0 +1,52 @@
+/*
+
+  sdcard_direct.h - direct sector streaming of contiguous SD card files
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ff.h"
+
+typedef struct {
+    FIL *file;
+    LBA_t lba;      // first sector of the file
+    FSIZE_t size;   // file size in bytes
+    FSIZE_t pos;    // current position
+} sdcard_direct_t;
+
+// Returns true if the file, opened for reading, is stored contiguously and can be read by sdcard_direct_read().
+// The position is taken from the file pointer, call sdcard_direct_seek() first if that is not sector aligned.
+bool sdcard_direct_open (sdcard_direct_t *stream, FIL *file);
+
+// Reads up to sectors whole sectors from the current, sector aligned, position straight to buf with a single multi block transfer.
+// Returns the number of valid bytes, less than sectors * 512 at the end of the file, 0 at end of file or on error.
+UINT sdcard_direct_read (sdcard_direct_t *stream, void *buf, UINT sectors);
+
+// Sets the position to the start of the sector containing pos, returns the offset of pos in that sector.
+UINT sdcard_direct_seek (sdcard_direct_t *stream, FSIZE_t pos);
+
+// Updates the FatFs file pointer to the current position, call before reading via FatFs again.
+FRESULT sdcard_direct_close (sdcard_direct_t *stream);
+
+/*EOF*/
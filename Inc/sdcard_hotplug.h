@@ -0,0 +1,54 @@
+/*
+
+  sdcard_hotplug.h - card detect driven background mount and cached directory index
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ff.h"
+
+#ifndef SDCARD_DIR_INDEX
+#define SDCARD_DIR_INDEX 64 // Max number of root directory entries in the index
+#endif
+
+typedef struct {
+    const char *name;
+    uint32_t size;
+    bool is_dir;
+} sdcard_dir_entry_t;
+
+// Returns true if the card is mounted, mounting is done in the background on card insertion.
+bool sdcard_hotplug_mounted (void);
+
+// Returns the number of entries in the root directory index, complete is set to false
+// if the index is being (re)built or has been truncated.
+uint_fast16_t sdcard_dir_index_count (bool *complete);
+bool sdcard_dir_index_get (uint_fast16_t idx, sdcard_dir_entry_t *entry);
+
+// Forces a rebuild of the index, call after files are added or deleted.
+void sdcard_dir_index_invalidate (void);
+
+void sdcard_hotplug_init (FATFS *fs);
+
+/*EOF*/
@@ -0,0 +1,52 @@
+/*
+
+  sdcard_index.h - FatFs fast seek and persisted line offset index for SD card jobs
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ff.h"
+
+#ifndef SDCARD_INDEX_STRIDE
+#define SDCARD_INDEX_STRIDE 64  // Lines per index entry
+#endif
+
+#ifndef SDCARD_CLMT_SIZE
+#define SDCARD_CLMT_SIZE    64  // Cluster link map size in DWORDs, (SDCARD_CLMT_SIZE - 1) / 2 fragments
+#endif
+
+// Creates the cluster link map for a file opened for reading, f_lseek() is then done without walking the FAT chain.
+// Only one file can have a link map at a time, the file should be closed with sdcard_index_close().
+FRESULT sdcard_index_open (FIL *file);
+void sdcard_index_close (FIL *file);
+
+// Builds the line offset index file (<path>.idx) if missing or out of date, returns the number of lines in lines if not NULL.
+FRESULT sdcard_index_build (const TCHAR *path, uint32_t *lines);
+
+// Positions file at the start of the given line (0 based) by using the index for path, it is built if needed.
+FRESULT sdcard_index_seek_line (FIL *file, const TCHAR *path, uint32_t line);
+
+void sdcard_index_init (void);
+
+/*EOF*/
@@ -0,0 +1,49 @@
+/*
+
+  sdcard_jobcache.h - compacted binary sidecar files for SD card jobs
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ff.h"
+
+typedef struct {
+    FIL file;
+    uint32_t lines;     // number of records
+    uint32_t src_size;  // size of the source file
+} sdcard_jobcache_t;
+
+// Opens the sidecar file (<path>.gcb) for path. If missing or out of date it is (re)built if build is true,
+// else FR_NO_FILE is returned. The file is positioned at the first record on return.
+FRESULT sdcard_jobcache_open (sdcard_jobcache_t *job, const TCHAR *path, bool build);
+
+// Reads the next record to line, null terminated. Returns the line length, 0 if the record
+// did not fit in size and was skipped, -1 at end of file or on error.
+int_fast16_t sdcard_jobcache_read_line (sdcard_jobcache_t *job, char *line, uint_fast16_t size);
+
+void sdcard_jobcache_close (sdcard_jobcache_t *job);
+
+void sdcard_jobcache_init (void);
+
+/*EOF*/
@@ -0,0 +1,58 @@
+/*
+
+  sdcard_reader.h - background read-ahead of SD card job files
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ff.h"
+
+typedef struct {
+    uint32_t level;         // current buffer fill in bytes
+    uint32_t level_min;     // lowest buffer fill seen while the job was running, after the initial fill
+    uint32_t starved;       // number of times the consumer found the buffer empty and had to wait for the card
+    uint32_t reads;         // buffer top ups
+    uint32_t read_ms_max;   // longest top up, the foreground loop is blocked for this long
+} sdcard_reader_stats_t;
+
+// Starts reading file, opened for reading and positioned at the start of the job, in the background.
+void sdcard_reader_start (FIL *file);
+
+// Stops background reading, the file is not closed.
+void sdcard_reader_stop (void);
+
+// Returns the next character of the job, -1 at end of file or on a read error.
+// Blocks and reads from the card if the buffer is empty.
+int16_t sdcard_reader_getc (void);
+
+// Returns true if the end of the file or an error has been reached, error is set on read errors.
+bool sdcard_reader_eof (bool *error);
+
+const sdcard_reader_stats_t *sdcard_reader_get_stats (void);
+
+// Registers the $FR command, hooks the buffer into jobs started by the SD card plugin
+// and adds the buffer state to the realtime report.
+void sdcard_reader_init (void);
+
+/*EOF*/
@@ -0,0 +1,47 @@
+/*
+
+  sdcard_upload.h - YModem upload to the SD card with write-behind buffering
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct {
+    uint32_t bytes;         // file bytes received
+    uint32_t ms;            // time from the header block to the end of the file
+    uint32_t blocks;        // data blocks received
+    uint32_t blocks_1k;     // of which 1024 byte blocks
+    uint32_t naks;          // blocks rejected and retransmitted
+    uint32_t flushes;       // card writes
+    uint32_t flush_ms_max;  // longest card write, the foreground loop is blocked for this long
+    uint32_t stalls;        // blocks that had to wait for buffer space before being acknowledged
+    uint32_t peak;          // peak buffer fill in bytes
+    bool contiguous;        // file space was preallocated as a single fragment
+} sdcard_upload_stats_t;
+
+const sdcard_upload_stats_t *sdcard_upload_get_stats (void);
+
+// Registers the $FY command.
+void sdcard_upload_init (void);
+
+/*EOF*/
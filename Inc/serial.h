@@ -33,6 +33,20 @@
 33 - GPIOC: TX = 10, RX =  5
 6  - GPIOC: TX =  6, RX =  7
 
+USART1 (1, 11) and USART6 (6) are clocked from APB2 and supports multi-megabaud rates, up to PCLK2/8.
+Oversampling by 8 is automatically selected for rates above PCLK/16. Use $UARTS to list actual rates.
+
+Hardware flow control (SERIALn_RTS_ENABLE = 1) pins:
+
+1, 11 - GPIOA: CTS = 11, RTS = 12 - not available when USB CDC is enabled
+2     - GPIOA: CTS =  0, RTS =  1
+21    - GPIOD: CTS =  3, RTS =  4
+3     - GPIOB: CTS = 13, RTS = 14
+32    - GPIOD: CTS = 11, RTS = 12
+
+Other ports may use GPIO driven RTS (SERIALn_RTS_ENABLE = 2), the board map must then
+define SERIALn_RTS_PORT and SERIALn_RTS_PIN.
+
 */
 
 #pragma once
@@ -22,11 +22,52 @@
 #ifndef _GRBL_SPI_H_
 #define _GRBL_SPI_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "main.h"
+
+typedef enum {
+    SPIXfer_Idle = 0,
+    SPIXfer_Queued,
+    SPIXfer_Active,
+    SPIXfer_Done,
+    SPIXfer_Failed
+} spi_xfer_state_t;
+
+typedef struct {
+    GPIO_TypeDef *cs_port;  // NULL if chip select is handled by the caller
+    uint8_t cs_pin;
+    uint32_t prescaler;     // SPI_BAUDRATEPRESCALER_x
+    uint32_t mode;          // SPI_POLARITY_x | SPI_PHASE_x
+    uint8_t priority;       // 0 is highest
+} spi_device_t;
+
+struct spi_transaction;
+
+typedef void (*spi_complete_ptr)(struct spi_transaction *transaction);
+
+typedef struct spi_transaction {
+    const spi_device_t *device;
+    const uint8_t *tx;      // NULL to transmit 0xFF
+    uint8_t *rx;            // NULL to discard received data
+    uint16_t len;
+    spi_complete_ptr on_complete; // called from the DMA interrupt, may be NULL
+    void *context;
+    volatile spi_xfer_state_t state;
+    struct spi_transaction *next;
+} spi_transaction_t;
+
 void spi_init (void);
 uint32_t spi_set_speed (uint32_t prescaler);
+uint32_t spi_get_clock (uint32_t prescaler);
 uint8_t spi_get_byte (void);
 uint8_t spi_put_byte (uint8_t byte);
 void spi_write (uint8_t *data, uint16_t len);
 void spi_read (uint8_t *data, uint16_t len);
+bool spi_submit (spi_transaction_t *transaction);
+void spi_claim (void);
+void spi_claim_device (const spi_device_t *device);
+void spi_release (void);
 
 #endif
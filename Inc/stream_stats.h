@@ -0,0 +1,59 @@
+/*
+
+  stream_stats.h - per stream throughput and health counters
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef struct stream_stats {
+    const char *name;
+    volatile uint32_t rx_bytes;     // characters received, including realtime commands
+    volatile uint32_t tx_bytes;     // characters queued for transmission
+    volatile uint32_t rt_commands;  // realtime commands extracted from the input
+    volatile uint32_t rx_overflows; // characters dropped due to input buffer full
+    volatile uint16_t rx_peak;      // peak input buffer fill
+    volatile uint16_t tx_peak;      // peak output buffer fill
+    volatile uint32_t blocked_us;   // time spent waiting for output buffer space in hal.stream_blocking_callback()
+    struct stream_stats *next;
+} stream_stats_t;
+
+// Counter updates, cheap enough for use in interrupt handlers.
+
+static inline void stream_stats_rx_fill (stream_stats_t *stats, uint_fast16_t count)
+{
+    if(count > stats->rx_peak)
+        stats->rx_peak = (uint16_t)count;
+}
+
+static inline void stream_stats_tx (stream_stats_t *stats, uint_fast16_t length, uint_fast16_t count)
+{
+    stats->tx_bytes += length;
+    if(count > stats->tx_peak)
+        stats->tx_peak = (uint16_t)count;
+}
+
+void stream_stats_register (stream_stats_t *stats);
+bool stream_stats_blocking_callback (stream_stats_t *stats);
+
+/*EOF*/
@@ -0,0 +1,65 @@
+/*
+
+  tmc_monitor.h - background health monitor for Trinamic SPI drivers
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "trinamic/common.h"
+
+#ifndef TRINAMIC_MONITOR_HISTORY
+#define TRINAMIC_MONITOR_HISTORY 16 // Number of StallGuard samples kept per motor
+#endif
+
+#ifndef TRINAMIC_MONITOR_BUDGET
+#define TRINAMIC_MONITOR_BUDGET 1   // Max CPU load in percent, the poll interval is increased to stay within it
+#endif
+
+typedef struct {
+    uint32_t drv_status;    // last DRV_STATUS read
+    uint32_t faults;        // fault flags (DRV_STATUS bits) seen since the last status report
+    uint16_t sg_result;     // last StallGuard load value, only updated while the motor is running
+    uint16_t sg_min;
+    uint16_t sg_max;
+    uint16_t sg_avg;        // average of the samples in the history
+    uint8_t head;
+    uint8_t count;
+    uint16_t history[TRINAMIC_MONITOR_HISTORY];
+} tmc_monitor_motor_t;
+
+typedef struct {
+    uint32_t polls;
+    uint32_t failed;        // polls that could not be started or completed with transfer errors
+    uint32_t interval;      // current poll interval in ms
+    uint32_t cost_us;       // CPU time spent by the last poll
+    uint32_t cost_us_max;
+} tmc_monitor_stats_t;
+
+// Returns NULL if the motor is not monitored.
+const tmc_monitor_motor_t *tmc_monitor_get (uint_fast8_t motor);
+const tmc_monitor_stats_t *tmc_monitor_get_stats (void);
+
+void tmc_monitor_init (void);
+
+/*EOF*/
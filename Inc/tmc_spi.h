@@ -0,0 +1,56 @@
+/*
+
+  tmc_spi.h - batched register reads of Trinamic SPI drivers
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "trinamic/common.h"
+
+struct tmc_spi_batch;
+
+typedef void (*tmc_spi_batch_ptr)(struct tmc_spi_batch *batch);
+
+typedef struct tmc_spi_batch {
+    uint8_t reg;                                // register address, the same register is read from all drivers
+    uint8_t motors;                             // bitmask of motors, by driver id, to read
+    volatile bool busy;
+    bool ok;                                    // set when the batch completed without transfer errors
+    TMC_spi_status_t status[TMC_N_MOTORS_MAX];  // status byte returned by each driver, by driver id
+    uint32_t value[TMC_N_MOTORS_MAX];           // register value returned by each driver, by driver id
+    uint32_t cycles;                            // CPU cycles spent in the completion interrupts
+    tmc_spi_batch_ptr on_complete;              // called from the DMA interrupt when done, may be NULL
+} tmc_spi_batch_t;
+
+// Starts reading a register from the drivers in batch->motors, returns immediately.
+// Returns false if a batch is already running or the transfer could not be started.
+// Only drivers with 40 bit datagrams are supported, not the TMC2660.
+bool tmc_spi_read_batch (tmc_spi_batch_t *batch);
+
+bool tmc_spi_batch_busy (void);
+
+// Returns a bitmask of the motors, by driver id, that have been configured by the Trinamic plugin.
+uint8_t tmc_spi_get_motors (void);
+
+/*EOF*/
@@ -45,6 +45,19 @@ typedef struct {
 extern volatile usb_linestate_t usb_linestate;
 
 const io_stream_t *usbInit (void);
-void usbBufferInput (uint8_t *data, uint32_t length);
+bool usbBufferInput (uint8_t *data, uint32_t length);
+void usbTxFlush (void);
+void usbTxComplete (void);
+void usbTxAbort (void);
+
+#if USB_SERIAL_DUAL
+
+extern volatile usb_linestate_t usb2_linestate;
+
+bool usb2BufferInput (uint8_t *data, uint32_t length);
+void usb2TxComplete (void);
+void usb2TxAbort (void);
+
+#endif
 
 /*EOF*/
@@ -17,16 +17,134 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <string.h>
 
 #include "main.h"
 #include "ff.h"
 
+#include "grbl/nuts_bolts.h"
+
+static
+uint32_t ClockKHz = 0;  /* Card clock after speed negotiation */
+
+static
+bool HighSpeed = false; /* Card switched to high speed mode (CMD6) */
+
+#if SDCARD_CACHE
+
+/* Write-through LRU cache of single sector reads, mainly FAT and directory sectors */
+static struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t tick;          /* Access counter, stamped on the lines for LRU replacement */
+    DWORD last;             /* Last sector read, sequential reads are not cached */
+    struct {
+        DWORD sector;
+        uint32_t used;      /* Last access tick, 0 if empty */
+        BYTE buf[512];
+    } line[SDCARD_CACHE];
+} cache;
+
+static
+void cache_invalidate (void)
+{
+    BYTE i;
+
+    for (i = 0; i < SDCARD_CACHE; i++)
+        cache.line[i].used = 0;
+}
+
+static
+bool cache_read (BYTE *buff, DWORD sector)
+{
+    BYTE i;
+
+    for (i = 0; i < SDCARD_CACHE; i++) {
+        if (cache.line[i].used && cache.line[i].sector == sector) {
+            memcpy(buff, cache.line[i].buf, 512);
+            cache.line[i].used = ++cache.tick;
+            cache.hits++;
+            return true;
+        }
+    }
+
+    cache.misses++;
+
+    return false;
+}
+
+static
+void cache_store (const BYTE *buff, DWORD sector)
+{
+    BYTE i, lru = 0;
+
+    for (i = 0; i < SDCARD_CACHE; i++) {
+        if (cache.line[i].used < cache.line[lru].used)
+            lru = i;
+    }
+
+    cache.line[lru].sector = sector;
+    cache.line[lru].used = ++cache.tick;
+    memcpy(cache.line[lru].buf, buff, 512);
+}
+
+/* Write-through, cached copies of the written sectors are updated */
+static
+void cache_write (const BYTE *buff, DWORD sector, UINT count)
+{
+    BYTE i;
+
+    for (i = 0; i < SDCARD_CACHE; i++) {
+        if (cache.line[i].used && cache.line[i].sector >= sector && cache.line[i].sector < sector + count)
+            memcpy(cache.line[i].buf, buff + (cache.line[i].sector - sector) * 512, 512);
+    }
+}
+
+#endif // SDCARD_CACHE
+
+static on_report_options_ptr on_report_options;
+
+static
+void report_options (bool newopt)
+{
+    on_report_options(newopt);
+
+    if (!newopt && ClockKHz) {
+        hal.stream.write("[SDCARD:");
+        hal.stream.write(uitoa(ClockKHz));
+        hal.stream.write(HighSpeed ? " kHz, high speed]" ASCII_EOL : " kHz]" ASCII_EOL);
+#if SDCARD_CACHE
+        hal.stream.write("[SDCACHE:");
+        hal.stream.write(uitoa(SDCARD_CACHE));
+        hal.stream.write(" sectors|hits:");
+        hal.stream.write(uitoa(cache.hits));
+        hal.stream.write("|misses:");
+        hal.stream.write(uitoa(cache.misses));
+        hal.stream.write("]" ASCII_EOL);
+#endif
+    }
+}
+
+/* Adds the negotiated card clock to the $I output */
+static
+void hook_report_options (void)
+{
+    static bool hooked = false;
+
+    if (!hooked) {
+        on_report_options = grbl.on_report_options;
+        grbl.on_report_options = report_options;
+        hooked = true;
+    }
+}
+
 #if !SDCARD_SDIO
 
 #include "diskio.h"
 #include "spi.h"
 
 #include "grbl/task.h"
+#include "grbl/protocol.h"
 
 #ifndef SDCARD_USE_DMA
 #define SDCARD_USE_DMA 1
@@ -35,6 +153,7 @@
 /* Definitions for MMC/SDC command */
 #define CMD0    (0x40+0)    /* GO_IDLE_STATE */
 #define CMD1    (0x40+1)    /* SEND_OP_COND */
+#define CMD6    (0x40+6)    /* SWITCH_FUNC */
 #define CMD8    (0x40+8)    /* SEND_IF_COND */
 #define CMD9    (0x40+9)    /* SEND_CSD */
 #define CMD10    (0x40+10)    /* SEND_CID */
@@ -48,23 +167,26 @@
 #define CMD41    (0x40+41)    /* SEND_OP_COND (ACMD) */
 #define CMD55    (0x40+55)    /* APP_CMD */
 #define CMD58    (0x40+58)    /* READ_OCR */
+#define CMD59    (0x40+59)    /* CRC_ON_OFF */
 
 #define BOOL bool
 #define TRUE true
 #define FALSE false
 
-/* asserts the CS pin to the card */
+/* claims the shared SPI bus and asserts the CS pin to the card */
 static inline
 void SELECT (void)
 {
+    spi_claim();
     DIGITAL_OUT(SD_CS_PORT, SD_CS_PIN, 0);
 }
 
-/* de-asserts the CS pin to the card */
+/* de-asserts the CS pin to the card and releases the bus for queued transfers */
 static inline
 void DESELECT (void)
 {
     DIGITAL_OUT(SD_CS_PORT, SD_CS_PIN, 1);
+    spi_release();
 }
 
 /*--------------------------------------------------------------------------
@@ -85,6 +207,30 @@ BYTE CardType;            /* b0:MMC, b1:SDC, b2:Block addressing */
 static
 BYTE PowerFlag = 0;     /* indicates if "power" is on */
 
+static volatile
+BYTE Remount = 0;       /* card content changed outside of FatFs */
+
+static volatile
+BYTE Yielding = 0;      /* foreground realtime processing is executed while waiting for the card */
+
+static
+WORD RxCRC;             /* CRC of the last data block received */
+
+static
+BYTE CrcOn = 0;         /* CRC checking could not be turned off, data blocks are sent with a valid CRC */
+
+static
+WORD crc16 (const BYTE *buf, UINT len);
+
+/* SPI clock prescalers, fastest first */
+static const
+uint32_t Prescalers[] = { SPI_BAUDRATEPRESCALER_2, SPI_BAUDRATEPRESCALER_4, SPI_BAUDRATEPRESCALER_8, SPI_BAUDRATEPRESCALER_16, SPI_BAUDRATEPRESCALER_32 };
+
+#define N_PRESCALERS (sizeof(Prescalers) / sizeof(uint32_t))
+
+static
+BYTE SpeedIdx = N_PRESCALERS - 1;  /* Current SPI clock prescaler */
+
 /*-----------------------------------------------------------------------*/
 /* Transmit a byte to MMC via SPI  (Platform dependent)                  */
 /*-----------------------------------------------------------------------*/
@@ -107,6 +253,27 @@ void rcvr_spi_m (BYTE *dst)
 
 #endif
 
+/*-----------------------------------------------------------------------*/
+/* Yield to the foreground while the card is busy                        */
+/*-----------------------------------------------------------------------*/
+/* Card programming may take hundreds of ms, realtime commands are       */
+/* executed and the step segment buffer is refilled meanwhile. The card  */
+/* is deselected so other devices may use the SPI bus, and the disk      */
+/* functions are not available until control is returned.                */
+
+static
+void yield (void)
+{
+    if (!Yielding) {
+        Yielding = 1;
+        DESELECT();            /* CS = H, the card keeps on programming */
+        rcvr_spi();            /* Idle (Release DO) */
+        protocol_exec_rt_system();
+        SELECT();            /* CS = L */
+        Yielding = 0;
+    }
+}
+
 /*-----------------------------------------------------------------------*/
 /* Wait for card ready                                                   */
 /*-----------------------------------------------------------------------*/
@@ -115,13 +282,15 @@ static
 BYTE wait_ready (void)
 {
     BYTE res;
+    UINT polls = 0;
 
 
     Timer2 = 50;    /* Wait for ready in timeout of 500ms */
     rcvr_spi();
-    do
-        res = rcvr_spi();
-    while ((res != 0xFF) && Timer2);
+    while (((res = rcvr_spi()) != 0xFF) && Timer2) {
+        if (!(++polls & 0x1F))    /* Yield every 32 polls, approx. 50 us at max speed */
+            yield();
+    }
 
     return res;
 }
@@ -190,13 +359,6 @@ void power_on (void)
     }
 }
 
-// set the SSI speed to the max setting
-static
-void set_max_speed(void)
-{
-    spi_set_speed(SPI_BAUDRATEPRESCALER_16);
-}
-
 static
 void power_off (void)
 {
@@ -240,8 +402,8 @@ BOOL rcvr_datablock (
     } while (btr -= 2);
 #endif
 
-    rcvr_spi();                        /* Discard CRC */
-    rcvr_spi();
+    RxCRC = (WORD)rcvr_spi() << 8;    /* Keep CRC for verification */
+    RxCRC |= rcvr_spi();
 
     return TRUE;                    /* Return with success */
 }
@@ -266,6 +428,7 @@ BOOL xmit_datablock (
 
     xmit_spi(token);                    /* Xmit data token */
     if (token != 0xFD) {    /* Is data token */
+        WORD crc = CrcOn ? crc16(buff, 512) : 0xFFFF;
 #if SDCARD_USE_DMA
         spi_write((uint8_t *)buff, 512); /* Xmit the 512 byte data block to MMC */
 #else
@@ -275,8 +438,8 @@ BOOL xmit_datablock (
             xmit_spi(*buff++);
         } while (--wc);
 #endif
-        xmit_spi(0xFF);                    /* CRC (Dummy) */
-        xmit_spi(0xFF);
+        xmit_spi((BYTE)(crc >> 8));        /* CRC (Dummy unless CRC checking is on) */
+        xmit_spi((BYTE)crc);
         resp = rcvr_spi();                /* Reveive data response */
         if ((resp & 0x1F) != 0x05)        /* If not accepted, return with error */
             return FALSE;
@@ -288,6 +451,43 @@ BOOL xmit_datablock (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* CRC calculation, commands (CRC7) and data blocks (CRC16)              */
+/*-----------------------------------------------------------------------*/
+
+static
+BYTE crc7 (const BYTE *buf, UINT len)
+{
+    BYTE crc = 0, i, d;
+
+    while (len--) {
+        d = *buf++;
+        for (i = 0; i < 8; i++) {
+            crc <<= 1;
+            if ((d ^ crc) & 0x80)
+                crc ^= 0x09;
+            d <<= 1;
+        }
+    }
+
+    return (crc << 1) | 0x01;    /* CRC7 + end bit */
+}
+
+static
+WORD crc16 (const BYTE *buf, UINT len)
+{
+    WORD crc = 0;
+    BYTE i;
+
+    while (len--) {
+        crc ^= (WORD)*buf++ << 8;
+        for (i = 0; i < 8; i++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
 /*-----------------------------------------------------------------------*/
 /* Send a command packet to MMC                                          */
 /*-----------------------------------------------------------------------*/
@@ -298,21 +498,20 @@ BYTE send_cmd (
     DWORD arg        /* Argument */
 )
 {
-    BYTE n, res;
+    BYTE n, res, pkt[5];
 
 
     if (wait_ready() != 0xFF) return 0xFF;
 
     /* Send command packet */
-    xmit_spi(cmd);                        /* Command */
-    xmit_spi((BYTE)(arg >> 24));        /* Argument[31..24] */
-    xmit_spi((BYTE)(arg >> 16));        /* Argument[23..16] */
-    xmit_spi((BYTE)(arg >> 8));            /* Argument[15..8] */
-    xmit_spi((BYTE)arg);                /* Argument[7..0] */
-    n = 0xff;
-    if (cmd == CMD0) n = 0x95;            /* CRC for CMD0(0) */
-    if (cmd == CMD8) n = 0x87;            /* CRC for CMD8(0x1AA) */
-    xmit_spi(n);
+    pkt[0] = cmd;                        /* Command */
+    pkt[1] = (BYTE)(arg >> 24);            /* Argument[31..24] */
+    pkt[2] = (BYTE)(arg >> 16);            /* Argument[23..16] */
+    pkt[3] = (BYTE)(arg >> 8);            /* Argument[15..8] */
+    pkt[4] = (BYTE)arg;                    /* Argument[7..0] */
+    for (n = 0; n < 5; n++)
+        xmit_spi(pkt[n]);
+    xmit_spi(crc7(pkt, 5));                /* Valid CRC for all commands, required when CRC checking is enabled */
 
     /* Receive command response */
     if (cmd == CMD12) rcvr_spi();        /* Skip a stuff byte when stop reading */
@@ -342,19 +541,16 @@ BYTE send_cmd (
 static
 BYTE send_cmd12 (void)
 {
-    BYTE n, res, val;
+    BYTE n, res = 0xFF, val, pkt[5] = { CMD12, 0, 0, 0, 0 };
 
     /* For CMD12, we don't wait for the card to be idle before we send
      * the new command.
      */
 
     /* Send command packet - the argument for CMD12 is ignored. */
-    xmit_spi(CMD12);
-    xmit_spi(0);
-    xmit_spi(0);
-    xmit_spi(0);
-    xmit_spi(0);
-    xmit_spi(0);
+    for (n = 0; n < 5; n++)
+        xmit_spi(pkt[n]);
+    xmit_spi(crc7(pkt, 5));                /* Valid CRC, required when CRC checking is enabled */
 
     /* Read up to 10 bytes from the card, remembering the value read if it's
        not 0xFF */
@@ -370,112 +566,30 @@ BYTE send_cmd12 (void)
     return res;            /* Return with the response value */
 }
 
-/*--------------------------------------------------------------------------
-
-   Public Functions
-
----------------------------------------------------------------------------*/
-
-
-/*-----------------------------------------------------------------------*/
-/* Initialize Disk Drive                                                 */
-/*-----------------------------------------------------------------------*/
-
-DSTATUS disk_initialize (
-    BYTE drv        /* Physical drive nmuber (0) */
-)
-{
-    BYTE n, ty, ocr[4];
-
-
-//  pinOut(7, 1);
-    if (drv) return STA_NOINIT;            /* Supports only single drive */
-    if (Stat & STA_NODISK) return Stat;    /* No card in the socket */
-
-    power_on();                            /* Force socket power on */
-
-    send_initial_clock_train();            /* Ensure the card is in SPI mode */
-
-    SELECT();                /* CS = L */
-
-    ty = 0;
-    if (send_cmd(CMD0, 0) == 1) {            /* Enter Idle state */
-        Timer1 = 100;                        /* Initialization timeout of 1000 msec */
-        if (send_cmd(CMD8, 0x1AA) == 1) {    /* SDC Ver2+ */
-            for (n = 0; n < 4; n++) ocr[n] = rcvr_spi();
-            if (ocr[2] == 0x01 && ocr[3] == 0xAA) {    /* The card can work at vdd range of 2.7-3.6V */
-                do {
-                    if (send_cmd(CMD55, 0) <= 1 && send_cmd(CMD41, 1UL << 30) == 0)    break;    /* ACMD41 with HCS bit */
-                } while (Timer1);
-                if (Timer1 && send_cmd(CMD58, 0) == 0) {    /* Check CCS bit */
-                    for (n = 0; n < 4; n++) ocr[n] = rcvr_spi();
-                    ty = (ocr[0] & 0x40) ? 6 : 2;
-                }
-            }
-        } else {                            /* SDC Ver1 or MMC */
-            ty = (send_cmd(CMD55, 0) <= 1 && send_cmd(CMD41, 0) <= 1) ? 2 : 1;    /* SDC : MMC */
-            do {
-                if (ty == 2) {
-                    if (send_cmd(CMD55, 0) <= 1 && send_cmd(CMD41, 0) == 0) break;    /* ACMD41 */
-                } else {
-                    if (send_cmd(CMD1, 0) == 0) break;                                /* CMD1 */
-                }
-            } while (Timer1);
-            if (!Timer1 || send_cmd(CMD16, 512) != 0)    /* Select R/W block length */
-                ty = 0;
-        }
-    }
-
-    CardType = ty;
-    DESELECT();            /* CS = H */
-    rcvr_spi();            /* Idle (Release DO) */
-
-    if (ty) {            /* Initialization succeded */
-        Stat &= ~STA_NOINIT;        /* Clear STA_NOINIT */
-        set_max_speed();
-    } else {            /* Initialization failed */
-        power_off();
-    }
-
-    return Stat;
-}
-
-
-
-/*-----------------------------------------------------------------------*/
-/* Get Disk Status                                                       */
-/*-----------------------------------------------------------------------*/
-
-DSTATUS disk_status (
-    BYTE drv        /* Physical drive nmuber (0) */
-)
-{
-    if (drv) return STA_NOINIT;        /* Supports only single drive */
-    return Stat;
-}
-
-
-
 /*-----------------------------------------------------------------------*/
-/* Read Sector(s)                                                        */
+/* Read sectors from the card                                            */
 /*-----------------------------------------------------------------------*/
+/* Returns the number of sectors not read, 0 on success.                 */
+/* Up to *ahead following sectors are read to abuf by the same command,  */
+/* *ahead is set to the number of sectors read ahead on return.          */
 
-DRESULT disk_read (
-    BYTE drv,            /* Physical drive nmuber (0) */
+static
+UINT read_sectors (
     BYTE *buff,            /* Pointer to the data buffer to store read data */
     DWORD sector,        /* Start sector number (LBA) */
-    UINT count            /* Sector count (1..255) */
+    UINT count,            /* Sector count (1..255) */
+    BYTE *abuf,            /* Pointer to the buffer for sectors read ahead */
+    UINT *ahead            /* Sectors to read ahead, NULL if none */
 )
 {
-    if (drv || !count) return RES_PARERR;
-    if (Stat & STA_NOINIT) return RES_NOTRDY;
+    UINT n = 0;
 
     if (!(CardType & 4)) sector *= 512;    /* Convert to byte address if needed */
 
     SELECT();            /* CS = L */
 //  __HAL_SPI_ENABLE(&hspi1);
 
-    if (count == 1) {    /* Single block read */
+    if (count == 1 && !(ahead && *ahead)) {    /* Single block read */
         if ((send_cmd(CMD17, sector) == 0)    /* READ_SINGLE_BLOCK */
             && rcvr_datablock(buff, 512))
             count = 0;
@@ -486,114 +600,518 @@ DRESULT disk_read (
                 if (!rcvr_datablock(buff, 512)) break;
                 buff += 512;
             } while (--count);
+            if (!count && ahead) {        /* Continue into the read-ahead buffer, stops at the end of the card */
+                while (n < *ahead && rcvr_datablock(abuf, 512)) {
+                    abuf += 512;
+                    n++;
+                }
+            }
             send_cmd12();                /* STOP_TRANSMISSION */
         }
     }
 
+    if (ahead)
+        *ahead = n;
+
     DESELECT();            /* CS = H */
     rcvr_spi();            /* Idle (Release DO) */
 
-    return count ? RES_ERROR : RES_OK;
+    return count;
 }
 
-
-
 /*-----------------------------------------------------------------------*/
-/* Write Sector(s)                                                       */
+/* Card clock negotiation                                                */
 /*-----------------------------------------------------------------------*/
 
-#if FF_FS_READONLY == 0
-DRESULT disk_write (
-    BYTE drv,            /* Physical drive nmuber (0) */
-    const BYTE *buff,    /* Pointer to the data to be written */
-    DWORD sector,        /* Start sector number (LBA) */
-    UINT count            /* Sector count (1..255) */
-)
+/* Switches a SDC to high speed mode (CMD6), allows up to 50 MHz clock */
+static
+BOOL switch_high_speed (void)
 {
-    if (drv || !count) return RES_PARERR;
-    if (Stat & STA_NOINIT) return RES_NOTRDY;
-    if (Stat & STA_PROTECT) return RES_WRPRT;
+    BYTE status[64];
+    BOOL ok = FALSE;
 
-    if (!(CardType & 4)) sector *= 512;    /* Convert to byte address if needed */
+    if (!(CardType & 2)) return FALSE;    /* SDC only */
 
     SELECT();            /* CS = L */
-//  __HAL_SPI_ENABLE(&hspi1);
 
-    if (count == 1) {    /* Single block write */
-        if ((send_cmd(CMD24, sector) == 0)    /* WRITE_BLOCK */
-            && xmit_datablock(buff, 0xFE))
-            count = 0;
-    }
-    else {                /* Multiple block write */
-        if (CardType & 2) {
-            send_cmd(CMD55, 0); send_cmd(CMD23, count);    /* ACMD23 */
-        }
-        if (send_cmd(CMD25, sector) == 0) {    /* WRITE_MULTIPLE_BLOCK */
-            do {
-                if (!xmit_datablock(buff, 0xFC)) break;
-                buff += 512;
-            } while (--count);
-            if (!xmit_datablock(0, 0xFD))    /* STOP_TRAN token */
-                count = 1;
-        }
-    }
+    if (send_cmd(CMD6, 0x80FFFFF1) == 0 && rcvr_datablock(status, 64))    /* Switch function group 1 to high speed */
+        ok = (status[16] & 0x0F) == 1;    /* Function group 1 switched to function 1 */
 
     DESELECT();            /* CS = H */
     rcvr_spi();            /* Idle (Release DO) */
 
-    return count ? RES_ERROR : RES_OK;
+    return ok;
 }
-#endif /* _READONLY */
 
-#endif // SDCARD_SDIO
+/* Reads the first sector a few times with CRC checking enabled */
+static
+BOOL read_test (void)
+{
+    BYTE buf[512], n = 4;
+    BOOL ok;
 
-/*-----------------------------------------------------------------------*/
-/* Miscellaneous Functions                                               */
-/*-----------------------------------------------------------------------*/
+    SELECT();            /* CS = L */
 
-DRESULT disk_ioctl (
-    BYTE drv,        /* Physical drive nmuber (0) */
-    BYTE ctrl,        /* Control code */
-    void *buff        /* Buffer to send/receive control data */
-)
-{
-    DRESULT res;
-    BYTE n, csd[16], *ptr = buff;
-    WORD csize;
+    if ((ok = send_cmd(CMD59, 1) == 0)) {    /* CRC_ON_OFF, enable CRC */
+        do {
+            ok = send_cmd(CMD17, 0) == 0 && rcvr_datablock(buf, 512) && RxCRC == crc16(buf, 512);
+        } while (ok && --n);
+    }
 
+    /* Disable CRC again, data blocks are written with a dummy CRC. */
+    /* After a failed test the command is sent at the lowest clock rate. */
+    if (!ok)
+        spi_set_speed(Prescalers[N_PRESCALERS - 1]);
 
-    if (drv) return RES_PARERR;
+    CrcOn = send_cmd(CMD59, 0) != 0;
 
-    res = RES_ERROR;
+    if (!ok)
+        spi_set_speed(Prescalers[SpeedIdx]);
 
-    if (ctrl == CTRL_POWER) {
-        switch (*ptr) {
-        case 0:        /* Sub control code == 0 (POWER_OFF) */
-            if (chk_power())
-                power_off();        /* Power off */
-            res = RES_OK;
-            break;
-        case 1:        /* Sub control code == 1 (POWER_ON) */
-            power_on();                /* Power on */
-            res = RES_OK;
-            break;
-        case 2:        /* Sub control code == 2 (POWER_GET) */
-            *(ptr+1) = (BYTE)chk_power();
-            res = RES_OK;
-            break;
-        default :
-            res = RES_PARERR;
-        }
-    }
-    else {
-        if (Stat & STA_NOINIT) return RES_NOTRDY;
+    DESELECT();            /* CS = H */
+    rcvr_spi();            /* Idle (Release DO) */
 
-        SELECT();        /* CS = L */
-//      __HAL_SPI_ENABLE(&hspi1);
+    return ok;
+}
 
-        switch (ctrl) {
-        case GET_SECTOR_COUNT :    /* Get number of sectors on the disk (DWORD) */
-            if ((send_cmd(CMD9, 0) == 0) && rcvr_datablock(csd, 16)) {
+static
+void set_speed (BYTE idx)
+{
+    SpeedIdx = idx;
+    spi_set_speed(Prescalers[idx]);
+    ClockKHz = spi_get_clock(Prescalers[idx]) / 1000;
+}
+
+/* Steps the SPI clock up to the fastest rate supported by the card that passes the read test */
+static
+void set_max_speed (void)
+{
+    BYTE idx;
+    uint32_t max_khz;
+
+    HighSpeed = switch_high_speed();
+    max_khz = CardType == 1 ? 20000 : (HighSpeed ? 50000 : 25000);
+
+    for (idx = 0; idx < N_PRESCALERS - 1; idx++) {
+        if (spi_get_clock(Prescalers[idx]) / 1000 <= max_khz) {
+            set_speed(idx);
+            if (read_test())
+                break;
+        }
+    }
+
+    set_speed(idx);
+}
+
+/* Steps the SPI clock down after a transfer error, returns FALSE if already at the lowest rate */
+static
+BOOL slow_down (void)
+{
+    if (SpeedIdx >= N_PRESCALERS - 1)
+        return FALSE;
+
+    set_speed(SpeedIdx + 1);
+
+    return TRUE;
+}
+
+#if SDCARD_READAHEAD
+
+/*-----------------------------------------------------------------------*/
+/* Sector read-ahead                                                     */
+/*-----------------------------------------------------------------------*/
+/* When FatFs reads consecutive sectors the following sectors are read  */
+/* into a buffer by the same CMD18 as the requested ones. Further        */
+/* sequential reads are then served from RAM, the command overhead and   */
+/* the wait for the first data token is paid once per buffer fill.       */
+/* Reads outside the stream, such as FAT sectors, bypass the buffer and  */
+/* leave it intact so the stream continues across cluster boundaries.    */
+/* Sectors are only read from disk_read(), never from the realtime loop. */
+/* The read that refills the buffer is polled and takes longer than the  */
+/* request alone, card latency still blocks the caller.                  */
+
+static struct {
+    BOOL armed;            /* Sequential access detected */
+    DWORD next;            /* Sector number (LBA) of the first sector in the ring */
+    DWORD prev;            /* Last sector read from the card, a read following it starts a new stream */
+    UINT head;            /* Ring index of the first sector */
+    UINT count;            /* Number of sectors in the ring */
+    BYTE buf[SDCARD_READAHEAD][512] __attribute__((aligned(4)));
+} ra = {0};
+
+static
+void ra_invalidate (void)
+{
+    ra.armed = FALSE;
+    ra.head = ra.count = 0;
+}
+
+/* Restarts read-ahead from the given sector */
+static
+void ra_rebase (DWORD sector)
+{
+    ra.armed = TRUE;
+    ra.next = sector;
+    ra.head = ra.count = 0;
+}
+
+/* Copies sectors available in the ring buffer to buff, returns the number of sectors copied */
+static
+UINT ra_read (BYTE *buff, DWORD sector, UINT count)
+{
+    UINT n = 0;
+
+    if (ra.count && sector >= ra.next && sector < ra.next + ra.count) {
+
+        UINT skip = sector - ra.next;    /* Sectors skipped are dropped */
+
+        ra.head = (ra.head + skip) % SDCARD_READAHEAD;
+        ra.count -= skip;
+        ra.next = sector;
+
+        while (count-- && ra.count) {
+            memcpy(buff, ra.buf[ra.head], 512);
+            ra.head = (ra.head + 1) % SDCARD_READAHEAD;
+            ra.count--;
+            ra.next++;
+            buff += 512;
+            n++;
+        }
+    }
+
+    return n;
+}
+
+#endif // SDCARD_READAHEAD
+
+/*--------------------------------------------------------------------------
+
+   Public Functions
+
+---------------------------------------------------------------------------*/
+
+
+/*-----------------------------------------------------------------------*/
+/* Initialize Disk Drive                                                 */
+/*-----------------------------------------------------------------------*/
+
+/* The initialization is split in steps so it can be polled, the card   */
+/* may take up to 1 s to leave the idle state. Each step holds the bus   */
+/* for a single ACMD41/CMD1 attempt.                                     */
+
+static
+BYTE InitTy = 0;        /* Card type being initialized, 0 if none (b2: SDC Ver2+, CCS read on completion) */
+
+static
+BYTE InitDone = 0;      /* Card initialized by polling, the next disk_initialize() call is skipped */
+
+static
+void init_finish (
+    BYTE ty            /* Card type, 0 on failure */
+)
+{
+    CardType = ty;
+    InitTy = 0;
+    DESELECT();            /* CS = H */
+    rcvr_spi();            /* Idle (Release DO) */
+
+    if (ty) {            /* Initialization succeded */
+        Stat &= ~STA_NOINIT;        /* Clear STA_NOINIT */
+        set_max_speed();
+        hook_report_options();
+    } else {            /* Initialization failed */
+        power_off();
+    }
+}
+
+/* Resets the card, returns TRUE if init_step() has to be called until the card is ready */
+static
+BOOL init_start (void)
+{
+    BYTE n, ocr[4];
+
+
+//  pinOut(7, 1);
+    power_on();                            /* Force socket power on */
+
+#if SDCARD_READAHEAD
+    ra_invalidate();
+#endif
+#if SDCARD_CACHE
+    cache_invalidate();
+#endif
+
+    send_initial_clock_train();            /* Ensure the card is in SPI mode */
+
+    SELECT();                /* CS = L */
+
+    InitTy = InitDone = 0;
+    CrcOn = 0;                /* CRC checking is off after reset */
+    if (send_cmd(CMD0, 0) == 1) {            /* Enter Idle state */
+        Timer1 = 100;                        /* Initialization timeout of 1000 msec */
+        if (send_cmd(CMD8, 0x1AA) == 1) {    /* SDC Ver2+ */
+            for (n = 0; n < 4; n++) ocr[n] = rcvr_spi();
+            if (ocr[2] == 0x01 && ocr[3] == 0xAA)    /* The card can work at vdd range of 2.7-3.6V */
+                InitTy = 4;
+        } else                                /* SDC Ver1 or MMC */
+            InitTy = (send_cmd(CMD55, 0) <= 1 && send_cmd(CMD41, 0) <= 1) ? 2 : 1;    /* SDC : MMC */
+    }
+
+    if (!InitTy) {
+        init_finish(0);
+        return FALSE;
+    }
+
+    DESELECT();            /* CS = H */
+    rcvr_spi();            /* Idle (Release DO) */
+
+    return TRUE;
+}
+
+/* Makes one attempt at leaving the idle state, returns TRUE if the card is still initializing */
+static
+BOOL init_step (void)
+{
+    BYTE n, ty = 0, ocr[4];
+    BOOL ready;
+
+
+    SELECT();                /* CS = L */
+
+    if (InitTy == 4)
+        ready = send_cmd(CMD55, 0) <= 1 && send_cmd(CMD41, 1UL << 30) == 0;    /* ACMD41 with HCS bit */
+    else if (InitTy == 2)
+        ready = send_cmd(CMD55, 0) <= 1 && send_cmd(CMD41, 0) == 0;    /* ACMD41 */
+    else
+        ready = send_cmd(CMD1, 0) == 0;                                /* CMD1 */
+
+    if (!ready && Timer1) {
+        DESELECT();            /* CS = H */
+        rcvr_spi();            /* Idle (Release DO) */
+        return TRUE;
+    }
+
+    if (ready) {
+        if (InitTy == 4) {
+            if (send_cmd(CMD58, 0) == 0) {    /* Check CCS bit */
+                for (n = 0; n < 4; n++) ocr[n] = rcvr_spi();
+                ty = (ocr[0] & 0x40) ? 6 : 2;
+            }
+        } else if (send_cmd(CMD16, 512) == 0)    /* Select R/W block length */
+            ty = InitTy;
+    }
+
+    init_finish(ty);
+
+    return FALSE;
+}
+
+DSTATUS disk_initialize (
+    BYTE drv        /* Physical drive nmuber (0) */
+)
+{
+    if (drv || Yielding) return STA_NOINIT;    /* Supports only single drive */
+    if (Stat & STA_NODISK) return Stat;    /* No card in the socket */
+
+    if (InitDone) {                        /* Initialized by MMC_INIT_STEP polling */
+        InitDone = 0;
+        if (!(Stat & STA_NOINIT)) return Stat;
+    }
+
+    if (init_start())
+        while (init_step());
+
+    return Stat;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Get Disk Status                                                       */
+/*-----------------------------------------------------------------------*/
+
+DSTATUS disk_status (
+    BYTE drv        /* Physical drive nmuber (0) */
+)
+{
+    if (drv) return STA_NOINIT;        /* Supports only single drive */
+    if (Remount) {                     /* Report not initialized once to have FatFs remount the volume */
+        Remount = 0;
+        return Stat | STA_NOINIT;
+    }
+    return Stat;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s)                                                        */
+/*-----------------------------------------------------------------------*/
+
+static
+DRESULT card_read (
+    BYTE drv,            /* Physical drive nmuber (0) */
+    BYTE *buff,            /* Pointer to the data buffer to store read data */
+    DWORD sector,        /* Start sector number (LBA) */
+    UINT count            /* Sector count (1..255) */
+)
+{
+    if (drv || !count) return RES_PARERR;
+    if ((Stat & STA_NOINIT) || Yielding) return RES_NOTRDY;
+
+#if SDCARD_READAHEAD
+    UINT n = ra_read(buff, sector, count);
+
+    if (n == count) return RES_OK;
+
+    buff += n * 512;
+    sector += n;
+    count -= n;
+
+    BOOL sequential = (ra.armed && sector == ra.next + ra.count) || sector == ra.prev + 1;
+    UINT ahead = SDCARD_READAHEAD;
+
+    ra.prev = sector + count - 1;
+    if (sequential) ra_invalidate();    /* The ring is refilled by this read, else kept for the stream */
+
+    if ((n = read_sectors(buff, sector, count, ra.buf[0], sequential ? &ahead : NULL)) && slow_down()) {    /* Retry at a lower clock rate on error */
+        ahead = SDCARD_READAHEAD;
+        n = read_sectors(buff, sector, count, ra.buf[0], sequential ? &ahead : NULL);
+    }
+
+    if (n == 0 && sequential) {
+        ra_rebase(ra.prev + 1);
+        ra.count = ahead;
+    }
+
+    return n ? RES_ERROR : RES_OK;
+#else
+    if (read_sectors(buff, sector, count, NULL, NULL) && (!slow_down() || read_sectors(buff, sector, count, NULL, NULL)))    /* Retry at a lower clock rate on error */
+        return RES_ERROR;
+
+    return RES_OK;
+#endif
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s)                                                       */
+/*-----------------------------------------------------------------------*/
+
+#if FF_FS_READONLY == 0
+static
+DRESULT card_write (
+    BYTE drv,            /* Physical drive nmuber (0) */
+    const BYTE *buff,    /* Pointer to the data to be written */
+    DWORD sector,        /* Start sector number (LBA) */
+    UINT count            /* Sector count (1..255) */
+)
+{
+    if (drv || !count) return RES_PARERR;
+    if ((Stat & STA_NOINIT) || Yielding) return RES_NOTRDY;
+    if (Stat & STA_PROTECT) return RES_WRPRT;
+
+#if SDCARD_READAHEAD
+    if (sector < ra.next + ra.count && sector + count > ra.next)    /* Discard overwritten sectors */
+        ra_invalidate();
+#endif
+
+    if (!(CardType & 4)) sector *= 512;    /* Convert to byte address if needed */
+
+    SELECT();            /* CS = L */
+//  __HAL_SPI_ENABLE(&hspi1);
+
+    if (count == 1) {    /* Single block write */
+        if ((send_cmd(CMD24, sector) == 0)    /* WRITE_BLOCK */
+            && xmit_datablock(buff, 0xFE))
+            count = 0;
+    }
+    else {                /* Multiple block write */
+        if (CardType & 2) {
+            send_cmd(CMD55, 0); send_cmd(CMD23, count);    /* ACMD23 */
+        }
+        if (send_cmd(CMD25, sector) == 0) {    /* WRITE_MULTIPLE_BLOCK */
+            do {
+                if (!xmit_datablock(buff, 0xFC)) break;
+                buff += 512;
+            } while (--count);
+            if (!xmit_datablock(0, 0xFD))    /* STOP_TRAN token */
+                count = 1;
+        }
+    }
+
+    DESELECT();            /* CS = H */
+    rcvr_spi();            /* Idle (Release DO) */
+
+    return count ? RES_ERROR : RES_OK;
+}
+#endif /* _READONLY */
+
+/*-----------------------------------------------------------------------*/
+/* Miscellaneous Functions                                               */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_ioctl (
+    BYTE drv,        /* Physical drive nmuber (0) */
+    BYTE ctrl,        /* Control code */
+    void *buff        /* Buffer to send/receive control data */
+)
+{
+    DRESULT res;
+    BYTE n, csd[16], *ptr = buff;
+    WORD csize;
+
+
+    if (drv) return RES_PARERR;
+
+    res = RES_ERROR;
+
+    if (ctrl == CTRL_POWER) {
+        switch (*ptr) {
+        case 0:        /* Sub control code == 0 (POWER_OFF) */
+            if (chk_power())
+                power_off();        /* Power off */
+            res = RES_OK;
+            break;
+        case 1:        /* Sub control code == 1 (POWER_ON) */
+            power_on();                /* Power on */
+            res = RES_OK;
+            break;
+        case 2:        /* Sub control code == 2 (POWER_GET) */
+            *(ptr+1) = (BYTE)chk_power();
+            res = RES_OK;
+            break;
+        default :
+            res = RES_PARERR;
+        }
+    }
+    else if (ctrl == MMC_INIT_STEP) {    /* Polled initialization, *ptr is set to 1 while the card is initializing */
+        if (Yielding || (Stat & STA_NODISK)) return RES_NOTRDY;
+        Stat |= STA_NOINIT;
+        *ptr = InitTy ? init_step() : init_start();
+        InitDone = !*ptr && !(Stat & STA_NOINIT);
+        res = *ptr || InitDone ? RES_OK : RES_ERROR;
+    }
+    else if (ctrl == CTRL_EJECT) {    /* Card content changed by another host (USB mass storage) */
+        Remount = 1;
+#if SDCARD_READAHEAD
+        ra_invalidate();
+#endif
+#if SDCARD_CACHE
+        cache_invalidate();
+#endif
+        res = RES_OK;
+    }
+    else {
+        if ((Stat & STA_NOINIT) || Yielding) return RES_NOTRDY;
+
+        SELECT();        /* CS = L */
+//      __HAL_SPI_ENABLE(&hspi1);
+
+        switch (ctrl) {
+        case GET_SECTOR_COUNT :    /* Get number of sectors on the disk (DWORD) */
+            if ((send_cmd(CMD9, 0) == 0) && rcvr_datablock(csd, 16)) {
                 if ((csd[0] >> 6) == 1) {    /* SDC ver 2.00 */
                     csize = csd[9] + ((WORD)csd[8] << 8) + 1;
                     *(DWORD*)buff = (DWORD)csize << 10;
@@ -652,6 +1170,346 @@ DRESULT disk_ioctl (
 }
 
 
+#else // SDCARD_SDIO
+
+/*-----------------------------------------------------------------------*/
+/* SD card in SDIO 4-bit mode, DMA transfers via bsp_driver_sd.c         */
+/*-----------------------------------------------------------------------*/
+
+#include "diskio.h"
+#include "bsp_driver_sd.h"
+
+#define SD_TIMEOUT 1000    /* Transfer and programming timeout in ms */
+
+static volatile
+DSTATUS Stat = STA_NOINIT;    /* Disk status */
+
+static volatile
+BYTE Remount = 0;       /* card content changed outside of FatFs */
+
+static volatile
+BYTE XferStatus = 0;    /* 0: transfer in progress, 1: completed, 2: failed */
+
+static
+BYTE InitDone = 0;      /* Card initialized by MMC_INIT_STEP, the next disk_initialize() call is skipped */
+
+static
+uint32_t scratch[512 / 4];    /* Word aligned bounce buffer for DMA transfers to/from unaligned buffers */
+
+/* Called from the SDIO interrupt */
+
+void BSP_SD_ReadCpltCallback (void)
+{
+    XferStatus = 1;
+}
+
+void BSP_SD_WriteCpltCallback (void)
+{
+    XferStatus = 1;
+}
+
+void BSP_SD_ErrorCallback (void)
+{
+    XferStatus = 2;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Wait for card ready, programming may be in progress after a write     */
+/*-----------------------------------------------------------------------*/
+
+static
+bool wait_ready (void)
+{
+    uint32_t ms = hal.get_elapsed_ticks();
+
+    while (BSP_SD_GetCardState() != SD_TRANSFER_OK) {
+        if (hal.get_elapsed_ticks() - ms > SD_TIMEOUT)
+            return false;
+    }
+
+    return true;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Wait for DMA transfer completion                                      */
+/*-----------------------------------------------------------------------*/
+
+static
+bool wait_transfer (void)
+{
+    uint32_t ms = hal.get_elapsed_ticks();
+
+    while (!XferStatus) {
+        if (hal.get_elapsed_ticks() - ms > SD_TIMEOUT) {
+            BSP_SD_Abort();
+            return false;
+        }
+    }
+
+    return XferStatus == 1 && wait_ready();
+}
+
+static
+bool read_blocks (BYTE *buff, DWORD sector, UINT count)
+{
+    XferStatus = 0;
+
+    return BSP_SD_ReadBlocks_DMA((uint32_t *)buff, sector, count) == MSD_OK && wait_transfer();
+}
+
+static
+bool write_blocks (const BYTE *buff, DWORD sector, UINT count)
+{
+    XferStatus = 0;
+
+    return BSP_SD_WriteBlocks_DMA((uint32_t *)buff, sector, count) == MSD_OK && wait_transfer();
+}
+
+/* Reads the first sector a few times, the SDIO hardware checks the data CRC */
+static
+bool read_test (void)
+{
+    BYTE n = 4;
+
+    while (read_blocks((BYTE *)scratch, 0, 1) && --n);
+
+    return n == 0;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Initialize Disk Drive                                                 */
+/*-----------------------------------------------------------------------*/
+
+DSTATUS disk_initialize (
+    BYTE drv        /* Physical drive nmuber (0) */
+)
+{
+    if (drv) return STA_NOINIT;            /* Supports only single drive */
+
+    if (InitDone) {
+        InitDone = 0;
+        if (!(Stat & STA_NOINIT)) return Stat;
+    }
+
+    Stat = STA_NOINIT;
+
+#if SDCARD_CACHE
+    cache_invalidate();
+#endif
+
+    if (BSP_SD_IsDetected() != SD_PRESENT)
+        Stat |= STA_NODISK;
+    else if (BSP_SD_Init() == MSD_OK && wait_ready()) {
+        Stat = 0;
+        if ((HighSpeed = BSP_SD_HighSpeed(1) == MSD_OK && read_test()) == false)
+            BSP_SD_HighSpeed(0);    /* Not supported or unreliable, revert to default speed */
+        ClockKHz = BSP_SD_GetClockKHz();
+        hook_report_options();
+    }
+
+    return Stat;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Get Disk Status                                                       */
+/*-----------------------------------------------------------------------*/
+
+DSTATUS disk_status (
+    BYTE drv        /* Physical drive nmuber (0) */
+)
+{
+    if (drv) return STA_NOINIT;        /* Supports only single drive */
+    if (BSP_SD_IsDetected() != SD_PRESENT)    /* Card removed, must be initialized again */
+        Stat = STA_NOINIT|STA_NODISK;
+    if (Remount) {                     /* Report not initialized once to have FatFs remount the volume */
+        Remount = 0;
+        return Stat | STA_NOINIT;
+    }
+    return Stat;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s)                                                        */
+/*-----------------------------------------------------------------------*/
+
+static
+DRESULT card_read (
+    BYTE drv,            /* Physical drive nmuber (0) */
+    BYTE *buff,            /* Pointer to the data buffer to store read data */
+    DWORD sector,        /* Start sector number (LBA) */
+    UINT count            /* Sector count (1..255) */
+)
+{
+    if (drv || !count) return RES_PARERR;
+    if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+    if (!((uint32_t)buff & 0x03))        /* Word aligned, DMA directly to the buffer */
+        return read_blocks(buff, sector, count) ? RES_OK : RES_ERROR;
+
+    do {
+        if (!read_blocks((BYTE *)scratch, sector++, 1))
+            return RES_ERROR;
+        memcpy(buff, scratch, 512);
+        buff += 512;
+    } while (--count);
+
+    return RES_OK;
+}
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s)                                                       */
+/*-----------------------------------------------------------------------*/
+
+#if FF_FS_READONLY == 0
+static
+DRESULT card_write (
+    BYTE drv,            /* Physical drive nmuber (0) */
+    const BYTE *buff,    /* Pointer to the data to be written */
+    DWORD sector,        /* Start sector number (LBA) */
+    UINT count            /* Sector count (1..255) */
+)
+{
+    if (drv || !count) return RES_PARERR;
+    if (Stat & STA_NOINIT) return RES_NOTRDY;
+    if (Stat & STA_PROTECT) return RES_WRPRT;
+
+    if (!((uint32_t)buff & 0x03))        /* Word aligned, DMA directly from the buffer */
+        return write_blocks(buff, sector, count) ? RES_OK : RES_ERROR;
+
+    do {
+        memcpy(scratch, buff, 512);
+        if (!write_blocks((BYTE *)scratch, sector++, 1))
+            return RES_ERROR;
+        buff += 512;
+    } while (--count);
+
+    return RES_OK;
+}
+#endif /* _READONLY */
+
+/*-----------------------------------------------------------------------*/
+/* Miscellaneous Functions                                               */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_ioctl (
+    BYTE drv,        /* Physical drive nmuber (0) */
+    BYTE ctrl,        /* Control code */
+    void *buff        /* Buffer to send/receive control data */
+)
+{
+    DRESULT res = RES_ERROR;
+    BSP_SD_CardInfo info;
+
+
+    if (drv) return RES_PARERR;
+
+    if (ctrl == CTRL_EJECT) {    /* Card content changed by another host (USB mass storage) */
+        Remount = 1;
+#if SDCARD_CACHE
+        cache_invalidate();
+#endif
+        return RES_OK;
+    }
+
+    if (ctrl == MMC_INIT_STEP) {    /* BSP_SD_Init() cannot be split, the card is initialized in a single step */
+        *(BYTE *)buff = 0;
+        InitDone = !(disk_initialize(drv) & STA_NOINIT);
+        return InitDone ? RES_OK : RES_ERROR;
+    }
+
+    if (Stat & STA_NOINIT) return RES_NOTRDY;
+
+    switch (ctrl) {
+    case CTRL_SYNC :    /* Make sure that data has been written */
+        if (wait_ready())
+            res = RES_OK;
+        break;
+
+    case GET_SECTOR_COUNT :    /* Get number of sectors on the disk (DWORD) */
+        BSP_SD_GetCardInfo(&info);
+        *(DWORD*)buff = info.LogBlockNbr;
+        res = RES_OK;
+        break;
+
+    case GET_SECTOR_SIZE :    /* Get sectors on the disk (WORD) */
+        *(WORD*)buff = 512;
+        res = RES_OK;
+        break;
+
+    case GET_BLOCK_SIZE :    /* Get erase block size in unit of sectors (DWORD) */
+        BSP_SD_GetCardInfo(&info);
+        *(DWORD*)buff = info.LogBlockSize / 512;
+        res = RES_OK;
+        break;
+
+    default:
+        res = RES_PARERR;
+    }
+
+    return res;
+}
+
+#endif // SDCARD_SDIO
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Read Sector(s)                                                        */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_read (
+    BYTE drv,            /* Physical drive nmuber (0) */
+    BYTE *buff,            /* Pointer to the data buffer to store read data */
+    DWORD sector,        /* Start sector number (LBA) */
+    UINT count            /* Sector count (1..255) */
+)
+{
+#if SDCARD_CACHE
+    DRESULT res;
+    bool cacheable = !drv && count == 1 && !(Stat & STA_NOINIT) && sector != cache.last + 1;    /* Streamed file data is not cached */
+
+    cache.last = sector + count - 1;
+
+    if (cacheable && cache_read(buff, sector))
+        return RES_OK;
+
+    if ((res = card_read(drv, buff, sector, count)) == RES_OK && cacheable)
+        cache_store(buff, sector);
+
+    return res;
+#else
+    return card_read(drv, buff, sector, count);
+#endif
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write Sector(s)                                                       */
+/*-----------------------------------------------------------------------*/
+
+#if FF_FS_READONLY == 0
+DRESULT disk_write (
+    BYTE drv,            /* Physical drive nmuber (0) */
+    const BYTE *buff,    /* Pointer to the data to be written */
+    DWORD sector,        /* Start sector number (LBA) */
+    UINT count            /* Sector count (1..255) */
+)
+{
+    DRESULT res = card_write(drv, buff, sector, count);
+
+#if SDCARD_CACHE
+    if (res == RES_OK)
+        cache_write(buff, sector, count);
+    else if (!drv)
+        cache_invalidate();    /* Sectors may be partially written */
+#endif
+
+    return res;
+}
+#endif /* _READONLY */
+
+
 
 /*---------------------------------------------------------*/
 /* User Provided Timer Function for FatFs module           */
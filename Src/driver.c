@@ -47,6 +47,22 @@
 #include "sdcard/sdcard.h"
 #include "ff.h"
 #include "diskio.h"
+#if SDCARD_INDEX_ENABLE
+#include "sdcard_index.h"
+#endif
+#if SDCARD_JOBCACHE_ENABLE
+#include "sdcard_jobcache.h"
+#endif
+#if SDCARD_JOB_BUFFER
+#include "sdcard_reader.h"
+#endif
+#if SDCARD_WRITEBEHIND
+#include "sdcard_upload.h"
+#endif
+#endif
+
+#if TRINAMIC_MONITOR
+#include "tmc_monitor.h"
 #endif
 
 #if USB_SERIAL_CDC
@@ -70,7 +86,11 @@
 #endif
 
 #if ETHERNET_ENABLE
-  #include <enet.h>
+  #if USB_NETWORK_ENABLE
+    #include "usb_enet.h"
+  #else
+    #include <enet.h>
+  #endif
   #if TELNET_ENABLE
     #include "networking/telnetd.h"
   #endif
@@ -1695,6 +1715,15 @@ static uint64_t getElapsedMicros (void)
     return ms * 1000 + (frac > 1000 ? 1000 : frac);
 }
 
+// Busy waits for at least ns nanoseconds, timed by the DWT cycle counter enabled in main.c.
+// Intended for short delays such as chip select setup and hold times.
+void delay_ns (uint32_t ns)
+{
+    uint32_t start = DWT->CYCCNT, cycles = (ns * hal.f_mcu + 999) / 1000;
+
+    while(DWT->CYCCNT - start < cycles);
+}
+
 static uint32_t getElapsedTicks (void)
 {
     return uwTick;
@@ -2200,79 +2229,87 @@ static void encoder_event (encoder_t *encoder, int32_t position)
 
 #endif // QEI_ENABLE
 
-#if SDCARD_SDIO
+#if SDCARD_HOTPLUG
+
+#include "sdcard_hotplug.h"
 
-#include "Drivers/FATFS/App/fatfs.h"
-#include "Drivers/FATFS/App/fatfs.h"
+static FATFS fatfs;
 
-static bool bus_ok = false;
+// The card is mounted and unmounted in the background on card detect changes.
 
 static bool sdcard_unmount (FATFS **fs)
 {
-   /*
-    if(card && esp_vfs_fat_sdcard_unmount("/sdcard", card) == ESP_OK) {
-        card = NULL;
-        bus_ok = false;
-        spi_bus_free(SDSPI_DEFAULT_HOST);
-    }
-*/
-    return false; // card == NULL;
+    *fs = NULL;
+
+    return true;
 }
 
 static char *sdcard_mount (FATFS **fs)
 {
-    MX_FATFS_Init();
+    if(!sdcard_hotplug_mounted())
+        return NULL;
 
-    if(!bus_ok)
-        bus_ok = BSP_SD_Init() == MSD_OK;
+    if(fs)
+        *fs = &fatfs;
 
-    if(!bus_ok)
-        return NULL;
+    return "";
+}
 
-    if(fs) {
-        if(*fs == NULL)
-            *fs = malloc(sizeof(FATFS));
+#elif SDCARD_SDIO || USB_MSC_ENABLE
 
-        if(*fs && f_mount(*fs, "0:/", 1) != FR_OK) {
-           free(*fs );
-           *fs = NULL;
-        }
-    }
+#if SDCARD_SDIO
+#include "bsp_driver_sd.h"
+#endif
+#if USB_MSC_ENABLE
+#include "usbd_msc_if.h"
+#endif
 
-/*
- *
-    if(card == NULL) {
-
-        esp_err_t ret = ESP_FAIL;
-        esp_vfs_fat_sdmmc_mount_config_t mount_config = {
-            .format_if_mount_failed = false,
-            .max_files = 5,
-            .allocation_unit_size = 16 * 1024
-        };
+static FATFS fatfs;
 
-        sdmmc_host_t host = SDSPI_HOST_DEFAULT();
-//        host.max_freq_khz = SDMMC_FREQ_HIGHSPEED;
+static bool sdcard_unmount (FATFS **fs)
+{
+    if(*fs) {
+        f_unmount("");
+        *fs = NULL;
+    }
 
-        sdspi_device_config_t slot_config = SDSPI_DEVICE_CONFIG_DEFAULT();
-        slot_config.gpio_cs = PIN_NUM_CS;
-        slot_config.host_id = host.slot;
+#if SDCARD_SDIO
+    BSP_SD_DeInit();
+#endif
+#if USB_MSC_ENABLE
+    usbMscSetMounted(false); // Hand the card over to the USB host
+#endif
 
-        gpio_set_drive_capability(PIN_NUM_CS, GPIO_DRIVE_CAP_3);
+    return true;
+}
 
-        if ((ret = esp_vfs_fat_sdspi_mount("/sdcard", &host, &slot_config, &mount_config, &card)) != ESP_OK)
-            report_message(ret == ESP_FAIL ? "Failed to mount filesystem" : "Failed to initialize SD card", Message_Warning);
-    }
+static char *sdcard_mount (FATFS **fs)
+{
+#if SDCARD_SDIO
+    if(BSP_SD_IsDetected() != SD_PRESENT)
+        return NULL;
+#endif
 
-    if(card && fs) {
+    if(fs) {
         if(*fs == NULL)
-            *fs = malloc(sizeof(FATFS));
+            *fs = &fatfs;
 
-        if(*fs && f_mount(*fs, "", 1) != FR_OK) {
-           free(*fs );
-           *fs  = NULL;
+#if USB_MSC_ENABLE
+        usbMscSetMounted(true); // Take the card from the USB host before FatFs accesses it
+#endif
+
+        if(f_mount(*fs, "", 1) != FR_OK) { // Card is initialized by disk_initialize() when mounted
+#if SDCARD_SDIO
+            BSP_SD_DeInit();
+#endif
+#if USB_MSC_ENABLE
+            usbMscSetMounted(false);
+#endif
+            *fs = NULL;
+            return NULL;
         }
     }
-*/
+
     return "";
 }
 
@@ -2371,20 +2408,44 @@ static bool driver_setup (settings_t *settings)
 
 #endif
 
-#if SDCARD_SDIO
+#if SDCARD_ENABLE
 
+#if !SDCARD_SDIO
+    DIGITAL_OUT(SD_CS_PORT, SD_CS_PIN, 1);
+#endif
+
+#if SDCARD_SDIO || SDCARD_HOTPLUG || USB_MSC_ENABLE
     sdcard_events_t *card = sdcard_init();
     card->on_mount = sdcard_mount;
     card->on_unmount = sdcard_unmount;
+#else
+    sdcard_init();
+#endif
 
-    sdcard_mount(NULL);
+#if SDCARD_HOTPLUG
+    sdcard_hotplug_init(&fatfs);
+#endif
 
-#elif SDCARD_ENABLE
+#endif
 
-    DIGITAL_OUT(SD_CS_PORT, SD_CS_PIN, 1);
+#if SDCARD_INDEX_ENABLE
+    sdcard_index_init();
+#endif
 
-    sdcard_init();
+#if SDCARD_JOBCACHE_ENABLE
+    sdcard_jobcache_init();
+#endif
+
+#if SDCARD_JOB_BUFFER
+    sdcard_reader_init();
+#endif
+
+#if SDCARD_WRITEBEHIND
+    sdcard_upload_init();
+#endif
 
+#if TRINAMIC_MONITOR
+    tmc_monitor_init();
 #endif
 
 #if SPINDLE_ENCODER_ENABLE
@@ -0,0 +1,117 @@
+/*
+
+  sdcard_direct.c - direct sector streaming of contiguous SD card files
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  A file occupying a single run of clusters is read by LBA via disk_read(), bypassing FatFs.
+  Reads are issued as one multi block command (CMD18 or SDIO DMA) regardless of the FAT layout
+  and without copying through the FatFs sector buffer.
+  exFAT files written in one go are flagged as contiguous in the directory entry, for FAT
+  volumes a cluster link map limited to a single fragment is used to check the chain.
+*/
+
+#include "driver.h"
+
+#if SDCARD_ENABLE && SDCARD_DIRECT_ENABLE
+
+#include "sdcard_direct.h"
+#include "diskio.h"
+
+#define SECTOR_SIZE FF_MAX_SS
+
+bool sdcard_direct_open (sdcard_direct_t *stream, FIL *file)
+{
+    DWORD clmt[4], *cltbl = file->cltbl;
+    FATFS *fs = file->obj.fs;
+    bool contiguous;
+
+    stream->file = NULL;
+
+    if(file->obj.sclust == 0 || (file->flag & FA_WRITE) || fs->csize == 0)
+        return false;
+
+#if FF_FS_EXFAT
+    if(!(contiguous = fs->fs_type == FS_EXFAT && (file->obj.stat & 0x03) == 2))
+#endif
+    {
+        // A link map for a single fragment fits in 4 DWORDs: size, fragment length, start cluster and terminator.
+        clmt[0] = sizeof(clmt) / sizeof(DWORD);
+        file->cltbl = clmt;
+        contiguous = f_lseek(file, CREATE_LINKMAP) == FR_OK;
+        file->cltbl = cltbl;
+    }
+
+    if(contiguous) {
+        stream->file = file;
+        stream->lba = fs->database + (LBA_t)fs->csize * (file->obj.sclust - 2);
+        stream->size = f_size(file);
+        stream->pos = f_tell(file);
+    }
+
+    return contiguous;
+}
+
+UINT sdcard_direct_read (sdcard_direct_t *stream, void *buf, UINT sectors)
+{
+    UINT count;
+    FSIZE_t remaining;
+
+    if(stream->file == NULL || stream->pos >= stream->size || stream->pos % SECTOR_SIZE)
+        return 0;
+
+    remaining = stream->size - stream->pos;
+
+    if((FSIZE_t)sectors * SECTOR_SIZE > remaining)
+        sectors = (UINT)((remaining + SECTOR_SIZE - 1) / SECTOR_SIZE);
+
+    if(disk_read(stream->file->obj.fs->pdrv, (BYTE *)buf, stream->lba + stream->pos / SECTOR_SIZE, sectors) != RES_OK)
+        return 0;
+
+    count = (FSIZE_t)sectors * SECTOR_SIZE > remaining ? (UINT)remaining : sectors * SECTOR_SIZE;
+    stream->pos += count;
+
+    return count;
+}
+
+UINT sdcard_direct_seek (sdcard_direct_t *stream, FSIZE_t pos)
+{
+    if(pos > stream->size)
+        pos = stream->size;
+
+    stream->pos = pos & ~(FSIZE_t)(SECTOR_SIZE - 1);
+
+    return (UINT)(pos - stream->pos);
+}
+
+FRESULT sdcard_direct_close (sdcard_direct_t *stream)
+{
+    FRESULT res = FR_OK;
+
+    if(stream->file) {
+        res = f_lseek(stream->file, stream->pos);
+        stream->file = NULL;
+    }
+
+    return res;
+}
+
+#endif // SDCARD_ENABLE && SDCARD_DIRECT_ENABLE
@@ -0,0 +1,348 @@
+/*
+
+  sdcard_hotplug.c - card detect driven background mount and cached directory index
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  The card detect switch is polled every 100 ms from a delayed task, a change has to be stable for
+  three polls before the card is mounted or unmounted. The card is initialized one step per 10 ms poll,
+  each step is a single ACMD41 attempt so the foreground is not held for the up to 1 s the card may take
+  to become ready. The volume is then mounted, FatFs reads the boot sector and the FAT synchronously.
+  The root directory index is built a few entries per poll so listings can be served from RAM without
+  touching the card.
+  The index is rebuilt when the volume is remounted.
+  Unmounting is deferred while a job is read from the card, the job then fails on the next read and
+  the volume is unmounted when the stream has been restored.
+  The index is only listed by $FD. The $F listing and the WebUI walk the directory in their own plugins,
+  serving those from the index is not implemented.
+  All storage is statically allocated.
+*/
+
+#include "driver.h"
+
+#if SDCARD_ENABLE && SDCARD_HOTPLUG
+
+#include <string.h>
+
+#include "sdcard_hotplug.h"
+#include "diskio.h"
+
+#if SDCARD_SDIO
+#include "bsp_driver_sd.h"
+#endif
+
+#include "grbl/hal.h"
+#include "grbl/task.h"
+#include "grbl/report.h"
+#include "grbl/nuts_bolts.h"
+
+#define POLL_INTERVAL   100 // ms
+#define INIT_INTERVAL   10  // ms, poll interval while the card is initializing
+#define DEBOUNCE_COUNT  3
+#define INDEX_PER_POLL  8   // directory entries read per poll
+#define INDEX_RETRIES   3   // attempts at reading the directory before giving up until the next remount
+#define NAME_POOL_SIZE  (SDCARD_DIR_INDEX * 24)
+
+typedef struct {
+    uint32_t size;
+    uint16_t name;  // offset in name pool
+    bool is_dir;
+} dir_entry_t;
+
+static struct {
+    FATFS *fs;
+    bool present;
+    bool mounted;
+    bool insert;    // mount pending
+    bool init;      // card initialization in progress
+    bool eject;     // card removed while mounted, unmount pending
+    uint_fast8_t debounce;
+} card = {0};
+
+static struct {
+    bool valid;
+    bool building;
+    bool truncated;
+    uint_fast8_t errors;
+    WORD id;        // volume mount id the index was built for
+    uint16_t count;
+    uint16_t pool_used;
+    dir_entry_t entry[SDCARD_DIR_INDEX];
+    char pool[NAME_POOL_SIZE];
+} dir = {0};
+
+static DIR dj;
+static FILINFO fno;
+
+static bool card_detected (void)
+{
+#if SDCARD_SDIO
+    return BSP_SD_IsDetected() == SD_PRESENT;
+#else
+    return !DIGITAL_IN(SD_DETECT_PORT, SD_DETECT_PIN); // Switch is closed to ground when a card is inserted
+#endif
+}
+
+static void index_close (void)
+{
+    if(dir.building)
+        f_closedir(&dj);
+
+    dir.valid = dir.building = false;
+}
+
+void sdcard_dir_index_invalidate (void)
+{
+    index_close();
+    dir.errors = 0;
+}
+
+static void index_error (void)
+{
+    index_close();
+
+    if(++dir.errors == INDEX_RETRIES)
+        report_warning("SD card directory could not be read");
+}
+
+static void index_start (void)
+{
+    index_close();
+
+    dir.count = dir.pool_used = 0;
+    dir.truncated = false;
+    dir.id = card.fs->id;
+
+    if(!(dir.building = f_opendir(&dj, "/") == FR_OK))
+        index_error();
+}
+
+static void index_continue (void)
+{
+    uint_fast8_t n = INDEX_PER_POLL;
+    size_t len;
+
+    while(n--) {
+
+        if(f_readdir(&dj, &fno) != FR_OK) {
+            index_error();
+            break;
+        }
+
+        if(fno.fname[0] == '\0') { // End of directory
+            f_closedir(&dj);
+            dir.building = false;
+            dir.valid = true;
+            dir.errors = 0;
+            break;
+        }
+
+        if(fno.fattrib & (AM_HID|AM_SYS))
+            continue;
+
+        len = strlen(fno.fname) + 1;
+
+        if(dir.count == SDCARD_DIR_INDEX || dir.pool_used + len > NAME_POOL_SIZE) {
+            dir.truncated = true;
+            continue;
+        }
+
+        memcpy(&dir.pool[dir.pool_used], fno.fname, len);
+        dir.entry[dir.count].name = dir.pool_used;
+        dir.entry[dir.count].size = (uint32_t)fno.fsize;
+        dir.entry[dir.count].is_dir = !!(fno.fattrib & AM_DIR);
+        dir.pool_used += len;
+        dir.count++;
+    }
+}
+
+// Performs a card initialization step, the volume is mounted when the card is ready.
+static void card_mount (void)
+{
+    BYTE busy = 0;
+    DRESULT res = disk_ioctl(0, MMC_INIT_STEP, &busy);
+
+    if(busy || res == RES_NOTRDY) // Retried on the next poll
+        return;
+
+    card.init = false;
+    card.mounted = res == RES_OK && f_mount(card.fs, "", 1) == FR_OK; // disk_initialize() is skipped for a card initialized by polling
+
+#if SDCARD_SDIO
+    if(!card.mounted)
+        BSP_SD_DeInit();
+#endif
+}
+
+static void card_unmount (void)
+{
+    sdcard_dir_index_invalidate();
+
+    f_unmount("");
+    card.mounted = false;
+
+#if SDCARD_SDIO
+    BSP_SD_DeInit();
+#endif
+}
+
+static void card_poll (void *data)
+{
+    bool present = card_detected();
+
+    if(present != card.present) {
+        if(++card.debounce >= DEBOUNCE_COUNT) {
+            card.debounce = 0;
+            card.insert = card.present = present;
+            if(!present) {
+                card.init = false;
+                card.eject = card.mounted;
+            }
+        }
+    } else
+        card.debounce = 0;
+
+    // Nothing is done while a job is running from the card, FatFs is not reentrant and
+    // the job holds an open file on the volume.
+    if(hal.stream.type != StreamType_SDCard) {
+
+        if(card.eject) {
+            card.eject = false;
+            card_unmount();
+        }
+
+        if(card.insert) {
+            card.insert = false;
+            card.init = true;
+            sdcard_dir_index_invalidate();
+        }
+
+        if(card.init)
+            card_mount();
+
+        if(card.mounted) {
+            if(dir.building)
+                index_continue();
+            else {
+                if(dir.id != card.fs->id) // Remounted
+                    sdcard_dir_index_invalidate();
+                if(!dir.valid && dir.errors < INDEX_RETRIES)
+                    index_start();
+            }
+        }
+    }
+
+    task_add_delayed(card_poll, NULL, card.init ? INIT_INTERVAL : POLL_INTERVAL);
+}
+
+bool sdcard_hotplug_mounted (void)
+{
+    return card.mounted && !card.eject;
+}
+
+uint_fast16_t sdcard_dir_index_count (bool *complete)
+{
+    if(complete)
+        *complete = dir.valid && !dir.truncated;
+
+    return dir.valid ? dir.count : 0;
+}
+
+bool sdcard_dir_index_get (uint_fast16_t idx, sdcard_dir_entry_t *entry)
+{
+    if(!dir.valid || idx >= dir.count)
+        return false;
+
+    entry->name = &dir.pool[dir.entry[idx].name];
+    entry->size = dir.entry[idx].size;
+    entry->is_dir = dir.entry[idx].is_dir;
+
+    return true;
+}
+
+// $FD - lists the root directory from the index.
+static status_code_t list_index (sys_state_t state, char *args)
+{
+    bool complete;
+    uint_fast16_t idx = 0, count = sdcard_dir_index_count(&complete);
+    sdcard_dir_entry_t entry;
+
+    if(!card.mounted)
+        return Status_SDMountError;
+
+    while(idx < count && sdcard_dir_index_get(idx++, &entry)) {
+        hal.stream.write(entry.is_dir ? "[DIR:/" : "[FILE:/");
+        hal.stream.write(entry.name);
+        if(!entry.is_dir) {
+            hal.stream.write("|SIZE:");
+            hal.stream.write(uitoa(entry.size));
+        }
+        hal.stream.write("]" ASCII_EOL);
+    }
+
+    if(!complete)
+        hal.stream.write(dir.valid ? "[MSG:Directory index truncated]" ASCII_EOL : "[MSG:Directory index not ready]" ASCII_EOL);
+
+    return Status_OK;
+}
+
+void sdcard_hotplug_init (FATFS *fs)
+{
+    static const sys_command_t hotplug_command_list[] = {
+        {"FD", list_index, {0}, { .str = "list SD card root directory from the cached index" } }
+    };
+
+    static sys_commands_t hotplug_commands = {
+        .n_commands = sizeof(hotplug_command_list) / sizeof(sys_command_t),
+        .commands = hotplug_command_list
+    };
+
+    card.fs = fs;
+
+#if !SDCARD_SDIO
+
+    GPIO_InitTypeDef GPIO_InitStruct = {
+        .Pin = 1 << SD_DETECT_PIN,
+        .Mode = GPIO_MODE_INPUT,
+        .Pull = GPIO_PULLUP,
+        .Speed = GPIO_SPEED_FREQ_LOW
+    };
+
+    HAL_GPIO_Init(SD_DETECT_PORT, &GPIO_InitStruct);
+
+    static const periph_pin_t cd = {
+        .function = Input_SdCardDetect,
+        .group = PinGroup_SdCard,
+        .port = SD_DETECT_PORT,
+        .pin = SD_DETECT_PIN,
+        .mode = { .mask = PINMODE_PULLUP }
+    };
+
+    hal.periph_port.register_pin(&cd);
+
+#endif
+
+    system_register_commands(&hotplug_commands);
+
+    task_add_delayed(card_poll, NULL, POLL_INTERVAL);
+}
+
+#endif // SDCARD_ENABLE && SDCARD_HOTPLUG
@@ -0,0 +1,310 @@
+/*
+
+  sdcard_index.c - FatFs fast seek and persisted line offset index for SD card jobs
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  The index file <path>.idx holds a header followed by the byte offset of every SDCARD_INDEX_STRIDE'th line.
+  It is tied to the size and modification time of the indexed file and rebuilt when either changes.
+  A line is then located by seeking to the nearest indexed offset and scanning at most SDCARD_INDEX_STRIDE - 1 lines,
+  with the cluster link map in place the seek itself does not read the FAT.
+*/
+
+#include "driver.h"
+
+#if SDCARD_ENABLE && SDCARD_INDEX_ENABLE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdcard_index.h"
+
+#include "grbl/hal.h"
+#include "grbl/nuts_bolts.h"
+
+#define INDEX_MAGIC 0x5844494CUL // "LIDX"
+#define INDEX_BATCH 32
+
+typedef struct {
+    uint32_t magic;
+    uint32_t stride;
+    FSIZE_t size;
+    WORD fdate;
+    WORD ftime;
+    uint32_t lines;
+} index_header_t;
+
+static FIL *clmt_owner = NULL;
+static DWORD clmt[SDCARD_CLMT_SIZE];
+// Static to keep the FatFs sector buffers off the stack
+static FIL src, idx;
+static BYTE buf[512];
+static uint32_t entries[INDEX_BATCH];
+static char idx_path[FF_MAX_LFN + 5];
+
+FRESULT sdcard_index_open (FIL *file)
+{
+    FRESULT res;
+
+    if(clmt_owner && clmt_owner != file)
+        clmt_owner->cltbl = NULL;
+
+    clmt[0] = SDCARD_CLMT_SIZE;
+    file->cltbl = clmt;
+
+    if((res = f_lseek(file, CREATE_LINKMAP)) == FR_OK)
+        clmt_owner = file;
+    else {
+        file->cltbl = NULL; // Too fragmented for the map, f_lseek() falls back to walking the FAT chain
+        clmt_owner = NULL;
+    }
+
+    return res;
+}
+
+void sdcard_index_close (FIL *file)
+{
+    if(clmt_owner == file) {
+        file->cltbl = NULL;
+        clmt_owner = NULL;
+    }
+}
+
+static const char *get_idx_path (const TCHAR *path)
+{
+    size_t len = strlen(path);
+
+    if(len > FF_MAX_LFN)
+        len = FF_MAX_LFN;
+
+    memcpy(idx_path, path, len);
+    strcpy(idx_path + len, ".idx");
+
+    return idx_path;
+}
+
+// Returns FR_OK if the index file exists and matches the indexed file, hdr holds the header on return.
+static FRESULT index_check (const TCHAR *path, index_header_t *hdr)
+{
+    UINT br;
+    FRESULT res;
+    FILINFO fno;
+
+    if((res = f_stat(path, &fno)) != FR_OK)
+        return res;
+
+    if((res = f_open(&idx, get_idx_path(path), FA_READ)) == FR_OK) {
+        if((res = f_read(&idx, hdr, sizeof(index_header_t), &br)) == FR_OK &&
+             !(br == sizeof(index_header_t) && hdr->magic == INDEX_MAGIC && hdr->stride == SDCARD_INDEX_STRIDE &&
+                hdr->size == fno.fsize && hdr->fdate == fno.fdate && hdr->ftime == fno.ftime))
+            res = FR_NO_FILE;
+        f_close(&idx);
+    }
+
+    hdr->size = fno.fsize;
+    hdr->fdate = fno.fdate;
+    hdr->ftime = fno.ftime;
+
+    return res;
+}
+
+static FRESULT index_create (const TCHAR *path, index_header_t *hdr)
+{
+    UINT br, bw, i, n = 0;
+    BYTE last = '\n';
+    FSIZE_t offset = 0;
+    uint32_t line = 0;
+    FRESULT res;
+
+    if((res = f_open(&src, path, FA_READ)) != FR_OK)
+        return res;
+
+    if((res = f_open(&idx, idx_path, FA_WRITE|FA_CREATE_ALWAYS)) != FR_OK) {
+        f_close(&src);
+        return res;
+    }
+
+    hdr->magic = 0; // Invalid until complete
+    hdr->stride = SDCARD_INDEX_STRIDE;
+    hdr->lines = 0;
+    entries[n++] = 0;
+
+    if((res = f_write(&idx, hdr, sizeof(index_header_t), &bw)) == FR_OK) do {
+
+        if((res = f_read(&src, buf, sizeof(buf), &br)) != FR_OK || br == 0)
+            break;
+
+        for(i = 0; i < br; i++) {
+            if(buf[i] == '\n' && ++line % SDCARD_INDEX_STRIDE == 0) {
+                entries[n++] = offset + i + 1;
+                if(n == INDEX_BATCH) {
+                    if((res = f_write(&idx, entries, sizeof(entries), &bw)) != FR_OK)
+                        break;
+                    n = 0;
+                }
+            }
+        }
+
+        offset += br;
+        last = buf[br - 1];
+
+    } while(res == FR_OK);
+
+    if(res == FR_OK && n)
+        res = f_write(&idx, entries, n * sizeof(uint32_t), &bw);
+
+    if(res == FR_OK) {
+        hdr->magic = INDEX_MAGIC;
+        hdr->lines = line + (last != '\n'); // Count an unterminated last line
+        if((res = f_lseek(&idx, 0)) == FR_OK)
+            res = f_write(&idx, hdr, sizeof(index_header_t), &bw);
+    }
+
+    f_close(&src);
+    f_close(&idx);
+
+    if(res != FR_OK)
+        f_unlink(idx_path);
+
+    return res;
+}
+
+static FRESULT index_get (const TCHAR *path, index_header_t *hdr)
+{
+    FRESULT res;
+
+    if((res = index_check(path, hdr)) == FR_NO_FILE)
+        res = index_create(path, hdr);
+
+    return res;
+}
+
+FRESULT sdcard_index_build (const TCHAR *path, uint32_t *lines)
+{
+    FRESULT res;
+    index_header_t hdr;
+
+    if((res = index_get(path, &hdr)) == FR_OK && lines)
+        *lines = hdr.lines;
+
+    return res;
+}
+
+FRESULT sdcard_index_seek_line (FIL *file, const TCHAR *path, uint32_t line)
+{
+    UINT br, i;
+    uint32_t offset, skip = line % SDCARD_INDEX_STRIDE;
+    FRESULT res;
+    index_header_t hdr;
+
+    if((res = index_get(path, &hdr)) != FR_OK)
+        return res;
+
+    if(line >= hdr.lines)
+        return FR_INVALID_PARAMETER;
+
+    if((res = f_open(&idx, idx_path, FA_READ)) != FR_OK)
+        return res;
+
+    if((res = f_lseek(&idx, sizeof(index_header_t) + (line / SDCARD_INDEX_STRIDE) * sizeof(uint32_t))) == FR_OK)
+        res = f_read(&idx, &offset, sizeof(uint32_t), &br);
+
+    f_close(&idx);
+
+    if(res != FR_OK || br != sizeof(uint32_t))
+        return res == FR_OK ? FR_INT_ERR : res;
+
+    if((res = f_lseek(file, offset)) != FR_OK || skip == 0)
+        return res;
+
+    // Scan forward from the indexed line
+    do {
+        if((res = f_read(file, buf, sizeof(buf), &br)) != FR_OK || br == 0)
+            return res == FR_OK ? FR_INT_ERR : res;
+        for(i = 0; i < br; i++) {
+            if(buf[i] == '\n' && --skip == 0)
+                return f_lseek(file, offset + i + 1);
+        }
+        offset += br;
+    } while(true);
+}
+
+// $FI=<file> - builds the line index for the file if missing or out of date and reports the number of lines.
+// $FI=<file>,<line> - reports the byte offset of the line, numbered from 1.
+static status_code_t file_index (sys_state_t state, char *args)
+{
+    bool ok;
+    char *param;
+    uint32_t line = 0, lines, offset, ms = hal.get_elapsed_ticks();
+
+    if(args == NULL)
+        return Status_InvalidStatement;
+
+    if((param = strrchr(args, ',')) && *(param + 1) && strspn(param + 1, "0123456789") == strlen(param + 1)) {
+        *param++ = '\0';
+        if((line = (uint32_t)atol(param)) == 0)
+            return Status_InvalidStatement;
+    }
+
+    if(sdcard_index_build(args, &lines) != FR_OK)
+        return Status_SDReadError;
+
+    if(line) {
+        if(line > lines || f_open(&src, args, FA_READ) != FR_OK)
+            return Status_InvalidStatement;
+        sdcard_index_open(&src);
+        ok = sdcard_index_seek_line(&src, args, line - 1) == FR_OK;
+        offset = (uint32_t)f_tell(&src);
+        sdcard_index_close(&src);
+        f_close(&src);
+        if(!ok)
+            return Status_SDReadError;
+        hal.stream.write("[LINE:");
+        hal.stream.write(uitoa(line));
+        hal.stream.write("|");
+        hal.stream.write(uitoa(offset));
+    } else {
+        hal.stream.write("[INDEX:");
+        hal.stream.write(uitoa(lines));
+    }
+
+    hal.stream.write("|");
+    hal.stream.write(uitoa(hal.get_elapsed_ticks() - ms));
+    hal.stream.write(" ms]" ASCII_EOL);
+
+    return Status_OK;
+}
+
+void sdcard_index_init (void)
+{
+    static const sys_command_t index_command_list[] = {
+        {"FI", file_index, {0}, { .str = "build/check SD card file line index, $FI=<file>,<line> reports the line offset" } }
+    };
+
+    static sys_commands_t index_commands = {
+        .n_commands = sizeof(index_command_list) / sizeof(sys_command_t),
+        .commands = index_command_list
+    };
+
+    system_register_commands(&index_commands);
+}
+
+#endif // SDCARD_ENABLE && SDCARD_INDEX_ENABLE
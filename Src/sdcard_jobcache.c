@@ -0,0 +1,294 @@
+/*
+
+  sdcard_jobcache.c - compacted binary sidecar files for SD card jobs
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  The sidecar file <path>.gcb is written by $FC=<file> and holds one length prefixed record per
+  non empty line, upper cased with whitespace and ; comments removed. Parenthesized comments are kept as is
+  since they may carry messages. Jobs run by $FR=<file> are read from the sidecar when it is up to date,
+  fewer bytes are then read from the card and passed to the parser.
+  The sidecar is tied to the source file by size, modification time and a CRC32 of its first and last sectors
+  and rebuilt when any of them changes. Files with lines longer than 255 characters after compaction are not cached.
+*/
+
+#include "driver.h"
+
+#if SDCARD_ENABLE && SDCARD_JOBCACHE_ENABLE
+
+#include <ctype.h>
+#include <string.h>
+
+#include "sdcard_jobcache.h"
+
+#include "grbl/hal.h"
+#include "grbl/nuts_bolts.h"
+
+#define JOBCACHE_MAGIC 0x31424347UL // "GCB1"
+
+typedef struct {
+    uint32_t magic;
+    FSIZE_t size;
+    WORD fdate;
+    WORD ftime;
+    uint32_t crc;
+    uint32_t lines;
+} jobcache_header_t;
+
+// Static to keep the FatFs sector buffers off the stack
+static FIL src, dst;
+static BYTE buf[512];
+static BYTE record[256];
+static char gcb_path[FF_MAX_LFN + 5];
+
+static const char *get_gcb_path (const TCHAR *path)
+{
+    size_t len = strlen(path);
+
+    if(len > FF_MAX_LFN)
+        len = FF_MAX_LFN;
+
+    memcpy(gcb_path, path, len);
+    strcpy(gcb_path + len, ".gcb");
+
+    return gcb_path;
+}
+
+static uint32_t crc32 (uint32_t crc, const BYTE *data, UINT len)
+{
+    uint_fast8_t i;
+
+    crc = ~crc;
+
+    while(len--) {
+        crc ^= *data++;
+        for(i = 0; i < 8; i++)
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320UL : crc >> 1;
+    }
+
+    return ~crc;
+}
+
+// Builds the header for the source file, the CRC covers the first and last sector.
+static FRESULT source_header (const TCHAR *path, jobcache_header_t *hdr)
+{
+    UINT br;
+    FRESULT res;
+    FILINFO fno;
+
+    if((res = f_stat(path, &fno)) != FR_OK || (res = f_open(&src, path, FA_READ)) != FR_OK)
+        return res;
+
+    hdr->magic = JOBCACHE_MAGIC;
+    hdr->size = fno.fsize;
+    hdr->fdate = fno.fdate;
+    hdr->ftime = fno.ftime;
+    hdr->lines = 0;
+
+    if((res = f_read(&src, buf, sizeof(buf), &br)) == FR_OK) {
+        hdr->crc = crc32(0, buf, br);
+        if(fno.fsize > sizeof(buf) && (res = f_lseek(&src, fno.fsize - sizeof(buf))) == FR_OK &&
+            (res = f_read(&src, buf, sizeof(buf), &br)) == FR_OK)
+            hdr->crc = crc32(hdr->crc, buf, br);
+    }
+
+    f_close(&src);
+
+    return res;
+}
+
+static bool header_valid (const jobcache_header_t *hdr)
+{
+    UINT br;
+    jobcache_header_t gcb;
+
+    return f_read(&dst, &gcb, sizeof(jobcache_header_t), &br) == FR_OK && br == sizeof(jobcache_header_t) &&
+            gcb.magic == hdr->magic && gcb.size == hdr->size && gcb.fdate == hdr->fdate &&
+             gcb.ftime == hdr->ftime && gcb.crc == hdr->crc;
+}
+
+static FRESULT jobcache_create (const TCHAR *path, jobcache_header_t *hdr)
+{
+    UINT br, bw, i;
+    BYTE c, len = 0;
+    bool comment = false, eol_comment = false, eof = false;
+    uint32_t magic = hdr->magic;
+    FRESULT res;
+
+    if((res = f_open(&src, path, FA_READ)) != FR_OK)
+        return res;
+
+    if((res = f_open(&dst, gcb_path, FA_WRITE|FA_CREATE_ALWAYS)) != FR_OK) {
+        f_close(&src);
+        return res;
+    }
+
+    hdr->magic = 0; // Invalid until complete
+    hdr->lines = 0;
+
+    if((res = f_write(&dst, hdr, sizeof(jobcache_header_t), &bw)) == FR_OK) do {
+
+        if((res = f_read(&src, buf, sizeof(buf), &br)) != FR_OK)
+            break;
+
+        if((eof = br == 0))
+            buf[br++] = '\n'; // Terminate the last line
+
+        for(i = 0; i < br && res == FR_OK; i++) {
+
+            c = buf[i];
+
+            if(c == '\n' || c == '\r') {
+                if(len) {
+                    record[0] = len;
+                    res = f_write(&dst, record, len + 1, &bw);
+                    hdr->lines++;
+                    len = 0;
+                }
+                comment = eol_comment = false;
+            } else if(!eol_comment && (comment || (c != ' ' && c != '\t'))) {
+                if(!comment && c == ';')
+                    eol_comment = true;
+                else if(len == 255)
+                    res = FR_DENIED; // Line too long
+                else {
+                    record[++len] = comment ? c : toupper(c);
+                    if(c == '(')
+                        comment = true;
+                    else if(c == ')')
+                        comment = false;
+                }
+            }
+        }
+
+    } while(res == FR_OK && !eof);
+
+    if(res == FR_OK) {
+        hdr->magic = magic;
+        if((res = f_lseek(&dst, 0)) == FR_OK)
+            res = f_write(&dst, hdr, sizeof(jobcache_header_t), &bw);
+    }
+
+    f_close(&src);
+    f_close(&dst);
+
+    if(res != FR_OK)
+        f_unlink(gcb_path);
+
+    return res;
+}
+
+FRESULT sdcard_jobcache_open (sdcard_jobcache_t *job, const TCHAR *path, bool build)
+{
+    bool valid = false;
+    FRESULT res;
+    jobcache_header_t hdr;
+
+    if((res = source_header(path, &hdr)) != FR_OK)
+        return res;
+
+    if(f_open(&dst, get_gcb_path(path), FA_READ) == FR_OK) {
+        valid = header_valid(&hdr);
+        f_close(&dst);
+    }
+
+    if(!valid && (!build || (res = jobcache_create(path, &hdr)) != FR_OK))
+        return build ? res : FR_NO_FILE;
+
+    if((res = f_open(&job->file, gcb_path, FA_READ)) == FR_OK) {
+        UINT br;
+        if((res = f_read(&job->file, &hdr, sizeof(jobcache_header_t), &br)) == FR_OK) {
+            job->lines = hdr.lines;
+            job->src_size = (uint32_t)hdr.size;
+        } else
+            f_close(&job->file);
+    }
+
+    return res;
+}
+
+int_fast16_t sdcard_jobcache_read_line (sdcard_jobcache_t *job, char *line, uint_fast16_t size)
+{
+    UINT br;
+    BYTE len;
+
+    if(f_read(&job->file, &len, 1, &br) != FR_OK || br != 1)
+        return -1;
+
+    if(len >= size) // Skip the record to stay in sync
+        return f_lseek(&job->file, f_tell(&job->file) + len) == FR_OK ? 0 : -1;
+
+    if(f_read(&job->file, line, len, &br) != FR_OK || br != len)
+        return -1;
+
+    line[len] = '\0';
+
+    return len;
+}
+
+void sdcard_jobcache_close (sdcard_jobcache_t *job)
+{
+    f_close(&job->file);
+}
+
+// $FC=<file> - builds the sidecar file for a job if missing or out of date and reports its size.
+static status_code_t jobcache_build (sys_state_t state, char *args)
+{
+    static sdcard_jobcache_t job;
+
+    uint32_t ms = hal.get_elapsed_ticks();
+
+    if(args == NULL)
+        return Status_InvalidStatement;
+
+    if(sdcard_jobcache_open(&job, args, true) != FR_OK)
+        return Status_SDReadError;
+
+    hal.stream.write("[JOBCACHE:");
+    hal.stream.write(uitoa(job.lines));
+    hal.stream.write(" lines|");
+    hal.stream.write(uitoa(job.src_size));
+    hal.stream.write("|");
+    hal.stream.write(uitoa((uint32_t)f_size(&job.file)));
+    hal.stream.write(" bytes|");
+    hal.stream.write(uitoa(hal.get_elapsed_ticks() - ms));
+    hal.stream.write(" ms]" ASCII_EOL);
+
+    sdcard_jobcache_close(&job);
+
+    return Status_OK;
+}
+
+void sdcard_jobcache_init (void)
+{
+    static const sys_command_t jobcache_command_list[] = {
+        {"FC", jobcache_build, {0}, { .str = "build/check compacted sidecar file for a SD card job" } }
+    };
+
+    static sys_commands_t jobcache_commands = {
+        .n_commands = sizeof(jobcache_command_list) / sizeof(sys_command_t),
+        .commands = jobcache_command_list
+    };
+
+    system_register_commands(&jobcache_commands);
+}
+
+#endif // SDCARD_ENABLE && SDCARD_JOBCACHE_ENABLE
@@ -0,0 +1,552 @@
+/*
+
+  sdcard_reader.c - background read-ahead of SD card job files
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  The job is read into a RAM ring buffer by a delayed foreground task running every 2 ms, ahead of the parser
+  consuming it character by character. The task does not decouple the card from the foreground loop: each
+  top up is a blocking read of up to 4 KB, the longest one is reported so the cost is visible.
+  The consumer only waits for the card if the buffer runs empty, such starvation is counted and the buffer
+  state is added to the real time report as |SDB:<level>,<min level>,<starved count>,<longest fill in ms>.
+
+  Jobs started by the SD card plugin with $F=<file> are buffered by wrapping the stream read function the plugin
+  installs, the task pulls characters from it while the plugin would accept a read. End of file, errors and the
+  end of job handling are left to the plugin: when its read function returns nothing the task stops pulling and
+  it is called directly once the buffer is drained. Note that the line number the plugin reports errors for is
+  that of the last line read into the buffer.
+
+  $FR=<file>[,<line>] runs a job via the buffer from a line located by the index or from a compacted sidecar file,
+  neither of which the plugin supports. Reads are then sector aligned and up to 4 KB so FatFs hands them straight
+  to disk_read() as multi sector reads, contiguous files are read by LBA if SDCARD_DIRECT_ENABLE is set.
+  The input stream is redirected the same way as the plugin does for $F=<file> and the job is ended the same way,
+  reading stops at M2/M30 or the end of the file and the stream is restored when the machine is idle.
+  A job run from the first line is read from its sidecar file if SDCARD_JOBCACHE_ENABLE is set and the sidecar
+  is up to date, the length prefixed records are then turned back into lines as they are consumed.
+*/
+
+#include "driver.h"
+
+#if SDCARD_ENABLE && SDCARD_JOB_BUFFER
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdcard_reader.h"
+#if SDCARD_DIRECT_ENABLE
+#include "sdcard_direct.h"
+#endif
+#if SDCARD_INDEX_ENABLE
+#include "sdcard_index.h"
+#endif
+#if SDCARD_JOBCACHE_ENABLE
+#include "sdcard_jobcache.h"
+#endif
+
+#include "grbl/hal.h"
+#include "grbl/task.h"
+#include "grbl/report.h"
+#include "grbl/state_machine.h"
+#include "grbl/nuts_bolts.h"
+
+#define SECTOR_SIZE     FF_MAX_SS
+#define READ_CHUNK      4096
+#define FILL_INTERVAL   2   // ms
+
+#if SDCARD_JOB_BUFFER % SECTOR_SIZE
+#error SDCARD_JOB_BUFFER must be a multiple of 512!
+#endif
+
+static struct {
+    FIL *file;
+    stream_read_ptr source; // read function of the SD card plugin stream when buffering a $F job
+    bool eof;
+    bool error;
+    bool primed;            // buffer has been filled once, level_min is tracked from then on
+    volatile bool busy;
+    uint32_t head;          // total bytes read from the card
+    uint32_t tail;          // total bytes consumed
+#if SDCARD_DIRECT_ENABLE
+    bool direct;
+    uint32_t skip;          // bytes to skip in the first sector
+    sdcard_direct_t stream;
+#endif
+    sdcard_reader_stats_t stats;
+    uint32_t buf[SDCARD_JOB_BUFFER / sizeof(uint32_t)]; // Word aligned for DMA
+} rd = {0};
+
+static struct {
+    bool active;
+    bool eol;               // last character returned terminated a line
+    uint32_t line;          // number of lines read
+    FIL file;
+#if SDCARD_JOBCACHE_ENABLE
+    bool cached;            // job is read from the sidecar file
+    uint_fast16_t record;   // characters left of the current record, including the line terminator
+    sdcard_jobcache_t cache;
+#endif
+    io_stream_t stream;     // input stream to restore when the job ends
+} job = {0};
+
+static driver_reset_ptr driver_reset;
+static status_message_ptr status_message;
+static on_realtime_report_ptr on_realtime_report;
+static on_stream_changed_ptr on_stream_changed;
+static on_program_completed_ptr on_program_completed;
+
+static void fill_stats (uint32_t ms)
+{
+    ms = hal.get_elapsed_ticks() - ms;
+    if(ms > rd.stats.read_ms_max)
+        rd.stats.read_ms_max = ms;
+    rd.stats.reads++;
+
+    if(!rd.primed && (rd.eof || rd.head - rd.tail > SDCARD_JOB_BUFFER - SECTOR_SIZE)) {
+        rd.primed = true;
+        rd.stats.level_min = rd.head - rd.tail;
+    }
+
+    rd.stats.level = rd.head - rd.tail;
+}
+
+// Pulls up to READ_CHUNK characters from the plugin stream, stops at the first read that returns nothing.
+static void fill_stream (void)
+{
+    int16_t c;
+    uint32_t ms, count = 0;
+    sys_state_t state = state_get();
+
+    if(rd.eof || rd.head - rd.tail == SDCARD_JOB_BUFFER || !(state == STATE_IDLE || (state & (STATE_CYCLE|STATE_HOLD|STATE_CHECK_MODE))))
+        return;
+
+    rd.busy = true;
+    ms = hal.get_elapsed_ticks();
+
+    while(count < READ_CHUNK && rd.head - rd.tail < SDCARD_JOB_BUFFER) {
+        if((c = rd.source()) == -1) {
+            rd.eof = true;
+            break;
+        }
+        ((BYTE *)rd.buf)[rd.head++ % SDCARD_JOB_BUFFER] = (BYTE)c;
+        count++;
+    }
+
+    fill_stats(ms);
+    rd.busy = false;
+}
+
+static void fill (void)
+{
+    UINT br = 0, length, pos = rd.head % SDCARD_JOB_BUFFER, space = SDCARD_JOB_BUFFER - (rd.head - rd.tail);
+    uint32_t ms;
+
+    if(rd.source) {
+        fill_stream();
+        return;
+    }
+
+    if(rd.eof || space < SECTOR_SIZE)
+        return;
+
+    length = min(space, SDCARD_JOB_BUFFER - pos);
+    length = min(length, READ_CHUNK) & ~(SECTOR_SIZE - 1);
+
+    rd.busy = true;
+    ms = hal.get_elapsed_ticks();
+
+#if SDCARD_DIRECT_ENABLE
+    if(rd.direct) {
+        if((br = sdcard_direct_read(&rd.stream, (BYTE *)rd.buf + pos, length / SECTOR_SIZE)) == 0)
+            rd.error = rd.stream.pos < rd.stream.size;
+    } else
+#endif
+    {
+        if(f_tell(rd.file) % SECTOR_SIZE) // Align the file position to a sector boundary for the following reads
+            length = SECTOR_SIZE - f_tell(rd.file) % SECTOR_SIZE;
+
+        rd.error = f_read(rd.file, (BYTE *)rd.buf + pos, length, &br) != FR_OK;
+    }
+
+    rd.head += br;
+    rd.eof = rd.error || br < length;
+
+#if SDCARD_DIRECT_ENABLE
+    if(rd.skip && br) {
+        rd.tail += min(rd.skip, br);
+        rd.skip = 0;
+    }
+#endif
+
+    fill_stats(ms);
+    rd.busy = false;
+}
+
+static int16_t stream_read (void);
+
+static void reader_poll (void *data)
+{
+    if(rd.source && hal.stream.read != stream_read)
+        sdcard_reader_stop(); // The plugin has ended the job without notifying the stream change
+
+    if(rd.file || rd.source) {
+        if(!rd.busy)
+            fill();
+        task_add_delayed(reader_poll, NULL, FILL_INTERVAL);
+    }
+}
+
+static void reader_report (stream_write_ptr stream_write, report_tracking_flags_t report)
+{
+    if(rd.file || rd.source) {
+        stream_write("|SDB:");
+        stream_write(uitoa(rd.stats.level));
+        stream_write(",");
+        stream_write(uitoa(rd.stats.level_min));
+        stream_write(",");
+        stream_write(uitoa(rd.stats.starved));
+        stream_write(",");
+        stream_write(uitoa(rd.stats.read_ms_max));
+    }
+
+    if(on_realtime_report)
+        on_realtime_report(stream_write, report);
+}
+
+static void reader_reset (void)
+{
+    memset(&rd.stats, 0, sizeof(sdcard_reader_stats_t));
+
+    rd.head = rd.tail = 0;
+    rd.eof = rd.error = rd.primed = false;
+}
+
+void sdcard_reader_start (FIL *file)
+{
+    reader_reset();
+
+#if SDCARD_DIRECT_ENABLE
+    if((rd.direct = sdcard_direct_open(&rd.stream, file)))
+        rd.skip = sdcard_direct_seek(&rd.stream, f_tell(file));
+#endif
+
+    rd.file = file;
+
+    fill();
+
+    task_add_delayed(reader_poll, NULL, FILL_INTERVAL);
+}
+
+void sdcard_reader_stop (void)
+{
+#if SDCARD_DIRECT_ENABLE
+    if(rd.direct) {
+        sdcard_direct_close(&rd.stream);
+        rd.direct = false;
+    }
+#endif
+
+    task_delete(reader_poll, NULL);
+
+    rd.file = NULL;
+    rd.source = NULL;
+}
+
+// Read function installed in place of the plugin's while a $F job is buffered.
+static int16_t stream_read (void)
+{
+    int16_t c;
+
+    if(rd.tail == rd.head) {
+        if(!rd.eof)
+            rd.stats.starved++;
+        if((c = rd.source()) != -1)
+            rd.eof = false; // The plugin is delivering again, resume pulling from it
+        return c;
+    }
+
+    c = ((BYTE *)rd.buf)[rd.tail++ % SDCARD_JOB_BUFFER];
+
+    rd.stats.level = rd.head - rd.tail;
+    if(rd.primed && !rd.eof && rd.stats.level < rd.stats.level_min)
+        rd.stats.level_min = rd.stats.level;
+
+    return c;
+}
+
+// Buffers jobs the SD card plugin starts, our own $FR jobs are already buffered.
+static void stream_changed (stream_type_t type)
+{
+    if(on_stream_changed)
+        on_stream_changed(type);
+
+    if(type == StreamType_SDCard && !job.active && hal.stream.read != stream_read) {
+        sdcard_reader_stop();
+        reader_reset();
+        rd.source = hal.stream.read;
+        hal.stream.read = stream_read;
+        task_add_delayed(reader_poll, NULL, FILL_INTERVAL);
+    } else if(type != StreamType_SDCard && rd.source)
+        sdcard_reader_stop();
+}
+
+int16_t sdcard_reader_getc (void)
+{
+    int16_t c;
+
+    if(rd.file == NULL)
+        return -1;
+
+    if(rd.tail == rd.head) {
+        if(rd.eof)
+            return -1;
+        rd.stats.starved++;
+        fill();
+        if(rd.tail == rd.head)
+            return -1;
+    }
+
+    c = ((BYTE *)rd.buf)[rd.tail++ % SDCARD_JOB_BUFFER];
+
+    rd.stats.level = rd.head - rd.tail;
+    if(rd.primed && !rd.eof && rd.stats.level < rd.stats.level_min)
+        rd.stats.level_min = rd.stats.level;
+
+    return c;
+}
+
+bool sdcard_reader_eof (bool *error)
+{
+    if(error)
+        *error = rd.error;
+
+    return rd.eof && rd.tail == rd.head;
+}
+
+const sdcard_reader_stats_t *sdcard_reader_get_stats (void)
+{
+    return &rd.stats;
+}
+
+static void job_close (void)
+{
+    if(rd.file) {
+        sdcard_reader_stop();
+#if SDCARD_JOBCACHE_ENABLE
+        if(job.cached)
+            sdcard_jobcache_close(&job.cache);
+        else
+#endif
+        f_close(&job.file);
+    }
+}
+
+static void job_end (void)
+{
+    job_close();
+
+    if(job.active) {
+        job.active = false;
+        memcpy(&hal.stream, &job.stream, sizeof(io_stream_t));
+        grbl.report.status_message = status_message;
+    }
+}
+
+static int16_t job_getc (void)
+{
+#if SDCARD_JOBCACHE_ENABLE
+    if(job.cached) {
+
+        int16_t len;
+
+        if(job.record == 0) {
+            if((len = sdcard_reader_getc()) == -1)
+                return -1;
+            job.record = len + 1;
+        }
+
+        return --job.record ? sdcard_reader_getc() : '\n';
+    }
+#endif
+
+    return sdcard_reader_getc();
+}
+
+static int16_t job_read (void)
+{
+    bool error;
+    int16_t c = -1;
+    sys_state_t state = state_get();
+
+    if(rd.file) {
+
+        if(state == STATE_IDLE || (state & (STATE_CYCLE|STATE_HOLD|STATE_CHECK_MODE)))
+            c = job_getc();
+
+        if(c == -1 && sdcard_reader_eof(&error)) {
+            job_close();
+            if(error)
+                report_warning("SD card read failed, job stopped");
+            else if(!job.eol)
+                c = '\n'; // Terminate an unterminated last line
+        }
+
+        if(c != -1 && (job.eol = c == '\n'))
+            job.line++;
+
+    } else if(state == STATE_IDLE || state == STATE_CHECK_MODE)
+        job_end(); // Restore the input stream when the job has been executed
+
+    return c;
+}
+
+// Only errors are reported while a job is running, the job is stopped on the first one.
+static status_code_t trap_status_messages (status_code_t status_code)
+{
+    if(status_code != Status_OK) {
+
+        hal.stream.write("error:");
+        hal.stream.write(uitoa(status_code));
+        hal.stream.write(" in SD card job at line ");
+        hal.stream.write(uitoa(job.line));
+        hal.stream.write(ASCII_EOL);
+
+        job_end();
+    }
+
+    return status_code;
+}
+
+// Stops reading the job at M2/M30 as the plugin does, the stream is restored by job_read() when idle.
+static void job_completed (program_flow_t program_flow, bool check_mode)
+{
+    if(job.active)
+        job_close();
+
+    if(on_program_completed)
+        on_program_completed(program_flow, check_mode);
+}
+
+static void job_reset (void)
+{
+    job_end();
+
+    if(rd.source)
+        sdcard_reader_stop();
+
+    driver_reset();
+}
+
+// $FR=<file> - runs a job from the SD card via the read-ahead buffer.
+// $FR=<file>,<line> - resumes a job from the given line, numbered from 1. The line is located via the line offset index.
+static status_code_t job_run (sys_state_t state, char *args)
+{
+    uint32_t line = 1;
+
+    if(args == NULL)
+        return Status_InvalidStatement;
+
+    if(!(state == STATE_IDLE || state == STATE_CHECK_MODE) || hal.stream.type == StreamType_SDCard)
+        return Status_SystemGClock;
+
+#if SDCARD_INDEX_ENABLE
+    char *param;
+
+    if((param = strrchr(args, ',')) && *(param + 1) && strspn(param + 1, "0123456789") == strlen(param + 1)) {
+        *param++ = '\0';
+        if((line = (uint32_t)atol(param)) == 0)
+            return Status_InvalidStatement;
+    }
+#endif
+
+#if SDCARD_JOBCACHE_ENABLE
+    job.record = 0;
+    if(!(job.cached = line == 1 && sdcard_jobcache_open(&job.cache, args, false) == FR_OK))
+#endif
+    if(f_open(&job.file, args, FA_READ) != FR_OK)
+        return Status_SDReadError;
+
+#if SDCARD_INDEX_ENABLE
+    if(line > 1) {
+
+        FRESULT res;
+
+        sdcard_index_open(&job.file);
+        res = sdcard_index_seek_line(&job.file, args, line - 1);
+        sdcard_index_close(&job.file);
+
+        if(res != FR_OK) {
+            f_close(&job.file);
+            return res == FR_INVALID_PARAMETER ? Status_InvalidStatement : Status_SDReadError;
+        }
+    }
+#endif
+
+    job.line = line - 1;
+    job.eol = true;
+
+#if SDCARD_JOBCACHE_ENABLE
+    sdcard_reader_start(job.cached ? &job.cache.file : &job.file);
+#else
+    sdcard_reader_start(&job.file);
+#endif
+
+    grbl.report.status_message(Status_OK);                  // Confirm the command before status messages are trapped
+    memcpy(&job.stream, &hal.stream, sizeof(io_stream_t));  // Save the current stream
+    hal.stream.type = StreamType_SDCard;                    // and redirect input to the job
+    hal.stream.read = job_read;
+    status_message = grbl.report.status_message;
+    grbl.report.status_message = trap_status_messages;
+    job.active = true;
+
+    return Status_OK;
+}
+
+void sdcard_reader_init (void)
+{
+    static const sys_command_t reader_command_list[] = {
+#if SDCARD_INDEX_ENABLE
+        {"FR", job_run, {0}, { .str = "run SD card job via the read-ahead buffer, $FR=<file>,<line> resumes from line" } }
+#else
+        {"FR", job_run, {0}, { .str = "run SD card job via the read-ahead buffer" } }
+#endif
+    };
+
+    static sys_commands_t reader_commands = {
+        .n_commands = sizeof(reader_command_list) / sizeof(sys_command_t),
+        .commands = reader_command_list
+    };
+
+    driver_reset = hal.driver_reset;
+    hal.driver_reset = job_reset;
+
+    on_realtime_report = grbl.on_realtime_report;
+    grbl.on_realtime_report = reader_report;
+
+    on_stream_changed = grbl.on_stream_changed;
+    grbl.on_stream_changed = stream_changed;
+
+    on_program_completed = grbl.on_program_completed;
+    grbl.on_program_completed = job_completed;
+
+    system_register_commands(&reader_commands);
+}
+
+#endif // SDCARD_ENABLE && SDCARD_JOB_BUFFER
@@ -0,0 +1,498 @@
+/*
+
+  sdcard_upload.c - YModem upload to the SD card with write-behind buffering
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  $FY starts a YModem (CRC, 128 and 1024 byte blocks) receiver on the current stream, the file name and size
+  are taken from the header block. Input to the parser is suspended and realtime command characters are
+  buffered as data for the duration of the transfer, the stream is restored when the batch ends, on an error
+  or on a reset.
+
+  The receiver runs from a delayed foreground task every millisecond. A block is acknowledged as soon as it
+  has been copied to a RAM write-behind buffer, the buffer is written to the card one 4 KB chunk per task run.
+  Chunks are sector aligned in the file so FatFs passes them straight to disk_write() as multi sector writes.
+  When the buffer is full the block is acknowledged after a chunk has been written, such stalls are counted.
+  Card writes are blocking: input accumulates in the stream buffer meanwhile, the sender is held off by flow
+  control if the stream has it, otherwise an overrun block is rejected and retransmitted.
+  When the header carries the file size the file is preallocated as a single fragment with f_expand(),
+  this avoids FAT updates during the transfer and lets the file be read directly by sector later.
+  The transfer stats of the last file are output when the batch ends.
+*/
+
+#include "driver.h"
+
+#if SDCARD_ENABLE && SDCARD_WRITEBEHIND
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdcard_upload.h"
+#include "ff.h"
+
+#include "grbl/hal.h"
+#include "grbl/task.h"
+#include "grbl/report.h"
+#include "grbl/state_machine.h"
+#include "grbl/nuts_bolts.h"
+
+#define YM_SOH          0x01
+#define YM_STX          0x02
+#define YM_EOT          0x04
+#define YM_ACK          0x06
+#define YM_NAK          0x15
+#define YM_CAN          0x18
+#define YM_CRC          'C'
+
+#define WRITE_CHUNK     4096
+#define POLL_INTERVAL   1       // ms
+#define TIMEOUT         1000    // ms
+#define MAX_ERRORS      10      // consecutive timeouts or bad blocks before the transfer is aborted
+
+#if SDCARD_WRITEBEHIND % WRITE_CHUNK
+#error SDCARD_WRITEBEHIND must be a multiple of 4096!
+#endif
+
+typedef enum {
+    Upload_Header = 0,
+    Upload_Data
+} upload_state_t;
+
+static struct {
+    bool active;
+    bool open;                  // file is open
+    bool done;                  // a file has been received
+    upload_state_t state;
+    uint8_t seq;                // expected block number
+    uint_fast8_t errors;
+    uint_fast8_t cancels;
+    uint32_t size;              // file size from the header, 0 if not known
+    uint32_t started;
+    uint32_t last_rx;           // time of the last byte or retry request
+    uint_fast16_t pkt_len;
+    stream_read_ptr read;       // read function of the stream, the parser gets no input while receiving
+    enqueue_realtime_command_ptr enqueue_realtime_command;
+    FIL file;
+    char path[128];
+    uint8_t pkt[3 + 1024 + 2];  // block header, data and CRC
+} up = {0};
+
+static struct {
+    FRESULT res;
+    uint32_t head;              // total bytes buffered
+    uint32_t tail;              // total bytes written to the card
+    uint32_t buf[SDCARD_WRITEBEHIND / sizeof(uint32_t)]; // Word aligned for DMA
+} wb = {0};
+
+static sdcard_upload_stats_t stats;
+static driver_reset_ptr driver_reset;
+
+static uint16_t crc16 (const uint8_t *buf, uint_fast16_t len)
+{
+    uint_fast8_t bit;
+    uint16_t crc = 0;
+
+    while(len--) {
+        crc ^= (uint16_t)*buf++ << 8;
+        for(bit = 0; bit < 8; bit++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+
+    return crc;
+}
+
+static inline void send (char c)
+{
+    hal.stream.write_char(c);
+}
+
+static void send_cancel (void)
+{
+    send(YM_CAN);
+    send(YM_CAN);
+    send(YM_CAN);
+}
+
+// Writes up to one chunk, partial chunks only if final is true.
+static bool flush_chunk (bool final)
+{
+    UINT bw, length = wb.head - wb.tail;
+    uint32_t ms;
+
+    if(length > WRITE_CHUNK)
+        length = WRITE_CHUNK;
+
+    if(length == 0 || wb.res != FR_OK || (length < WRITE_CHUNK && !final))
+        return false;
+
+    ms = hal.get_elapsed_ticks();
+
+    // The buffer size is a multiple of the chunk size so a chunk never wraps.
+    if((wb.res = f_write(&up.file, (BYTE *)wb.buf + wb.tail % SDCARD_WRITEBEHIND, length, &bw)) == FR_OK && bw != length)
+        wb.res = FR_DENIED; // Disk full
+
+    ms = hal.get_elapsed_ticks() - ms;
+    if(ms > stats.flush_ms_max)
+        stats.flush_ms_max = ms;
+    stats.flushes++;
+
+    wb.tail += length;
+
+    return wb.res == FR_OK;
+}
+
+static bool buffer_write (const uint8_t *data, uint32_t length)
+{
+    uint32_t count, pos;
+
+    while(length) {
+
+        if(wb.head - wb.tail == SDCARD_WRITEBEHIND) {
+            stats.stalls++;
+            if(!flush_chunk(false))
+                return false;
+        }
+
+        pos = wb.head % SDCARD_WRITEBEHIND;
+        count = min(length, SDCARD_WRITEBEHIND - (wb.head - wb.tail));
+        count = min(count, SDCARD_WRITEBEHIND - pos);
+
+        memcpy((BYTE *)wb.buf + pos, data, count);
+
+        data += count;
+        length -= count;
+        wb.head += count;
+        stats.bytes += count;
+    }
+
+    if(wb.head - wb.tail > stats.peak)
+        stats.peak = wb.head - wb.tail;
+
+    return wb.res == FR_OK;
+}
+
+static bool file_open (const char *name, uint32_t size)
+{
+    if(strlen(name) >= sizeof(up.path) || f_open(&up.file, name, FA_WRITE|FA_CREATE_ALWAYS) != FR_OK)
+        return false;
+
+    strcpy(up.path, name);
+    memset(&stats, 0, sizeof(sdcard_upload_stats_t));
+
+#if FF_USE_EXPAND
+    if(size)
+        stats.contiguous = f_expand(&up.file, size, 1) == FR_OK;
+#endif
+
+    wb.head = wb.tail = 0;
+    wb.res = FR_OK;
+    up.size = size;
+    up.open = true;
+    up.started = hal.get_elapsed_ticks();
+
+    return true;
+}
+
+// Flushes the buffer and closes the file, the file is deleted if keep is false or a write failed.
+static bool file_close (bool keep)
+{
+    FRESULT res;
+
+    if(keep)
+        while(flush_chunk(true));
+
+    if((res = wb.res) == FR_OK && f_size(&up.file) > f_tell(&up.file))
+        res = f_truncate(&up.file); // Drop the unused part of the preallocated space
+
+    if(f_close(&up.file) != FR_OK && res == FR_OK)
+        res = FR_DISK_ERR;
+
+    if(!keep || res != FR_OK)
+        f_unlink(up.path);
+
+    stats.ms = hal.get_elapsed_ticks() - up.started;
+    up.open = false;
+
+    return keep && res == FR_OK;
+}
+
+static void report_stats (void)
+{
+    hal.stream.write("[UPLOAD:");
+    hal.stream.write(up.path);
+    hal.stream.write("|");
+    hal.stream.write(uitoa(stats.bytes));
+    hal.stream.write(" bytes|");
+    hal.stream.write(uitoa(stats.ms));
+    hal.stream.write(" ms|");
+    hal.stream.write(uitoa(stats.ms ? stats.bytes / stats.ms : 0)); // bytes/ms = kB/s
+    hal.stream.write(" kB/s|blocks:");
+    hal.stream.write(uitoa(stats.blocks));
+    hal.stream.write(",");
+    hal.stream.write(uitoa(stats.blocks_1k));
+    hal.stream.write("|naks:");
+    hal.stream.write(uitoa(stats.naks));
+    hal.stream.write("|writes:");
+    hal.stream.write(uitoa(stats.flushes));
+    hal.stream.write("|max:");
+    hal.stream.write(uitoa(stats.flush_ms_max));
+    hal.stream.write(" ms|peak:");
+    hal.stream.write(uitoa(stats.peak));
+    hal.stream.write("|stalls:");
+    hal.stream.write(uitoa(stats.stalls));
+    hal.stream.write(stats.contiguous ? "|contiguous]" ASCII_EOL : "]" ASCII_EOL);
+}
+
+static int16_t upload_read (void)
+{
+    return -1;
+}
+
+// Restores the stream, error is reported if not NULL. Nothing is output on a reset.
+static void upload_end (const char *error, bool report)
+{
+    if(up.open)
+        file_close(false);
+
+    hal.stream.read = up.read;
+    hal.stream.set_enqueue_rt_handler(up.enqueue_realtime_command);
+    if(hal.stream.reset_read_buffer)
+        hal.stream.reset_read_buffer(); // Drop what is left of the transfer
+
+    up.active = false;
+
+    if(report) {
+        if(error)
+            report_warning((char *)error);
+        else if(up.done)
+            report_stats();
+    }
+}
+
+static void block_received (void)
+{
+    uint_fast16_t len = up.pkt[0] == YM_STX ? 1024 : 128;
+
+    if(up.pkt[1] != (uint8_t)~up.pkt[2] || crc16(&up.pkt[3], len) != ((up.pkt[len + 3] << 8) | up.pkt[len + 4])) {
+        stats.naks++;
+        send(YM_NAK);
+        return;
+    }
+
+    up.errors = 0;
+
+    if(up.state == Upload_Header) {
+
+        if(up.pkt[1] != 0) {    // Data block retransmitted after the end of the file was acknowledged
+            send(YM_ACK);
+            return;
+        }
+
+        if(up.pkt[3] == '\0') { // Empty header, end of batch
+            send(YM_ACK);
+            upload_end(up.done ? NULL : "SD card upload: no file received", true);
+            return;
+        }
+
+        char *name = (char *)&up.pkt[3];
+
+        if(!file_open(name, (uint32_t)strtoul(name + strlen(name) + 1, NULL, 10))) {
+            send_cancel();
+            upload_end("SD card upload: file could not be created", true);
+            return;
+        }
+
+        up.seq = 1;
+        up.state = Upload_Data;
+        send(YM_ACK);
+        send(YM_CRC);
+
+    } else if(up.pkt[1] == (uint8_t)(up.seq - 1))
+        send(YM_ACK);           // Duplicate, our acknowledge was lost
+
+    else if(up.pkt[1] != up.seq) {
+        send_cancel();
+        upload_end("SD card upload: block out of sequence", true);
+
+    } else {
+
+        uint32_t count = len;
+
+        if(up.size)             // Drop the padding of the last block
+            count = min(count, up.size - min(up.size, stats.bytes));
+
+        if(!buffer_write(&up.pkt[3], count)) {
+            send_cancel();
+            upload_end("SD card upload: write failed", true);
+            return;
+        }
+
+        up.seq++;
+        stats.blocks++;
+        if(len == 1024)
+            stats.blocks_1k++;
+
+        send(YM_ACK);
+    }
+}
+
+static void byte_received (uint8_t c)
+{
+    if(up.pkt_len == 0) switch(c) {
+
+        case YM_SOH:
+        case YM_STX:
+            up.cancels = 0;
+            up.pkt[up.pkt_len++] = c;
+            break;
+
+        case YM_EOT:
+            up.cancels = 0;
+            if(up.state == Upload_Data) {
+                if(!file_close(true)) {
+                    send_cancel();
+                    upload_end("SD card upload: write failed", true);
+                    break;
+                }
+                up.done = true;
+                up.state = Upload_Header;
+                send(YM_ACK);
+                send(YM_CRC);       // Request the next header, the batch ends with an empty one
+            } else
+                send(YM_ACK);
+            break;
+
+        case YM_CAN:
+            if(++up.cancels == 2)
+                upload_end("SD card upload cancelled", true);
+            break;
+
+        default: // Noise between blocks
+            break;
+
+    } else {
+
+        up.pkt[up.pkt_len++] = c;
+
+        if(up.pkt_len == (up.pkt[0] == YM_STX ? 1024 : 128) + 5) {
+            up.pkt_len = 0;
+            block_received();
+        }
+    }
+}
+
+static void upload_poll (void *data)
+{
+    int16_t c;
+    uint32_t ms = hal.get_elapsed_ticks();
+
+    while(up.active && (c = up.read()) != -1) {
+        up.last_rx = ms;
+        byte_received((uint8_t)c);
+    }
+
+    if(!up.active)
+        return;
+
+    if(ms - up.last_rx >= TIMEOUT) {
+
+        up.last_rx = ms;
+        up.pkt_len = 0;
+
+        if(++up.errors > MAX_ERRORS) {
+            send_cancel();
+            // A sender that ends the batch without an empty header block times out here.
+            upload_end(up.done && up.state == Upload_Header ? NULL : "SD card upload timed out", true);
+            return;
+        }
+
+        if(up.state == Upload_Data)
+            stats.naks++;
+
+        send(up.state == Upload_Header ? YM_CRC : YM_NAK);
+    }
+
+    if(up.open)
+        flush_chunk(false);
+
+    task_add_delayed(upload_poll, NULL, POLL_INTERVAL);
+}
+
+static void upload_reset (void)
+{
+    if(up.active) {
+        task_delete(upload_poll, NULL);
+        upload_end(NULL, false);
+    }
+
+    driver_reset();
+}
+
+// $FY - receives files to the SD card by YModem.
+static status_code_t upload_start (sys_state_t state, char *args)
+{
+    if(args)
+        return Status_InvalidStatement;
+
+    if(state != STATE_IDLE || up.active || hal.stream.type == StreamType_SDCard)
+        return Status_SystemGClock;
+
+    if(hal.stream.write_char == NULL || hal.stream.set_enqueue_rt_handler == NULL)
+        return Status_InvalidStatement; // Stream cannot transfer binary data
+
+    up.done = false;
+    up.state = Upload_Header;
+    up.errors = up.cancels = 0;
+    up.pkt_len = 0;
+    up.last_rx = hal.get_elapsed_ticks() - TIMEOUT; // Send the first request right away
+    up.read = hal.stream.read;
+    hal.stream.read = upload_read;
+    up.enqueue_realtime_command = hal.stream.set_enqueue_rt_handler(stream_buffer_all);
+    up.active = true;
+
+    task_add_delayed(upload_poll, NULL, POLL_INTERVAL);
+
+    return Status_OK;
+}
+
+const sdcard_upload_stats_t *sdcard_upload_get_stats (void)
+{
+    return &stats;
+}
+
+void sdcard_upload_init (void)
+{
+    static const sys_command_t upload_command_list[] = {
+        {"FY", upload_start, { .noargs = On }, { .str = "receive files to the SD card by YModem with write-behind buffering" } }
+    };
+
+    static sys_commands_t upload_commands = {
+        .n_commands = sizeof(upload_command_list) / sizeof(sys_command_t),
+        .commands = upload_command_list
+    };
+
+    driver_reset = hal.driver_reset;
+    hal.driver_reset = upload_reset;
+
+    system_register_commands(&upload_commands);
+}
+
+#endif // SDCARD_ENABLE && SDCARD_WRITEBEHIND
@@ -28,10 +28,37 @@
 
 #include "grbl/hal.h"
 #include "grbl/protocol.h"
+#include "grbl/nuts_bolts.h"
+
+#if STREAM_STATS_ENABLE
+#include "stream_stats.h"
+#endif
+
+#ifndef SERIAL_BAUD_MAX_ERROR
+#define SERIAL_BAUD_MAX_ERROR 25 // permille, baud rates that cannot be set within this tolerance are rejected
+#endif
+
+#if SERIAL_RTS_ENABLE || SERIAL1_RTS_ENABLE || SERIAL2_RTS_ENABLE
+#ifndef RX_BUFFER_HWM
+#define RX_BUFFER_HWM ((RX_BUFFER_SIZE * 3) / 4) // Throttle sender when input buffer fill reaches this level
+#endif
+#ifndef RX_BUFFER_LWM
+#define RX_BUFFER_LWM (RX_BUFFER_SIZE / 4)       // and release when it drops below this level
+#endif
+#endif
+
+typedef struct {
+    uint32_t requested;
+    uint32_t actual;
+} serial_baud_t;
 
 #ifdef SERIAL_PORT
 static stream_rx_buffer_t rxbuf = {0};
 static stream_tx_buffer_t txbuf = {0};
+static serial_baud_t baud = {0};
+#if STREAM_STATS_ENABLE
+static stream_stats_t stats = { .name = "UART1" };
+#endif
 static enqueue_realtime_command_ptr enqueue_realtime_command = protocol_enqueue_realtime_command;
 static const io_stream_t *serialInit (uint32_t baud_rate);
 #else
@@ -41,6 +68,10 @@ static const io_stream_t *serialInit (uint32_t baud_rate);
 #ifdef SERIAL1_PORT
 static stream_rx_buffer_t rxbuf1 = {0};
 static stream_tx_buffer_t txbuf1 = {0};
+static serial_baud_t baud1 = {0};
+#if STREAM_STATS_ENABLE
+static stream_stats_t stats1 = { .name = "UART2" };
+#endif
 static enqueue_realtime_command_ptr enqueue_realtime_command1 = protocol_enqueue_realtime_command;
 static const io_stream_t *serial1Init(uint32_t baud_rate);
 #else
@@ -50,6 +81,10 @@ static const io_stream_t *serial1Init(uint32_t baud_rate);
 #ifdef SERIAL2_PORT
 static stream_rx_buffer_t rxbuf2 = {0};
 static stream_tx_buffer_t txbuf2 = {0};
+static serial_baud_t baud2 = {0};
+#if STREAM_STATS_ENABLE
+static stream_stats_t stats2 = { .name = "UART3" };
+#endif
 static enqueue_realtime_command_ptr enqueue_realtime_command2 = protocol_enqueue_realtime_command;
 static const io_stream_t *serial2Init(uint32_t baud_rate);
 #else
@@ -138,6 +173,39 @@ static const io_stream_t *serial2Init(uint32_t baud_rate);
 #error Code has to be added to support serial port
 #endif
 
+#if SERIAL_RTS_ENABLE == 1
+#if SERIAL_PORT == 2
+#define UART0_CTS_PIN 0
+#define UART0_RTS_PIN 1
+#define UART0_FC_PORT GPIOA
+#elif SERIAL_PORT == 21
+#define UART0_CTS_PIN 3
+#define UART0_RTS_PIN 4
+#define UART0_FC_PORT GPIOD
+#elif SERIAL_PORT == 3
+#define UART0_CTS_PIN 13
+#define UART0_RTS_PIN 14
+#define UART0_FC_PORT GPIOB
+#elif SERIAL_PORT == 32
+#define UART0_CTS_PIN 11
+#define UART0_RTS_PIN 12
+#define UART0_FC_PORT GPIOD
+#elif (SERIAL_PORT == 1 || SERIAL_PORT == 11) && !USB_SERIAL_CDC
+#define UART0_CTS_PIN 11
+#define UART0_RTS_PIN 12
+#define UART0_FC_PORT GPIOA
+#else
+#error Hardware flow control is not available for the selected serial port, use GPIO RTS instead!
+#endif
+#define UART0_RTS_PORT UART0_FC_PORT
+#elif SERIAL_RTS_ENABLE == 2
+#if !defined(SERIAL_RTS_PORT) || !defined(SERIAL_RTS_PIN)
+#error SERIAL_RTS_PORT and SERIAL_RTS_PIN must be defined for GPIO RTS flow control!
+#endif
+#define UART0_RTS_PORT SERIAL_RTS_PORT
+#define UART0_RTS_PIN SERIAL_RTS_PIN
+#endif
+
 #endif // SERIAL_PORT
 
 #if SERIAL1_PORT
@@ -222,6 +290,39 @@ static const io_stream_t *serial2Init(uint32_t baud_rate);
 #error Code has to be added to support serial port 1
 #endif
 
+#if SERIAL1_RTS_ENABLE == 1
+#if SERIAL1_PORT == 2
+#define UART1_CTS_PIN 0
+#define UART1_RTS_PIN 1
+#define UART1_FC_PORT GPIOA
+#elif SERIAL1_PORT == 21
+#define UART1_CTS_PIN 3
+#define UART1_RTS_PIN 4
+#define UART1_FC_PORT GPIOD
+#elif SERIAL1_PORT == 3
+#define UART1_CTS_PIN 13
+#define UART1_RTS_PIN 14
+#define UART1_FC_PORT GPIOB
+#elif SERIAL1_PORT == 32
+#define UART1_CTS_PIN 11
+#define UART1_RTS_PIN 12
+#define UART1_FC_PORT GPIOD
+#elif (SERIAL1_PORT == 1 || SERIAL1_PORT == 11) && !USB_SERIAL_CDC
+#define UART1_CTS_PIN 11
+#define UART1_RTS_PIN 12
+#define UART1_FC_PORT GPIOA
+#else
+#error Hardware flow control is not available for the selected serial port, use GPIO RTS instead!
+#endif
+#define UART1_RTS_PORT UART1_FC_PORT
+#elif SERIAL1_RTS_ENABLE == 2
+#if !defined(SERIAL1_RTS_PORT) || !defined(SERIAL1_RTS_PIN)
+#error SERIAL1_RTS_PORT and SERIAL1_RTS_PIN must be defined for GPIO RTS flow control!
+#endif
+#define UART1_RTS_PORT SERIAL1_RTS_PORT
+#define UART1_RTS_PIN SERIAL1_RTS_PIN
+#endif
+
 #endif // SERIAL1_PORT
 
 #if SERIAL2_PORT
@@ -306,6 +407,39 @@ static const io_stream_t *serial2Init(uint32_t baud_rate);
 #error Code has to be added to support serial port 2
 #endif
 
+#if SERIAL2_RTS_ENABLE == 1
+#if SERIAL2_PORT == 2
+#define UART2_CTS_PIN 0
+#define UART2_RTS_PIN 1
+#define UART2_FC_PORT GPIOA
+#elif SERIAL2_PORT == 21
+#define UART2_CTS_PIN 3
+#define UART2_RTS_PIN 4
+#define UART2_FC_PORT GPIOD
+#elif SERIAL2_PORT == 3
+#define UART2_CTS_PIN 13
+#define UART2_RTS_PIN 14
+#define UART2_FC_PORT GPIOB
+#elif SERIAL2_PORT == 32
+#define UART2_CTS_PIN 11
+#define UART2_RTS_PIN 12
+#define UART2_FC_PORT GPIOD
+#elif (SERIAL2_PORT == 1 || SERIAL2_PORT == 11) && !USB_SERIAL_CDC
+#define UART2_CTS_PIN 11
+#define UART2_RTS_PIN 12
+#define UART2_FC_PORT GPIOA
+#else
+#error Hardware flow control is not available for the selected serial port, use GPIO RTS instead!
+#endif
+#define UART2_RTS_PORT UART2_FC_PORT
+#elif SERIAL2_RTS_ENABLE == 2
+#if !defined(SERIAL2_RTS_PORT) || !defined(SERIAL2_RTS_PIN)
+#error SERIAL2_RTS_PORT and SERIAL2_RTS_PIN must be defined for GPIO RTS flow control!
+#endif
+#define UART2_RTS_PORT SERIAL2_RTS_PORT
+#define UART2_RTS_PIN SERIAL2_RTS_PIN
+#endif
+
 #endif // SERIAL2_PORT
 
 static io_stream_properties_t serial[] = {
@@ -344,6 +478,75 @@ static io_stream_properties_t serial[] = {
 #endif
 };
 
+#if SERIAL_PORT || SERIAL1_PORT || SERIAL2_PORT
+
+//
+// Sets the baud rate register, oversampling by 8 is selected when the rate cannot be reached
+// with oversampling by 16. This allows up to PCLK/8, e.g. 10.5 Mbaud on APB2 USARTs of a F407.
+// NOTE: the UART must be disabled when called.
+// Returns the achieved baud rate, 0 if out of range or the error exceeds SERIAL_BAUD_MAX_ERROR.
+//
+static uint32_t serialSetBRR (USART_TypeDef *uart, uint32_t pclk, serial_baud_t *baud, uint32_t baud_rate)
+{
+    uint32_t div, actual, error;
+
+    if(baud_rate == 0 || (div = (pclk + (baud_rate >> 1)) / baud_rate) < 8 || div > 0xFFFF)
+        return 0;
+
+    actual = pclk / div;
+    error = actual > baud_rate ? actual - baud_rate : baud_rate - actual;
+
+    if(error * 1000 > baud_rate * SERIAL_BAUD_MAX_ERROR)
+        return 0;
+
+    if(div >= 16) {
+        uart->CR1 &= ~USART_CR1_OVER8;
+        uart->BRR = div;
+    } else {
+        uart->CR1 |= USART_CR1_OVER8;
+        uart->BRR = ((div & ~0x07) << 1) | (div & 0x07);
+    }
+
+    baud->requested = baud_rate;
+
+    return baud->actual = actual;
+}
+
+static void report_baud (uint_fast8_t uart, serial_baud_t *baud)
+{
+    if(baud->requested) {
+
+        int32_t error = (int32_t)(baud->actual - baud->requested);
+
+        hal.stream.write("[UART");
+        hal.stream.write(uitoa(uart));
+        hal.stream.write(":");
+        hal.stream.write(uitoa(baud->requested));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(baud->actual));
+        hal.stream.write(",");
+        hal.stream.write(ftoa((float)error * 100.0f / (float)baud->requested, 2));
+        hal.stream.write("%]" ASCII_EOL);
+    }
+}
+
+static status_code_t report_uarts (sys_state_t state, char *args)
+{
+#if SERIAL_PORT
+    report_baud(1, &baud);
+#endif
+#if SERIAL1_PORT
+    report_baud(2, &baud1);
+#endif
+#if SERIAL2_PORT
+    report_baud(3, &baud2);
+#endif
+
+    return Status_OK;
+}
+
+#endif
+
 void serialRegisterStreams (void)
 {
     static io_stream_details_t streams = {
@@ -374,6 +577,21 @@ void serialRegisterStreams (void)
     hal.periph_port.register_pin(&rx0);
     hal.periph_port.register_pin(&tx0);
 
+#if SERIAL_RTS_ENABLE
+
+    static const periph_pin_t rts0 = {
+        .function = Output_RTS,
+        .group = PinGroup_UART1,
+        .port = UART0_RTS_PORT,
+        .pin = UART0_RTS_PIN,
+        .mode = { .mask = PINMODE_OUTPUT },
+        .description = "UART1"
+    };
+
+    hal.periph_port.register_pin(&rts0);
+
+#endif
+
 #endif
 
 #if SERIAL1_PORT
@@ -399,6 +617,21 @@ void serialRegisterStreams (void)
     hal.periph_port.register_pin(&rx1);
     hal.periph_port.register_pin(&tx1);
 
+#if SERIAL1_RTS_ENABLE
+
+    static const periph_pin_t rts1 = {
+        .function = Output_RTS,
+        .group = PinGroup_UART2,
+        .port = UART1_RTS_PORT,
+        .pin = UART1_RTS_PIN,
+        .mode = { .mask = PINMODE_OUTPUT },
+        .description = "UART2"
+    };
+
+    hal.periph_port.register_pin(&rts1);
+
+#endif
+
 #endif
 
 #if SERIAL2_PORT
@@ -424,9 +657,39 @@ void serialRegisterStreams (void)
     hal.periph_port.register_pin(&rx2);
     hal.periph_port.register_pin(&tx2);
 
+#if SERIAL2_RTS_ENABLE
+
+    static const periph_pin_t rts2 = {
+        .function = Output_RTS,
+        .group = PinGroup_UART3,
+        .port = UART2_RTS_PORT,
+        .pin = UART2_RTS_PIN,
+        .mode = { .mask = PINMODE_OUTPUT },
+        .description = "UART3"
+    };
+
+    hal.periph_port.register_pin(&rts2);
+
+#endif
+
 #endif
 
     stream_register_streams(&streams);
+
+#if SERIAL_PORT || SERIAL1_PORT || SERIAL2_PORT
+
+    static const sys_command_t uart_command_list[] = {
+        {"UARTS", report_uarts, { .noargs = On }, { .str = "output UART requested and actual baud rates" } }
+    };
+
+    static sys_commands_t uart_commands = {
+        .n_commands = sizeof(uart_command_list) / sizeof(sys_command_t),
+        .commands = uart_command_list
+    };
+
+    system_register_commands(&uart_commands);
+
+#endif
 }
 
 #if SERIAL_PORT || SERIAL1_PORT || SERIAL2_PORT
@@ -452,6 +715,24 @@ static bool serialClaimPort (uint8_t instance)
 
 #if SERIAL_PORT
 
+#if SERIAL_RTS_ENABLE
+
+//
+// Throttles or releases the sender. GPIO RTS is deasserted (high) directly, for hardware flow control
+// reception is halted so that the USART deasserts RTS when the data register becomes full.
+//
+static void serialRtsHold (bool on)
+{
+    rxbuf.rts_state = on;
+#if SERIAL_RTS_ENABLE == 1
+    BITBAND_PERI(UART0->CR1, USART_CR1_RXNEIE_Pos) = !on;
+#else
+    DIGITAL_OUT(UART0_RTS_PORT, UART0_RTS_PIN, on);
+#endif
+}
+
+#endif
+
 //
 // Returns number of free characters in serial input buffer
 //
@@ -478,6 +759,10 @@ static uint16_t serialRxCount (void)
 static void serialRxFlush (void)
 {
     rxbuf.tail = rxbuf.head;
+#if SERIAL_RTS_ENABLE
+    if(rxbuf.rts_state)
+        serialRtsHold(false);
+#endif
 }
 
 //
@@ -488,6 +773,10 @@ static void serialRxCancel (void)
     rxbuf.data[rxbuf.head] = ASCII_CAN;
     rxbuf.tail = rxbuf.head;
     rxbuf.head = BUFNEXT(rxbuf.head, rxbuf);
+#if SERIAL_RTS_ENABLE
+    if(rxbuf.rts_state)
+        serialRtsHold(false);
+#endif
 }
 
 //
@@ -498,11 +787,18 @@ static bool serialPutC (const char c)
     uint16_t next_head = BUFNEXT(txbuf.head, txbuf);    // Get pointer to next free slot in buffer
 
     while(txbuf.tail == next_head) {                    // While TX buffer full
+#if STREAM_STATS_ENABLE
+        if(!stream_stats_blocking_callback(&stats))
+#else
         if(!hal.stream_blocking_callback())             // check if blocking for space,
+#endif
             return false;                               // exit if not (leaves TX buffer in an inconsistent state)
     }
     txbuf.data[txbuf.head] = c;                         // Add data to buffer,
     txbuf.head = next_head;                             // update head pointer and
+#if STREAM_STATS_ENABLE
+    stream_stats_tx(&stats, 1, BUFCOUNT(next_head, txbuf.tail, TX_BUFFER_SIZE));
+#endif
     UART0->CR1 |= USART_CR1_TXEIE;                      // enable TX interrupts
 
     return true;
@@ -562,6 +858,11 @@ static int16_t serialGetC (void)
     char data = rxbuf.data[tail];       // Get next character
     rxbuf.tail = BUFNEXT(tail, rxbuf);  // and update pointer
 
+#if SERIAL_RTS_ENABLE
+    if(rxbuf.rts_state && BUFCOUNT(rxbuf.head, rxbuf.tail, RX_BUFFER_SIZE) < RX_BUFFER_LWM)
+        serialRtsHold(false);                                 // Release sender
+#endif
+
     return (int16_t)data;
 }
 
@@ -572,9 +873,22 @@ static bool serialSuspendInput (bool suspend)
 
 static bool serialSetBaudRate (uint32_t baud_rate)
 {
+    uint32_t cr1 = UART0->CR1, brr = UART0->BRR;
+
     UART0->CR1 = USART_CR1_RE|USART_CR1_TE;
-    UART0->BRR = UART_BRR_SAMPLING16(UART0_CLK, baud_rate);
+
+    if(serialSetBRR(UART0, UART0_CLK, &baud, baud_rate) == 0) {
+        UART0->BRR = brr;     // Keep the current settings
+        UART0->CR1 = cr1;
+        return false;
+    }
+
+#if SERIAL_RTS_ENABLE == 1
+    UART0->CR3 = USART_CR3_RTSE|USART_CR3_CTSE;
+    UART0->CR1 |= rxbuf.rts_state ? USART_CR1_UE : (USART_CR1_UE|USART_CR1_RXNEIE);
+#else
     UART0->CR1 |= (USART_CR1_UE|USART_CR1_RXNEIE);
+#endif
 
     return true;
 }
@@ -583,7 +897,11 @@ static bool serialDisable (bool disable)
 {
     if(disable)
         UART0->CR1 &= ~USART_CR1_RXNEIE;
+#if SERIAL_RTS_ENABLE == 1
+    else if(!rxbuf.rts_state)
+#else
     else
+#endif
         UART0->CR1 |= USART_CR1_RXNEIE;
 
     return true;
@@ -640,27 +958,63 @@ static const io_stream_t *serialInit (uint32_t baud_rate)
     };
     HAL_GPIO_Init(UART0_PORT, &GPIO_InitStructure);
 
-    serialSetBaudRate(baud_rate);
+#if SERIAL_RTS_ENABLE == 1
+    GPIO_InitStructure.Pin = (1 << UART0_CTS_PIN)|(1 << UART0_RTS_PIN);
+    HAL_GPIO_Init(UART0_FC_PORT, &GPIO_InitStructure);
+#elif SERIAL_RTS_ENABLE == 2
+    DIGITAL_OUT(UART0_RTS_PORT, UART0_RTS_PIN, 0);
+    GPIO_InitStructure.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStructure.Pin = 1 << UART0_RTS_PIN;
+    HAL_GPIO_Init(UART0_RTS_PORT, &GPIO_InitStructure);
+#endif
+
+    if(!serialSetBaudRate(baud_rate))
+        serialSetBaudRate(BAUD_RATE);
 
     HAL_NVIC_SetPriority(UART0_IRQ, 0, 0);
     HAL_NVIC_EnableIRQ(UART0_IRQ);
 
+#if STREAM_STATS_ENABLE
+    stream_stats_register(&stats);
+#endif
+
     return &stream;
 }
 
 void UART0_IRQHandler (void)
 {
+#if SERIAL_RTS_ENABLE == 1
+    if((UART0->SR & USART_SR_RXNE) && (UART0->CR1 & USART_CR1_RXNEIE)) {
+#else
     if(UART0->SR & USART_SR_RXNE) {
+#endif
         uint32_t data = UART0->DR;
+#if STREAM_STATS_ENABLE
+        stats.rx_bytes++;
+#endif
         if(!enqueue_realtime_command((char)data)) {             // Check and strip realtime commands...
             uint16_t next_head = BUFNEXT(rxbuf.head, rxbuf);    // Get and increment buffer pointer
-            if(next_head == rxbuf.tail)                         // If buffer full
+            if(next_head == rxbuf.tail) {                       // If buffer full
                 rxbuf.overflow = 1;                             // flag overflow
-            else {
+#if STREAM_STATS_ENABLE
+                stats.rx_overflows++;
+#endif
+            } else {
                 rxbuf.data[rxbuf.head] = (char)data;            // if not add data to buffer
                 rxbuf.head = next_head;                         // and update pointer
+#if STREAM_STATS_ENABLE
+                stream_stats_rx_fill(&stats, BUFCOUNT(next_head, rxbuf.tail, RX_BUFFER_SIZE));
+#endif
+#if SERIAL_RTS_ENABLE
+                if(!rxbuf.rts_state && BUFCOUNT(next_head, rxbuf.tail, RX_BUFFER_SIZE) >= RX_BUFFER_HWM)
+                    serialRtsHold(true);                        // Throttle sender
+#endif
             }
         }
+#if STREAM_STATS_ENABLE
+        else
+            stats.rt_commands++;
+#endif
     }
 
     if((UART0->SR & USART_SR_TXE) && (UART0->CR1 & USART_CR1_TXEIE)) {
@@ -676,6 +1030,24 @@ void UART0_IRQHandler (void)
 
 #if SERIAL1_PORT
 
+#if SERIAL1_RTS_ENABLE
+
+//
+// Throttles or releases the sender. GPIO RTS is deasserted (high) directly, for hardware flow control
+// reception is halted so that the USART deasserts RTS when the data register becomes full.
+//
+static void serial1RtsHold (bool on)
+{
+    rxbuf1.rts_state = on;
+#if SERIAL1_RTS_ENABLE == 1
+    BITBAND_PERI(UART1->CR1, USART_CR1_RXNEIE_Pos) = !on;
+#else
+    DIGITAL_OUT(UART1_RTS_PORT, UART1_RTS_PIN, on);
+#endif
+}
+
+#endif
+
 //
 // Returns number of free characters in serial input buffer
 //
@@ -702,6 +1074,10 @@ static uint16_t serial1RxCount (void)
 static void serial1RxFlush (void)
 {
     rxbuf1.tail = rxbuf1.head;
+#if SERIAL1_RTS_ENABLE
+    if(rxbuf1.rts_state)
+        serial1RtsHold(false);
+#endif
 }
 
 //
@@ -712,6 +1088,10 @@ static void serial1RxCancel (void)
     rxbuf1.data[rxbuf1.head] = ASCII_CAN;
     rxbuf1.tail = rxbuf1.head;
     rxbuf1.head = BUFNEXT(rxbuf1.head, rxbuf1);
+#if SERIAL1_RTS_ENABLE
+    if(rxbuf1.rts_state)
+        serial1RtsHold(false);
+#endif
 }
 
 //
@@ -722,13 +1102,20 @@ static bool serial1PutC (const char c)
     uint32_t next_head = BUFNEXT(txbuf1.head, txbuf1);   // Set and update head pointer
 
     while(txbuf1.tail == next_head) {           // While TX buffer full
+#if STREAM_STATS_ENABLE
+        if(!stream_stats_blocking_callback(&stats1))
+#else
         if(!hal.stream_blocking_callback())     // check if blocking for space,
+#endif
             return false;                       // exit if not (leaves TX buffer in an inconsistent state)
         UART1->CR1 |= USART_CR1_TXEIE;          // Enable TX interrupts???
     }
 
     txbuf1.data[txbuf1.head] = c;               // Add data to buffer
     txbuf1.head = next_head;                    // and update head pointer
+#if STREAM_STATS_ENABLE
+    stream_stats_tx(&stats1, 1, BUFCOUNT(next_head, txbuf1.tail, TX_BUFFER_SIZE));
+#endif
 
     UART1->CR1 |= USART_CR1_TXEIE;              // Enable TX interrupts
 
@@ -788,6 +1175,11 @@ static int16_t serial1GetC (void)
     char data = rxbuf1.data[tail];          // Get next character
     rxbuf1.tail = BUFNEXT(tail, rxbuf1);    // and update pointer
 
+#if SERIAL1_RTS_ENABLE
+    if(rxbuf1.rts_state && BUFCOUNT(rxbuf1.head, rxbuf1.tail, RX_BUFFER_SIZE) < RX_BUFFER_LWM)
+        serial1RtsHold(false);                                 // Release sender
+#endif
+
     return (int16_t)data;
 }
 
@@ -798,9 +1190,22 @@ static bool serial1SuspendInput (bool suspend)
 
 static bool serial1SetBaudRate (uint32_t baud_rate)
 {
+    uint32_t cr1 = UART1->CR1, brr = UART1->BRR;
+
     UART1->CR1 = USART_CR1_RE|USART_CR1_TE;
-    UART1->BRR = UART_BRR_SAMPLING16(UART1_CLK, baud_rate);
+
+    if(serialSetBRR(UART1, UART1_CLK, &baud1, baud_rate) == 0) {
+        UART1->BRR = brr;     // Keep the current settings
+        UART1->CR1 = cr1;
+        return false;
+    }
+
+#if SERIAL1_RTS_ENABLE == 1
+    UART1->CR3 = USART_CR3_RTSE|USART_CR3_CTSE;
+    UART1->CR1 |= rxbuf1.rts_state ? USART_CR1_UE : (USART_CR1_UE|USART_CR1_RXNEIE);
+#else
     UART1->CR1 |= (USART_CR1_UE|USART_CR1_RXNEIE);
+#endif
 
     return true;
 }
@@ -809,7 +1214,11 @@ static bool serial1Disable (bool disable)
 {
     if(disable)
         UART1->CR1 &= ~USART_CR1_RXNEIE;
+#if SERIAL1_RTS_ENABLE == 1
+    else if(!rxbuf1.rts_state)
+#else
     else
+#endif
         UART1->CR1 |= USART_CR1_RXNEIE;
 
     return true;
@@ -867,28 +1276,64 @@ static const io_stream_t *serial1Init (uint32_t baud_rate)
     };
     HAL_GPIO_Init(UART1_PORT, &GPIO_InitStructure);
 
-    serial1SetBaudRate(baud_rate);
+#if SERIAL1_RTS_ENABLE == 1
+    GPIO_InitStructure.Pin = (1 << UART1_CTS_PIN)|(1 << UART1_RTS_PIN);
+    HAL_GPIO_Init(UART1_FC_PORT, &GPIO_InitStructure);
+#elif SERIAL1_RTS_ENABLE == 2
+    DIGITAL_OUT(UART1_RTS_PORT, UART1_RTS_PIN, 0);
+    GPIO_InitStructure.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStructure.Pin = 1 << UART1_RTS_PIN;
+    HAL_GPIO_Init(UART1_RTS_PORT, &GPIO_InitStructure);
+#endif
+
+    if(!serial1SetBaudRate(baud_rate))
+        serial1SetBaudRate(BAUD_RATE);
 
     HAL_NVIC_SetPriority(UART1_IRQ, 0, 0);
     HAL_NVIC_EnableIRQ(UART1_IRQ);
 
+#if STREAM_STATS_ENABLE
+    stream_stats_register(&stats1);
+#endif
+
 
     return &stream;
 }
 
 void UART1_IRQHandler (void)
 {
+#if SERIAL1_RTS_ENABLE == 1
+    if((UART1->SR & USART_SR_RXNE) && (UART1->CR1 & USART_CR1_RXNEIE)) {
+#else
     if(UART1->SR & USART_SR_RXNE) {
+#endif
         uint32_t data = UART1->DR;
+#if STREAM_STATS_ENABLE
+        stats1.rx_bytes++;
+#endif
         if(!enqueue_realtime_command1((char)data)) {            // Check and strip realtime commands...
             uint16_t next_head = BUFNEXT(rxbuf1.head, rxbuf1);  // Get and increment buffer pointer
-            if(next_head == rxbuf1.tail)                        // If buffer full
+            if(next_head == rxbuf1.tail) {                      // If buffer full
                 rxbuf1.overflow = 1;                            // flag overflow
-            else {
+#if STREAM_STATS_ENABLE
+                stats1.rx_overflows++;
+#endif
+            } else {
                 rxbuf1.data[rxbuf1.head] = (char)data;          // if not add data to buffer
                 rxbuf1.head = next_head;                        // and update pointer
+#if STREAM_STATS_ENABLE
+                stream_stats_rx_fill(&stats1, BUFCOUNT(next_head, rxbuf1.tail, RX_BUFFER_SIZE));
+#endif
+#if SERIAL1_RTS_ENABLE
+                if(!rxbuf1.rts_state && BUFCOUNT(next_head, rxbuf1.tail, RX_BUFFER_SIZE) >= RX_BUFFER_HWM)
+                    serial1RtsHold(true);                       // Throttle sender
+#endif
             }
         }
+#if STREAM_STATS_ENABLE
+        else
+            stats1.rt_commands++;
+#endif
     }
 
     if((UART1->SR & USART_SR_TXE) && (UART1->CR1 & USART_CR1_TXEIE)) {
@@ -904,6 +1349,24 @@ void UART1_IRQHandler (void)
 
 #if SERIAL2_PORT
 
+#if SERIAL2_RTS_ENABLE
+
+//
+// Throttles or releases the sender. GPIO RTS is deasserted (high) directly, for hardware flow control
+// reception is halted so that the USART deasserts RTS when the data register becomes full.
+//
+static void serial2RtsHold (bool on)
+{
+    rxbuf2.rts_state = on;
+#if SERIAL2_RTS_ENABLE == 1
+    BITBAND_PERI(UART2->CR1, USART_CR1_RXNEIE_Pos) = !on;
+#else
+    DIGITAL_OUT(UART2_RTS_PORT, UART2_RTS_PIN, on);
+#endif
+}
+
+#endif
+
 //
 // Returns number of free characters in serial input buffer
 //
@@ -930,6 +1393,10 @@ static uint16_t serial2RxCount (void)
 static void serial2RxFlush (void)
 {
     rxbuf2.tail = rxbuf2.head;
+#if SERIAL2_RTS_ENABLE
+    if(rxbuf2.rts_state)
+        serial2RtsHold(false);
+#endif
 }
 
 //
@@ -940,6 +1407,10 @@ static void serial2RxCancel (void)
     rxbuf2.data[rxbuf2.head] = ASCII_CAN;
     rxbuf2.tail = rxbuf2.head;
     rxbuf2.head = BUFNEXT(rxbuf2.head, rxbuf2);
+#if SERIAL2_RTS_ENABLE
+    if(rxbuf2.rts_state)
+        serial2RtsHold(false);
+#endif
 }
 
 //
@@ -950,13 +1421,20 @@ static bool serial2PutC (const char c)
     uint32_t next_head = BUFNEXT(txbuf2.head, txbuf2);   // Set and update head pointer
 
     while(txbuf2.tail == next_head) {           // While TX buffer full
+#if STREAM_STATS_ENABLE
+        if(!stream_stats_blocking_callback(&stats2))
+#else
         if(!hal.stream_blocking_callback())     // check if blocking for space,
+#endif
             return false;                       // exit if not (leaves TX buffer in an inconsistent state)
         UART2->CR1 |= USART_CR1_TXEIE;          // Enable TX interrupts???
     }
 
     txbuf2.data[txbuf2.head] = c;               // Add data to buffer
     txbuf2.head = next_head;                    // and update head pointer
+#if STREAM_STATS_ENABLE
+    stream_stats_tx(&stats2, 1, BUFCOUNT(next_head, txbuf2.tail, TX_BUFFER_SIZE));
+#endif
 
     UART2->CR1 |= USART_CR1_TXEIE;              // Enable TX interrupts
 
@@ -1016,6 +1494,11 @@ static int16_t serial2GetC (void)
     char data = rxbuf2.data[tail];          // Get next character
     rxbuf2.tail = BUFNEXT(tail, rxbuf2);    // and update pointer
 
+#if SERIAL2_RTS_ENABLE
+    if(rxbuf2.rts_state && BUFCOUNT(rxbuf2.head, rxbuf2.tail, RX_BUFFER_SIZE) < RX_BUFFER_LWM)
+        serial2RtsHold(false);                                 // Release sender
+#endif
+
     return (int16_t)data;
 }
 
@@ -1026,9 +1509,22 @@ static bool serial2SuspendInput (bool suspend)
 
 static bool serial2SetBaudRate (uint32_t baud_rate)
 {
+    uint32_t cr1 = UART2->CR1, brr = UART2->BRR;
+
     UART2->CR1 = USART_CR1_RE|USART_CR1_TE;
-    UART2->BRR = UART_BRR_SAMPLING16(UART2_CLK, baud_rate);
+
+    if(serialSetBRR(UART2, UART2_CLK, &baud2, baud_rate) == 0) {
+        UART2->BRR = brr;     // Keep the current settings
+        UART2->CR1 = cr1;
+        return false;
+    }
+
+#if SERIAL2_RTS_ENABLE == 1
+    UART2->CR3 = USART_CR3_RTSE|USART_CR3_CTSE;
+    UART2->CR1 |= rxbuf2.rts_state ? USART_CR1_UE : (USART_CR1_UE|USART_CR1_RXNEIE);
+#else
     UART2->CR1 |= (USART_CR1_UE|USART_CR1_RXNEIE);
+#endif
 
     return true;
 }
@@ -1037,7 +1533,11 @@ static bool serial2Disable (bool disable)
 {
     if(disable)
         UART2->CR1 &= ~USART_CR1_RXNEIE;
+#if SERIAL2_RTS_ENABLE == 1
+    else if(!rxbuf2.rts_state)
+#else
     else
+#endif
         UART2->CR1 |= USART_CR1_RXNEIE;
 
     return true;
@@ -1095,27 +1595,63 @@ static const io_stream_t *serial2Init (uint32_t baud_rate)
     };
     HAL_GPIO_Init(UART2_PORT, &GPIO_InitStructure);
 
-    serial2SetBaudRate(baud_rate);
+#if SERIAL2_RTS_ENABLE == 1
+    GPIO_InitStructure.Pin = (1 << UART2_CTS_PIN)|(1 << UART2_RTS_PIN);
+    HAL_GPIO_Init(UART2_FC_PORT, &GPIO_InitStructure);
+#elif SERIAL2_RTS_ENABLE == 2
+    DIGITAL_OUT(UART2_RTS_PORT, UART2_RTS_PIN, 0);
+    GPIO_InitStructure.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStructure.Pin = 1 << UART2_RTS_PIN;
+    HAL_GPIO_Init(UART2_RTS_PORT, &GPIO_InitStructure);
+#endif
+
+    if(!serial2SetBaudRate(baud_rate))
+        serial2SetBaudRate(BAUD_RATE);
 
     HAL_NVIC_SetPriority(UART2_IRQ, 0, 0);
     HAL_NVIC_EnableIRQ(UART2_IRQ);
 
+#if STREAM_STATS_ENABLE
+    stream_stats_register(&stats2);
+#endif
+
     return &stream;
 }
 
 void UART2_IRQHandler (void)
 {
+#if SERIAL2_RTS_ENABLE == 1
+    if((UART2->SR & USART_SR_RXNE) && (UART2->CR1 & USART_CR1_RXNEIE)) {
+#else
     if(UART2->SR & USART_SR_RXNE) {
+#endif
         uint32_t data = UART2->DR;
+#if STREAM_STATS_ENABLE
+        stats2.rx_bytes++;
+#endif
         if(!enqueue_realtime_command2((char)data)) {            // Check and strip realtime commands...
             uint16_t next_head = BUFNEXT(rxbuf2.head, rxbuf2);  // Get and increment buffer pointer
-            if(next_head == rxbuf2.tail)                        // If buffer full
+            if(next_head == rxbuf2.tail) {                      // If buffer full
                 rxbuf2.overflow = 1;                            // flag overflow
-            else {
+#if STREAM_STATS_ENABLE
+                stats2.rx_overflows++;
+#endif
+            } else {
                 rxbuf2.data[rxbuf2.head] = (char)data;          // if not add data to buffer
                 rxbuf2.head = next_head;                        // and update pointer
+#if STREAM_STATS_ENABLE
+                stream_stats_rx_fill(&stats2, BUFCOUNT(next_head, rxbuf2.tail, RX_BUFFER_SIZE));
+#endif
+#if SERIAL2_RTS_ENABLE
+                if(!rxbuf2.rts_state && BUFCOUNT(next_head, rxbuf2.tail, RX_BUFFER_SIZE) >= RX_BUFFER_HWM)
+                    serial2RtsHold(true);                       // Throttle sender
+#endif
             }
         }
+#if STREAM_STATS_ENABLE
+        else
+            stats2.rt_commands++;
+#endif
     }
 
     if((UART2->SR & USART_SR_TXE) && (UART2->CR1 & USART_CR1_TXEIE)) {
@@ -19,11 +19,23 @@
   along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
 */
 
+/*
+  Transactions may be queued by spi_submit() and are then executed by DMA, each with the clock, mode and
+  chip select of its device, the next queued transaction is started from the DMA completion interrupt.
+  The queue is ordered by device priority. Blocking users (SD card, WIZnet) claim the bus with spi_claim()
+  for the duration of a chip select frame, this waits for at most one active DMA transaction and holds
+  off queued transactions until spi_release() is called.
+*/
+
+#include <string.h>
+
 #include "main.h"
 #include "driver.h"
 
 #if SPI_ENABLE
 
+#include "spi.h"
+
 #define SPIport(p) SPIportI(p)
 #define SPIportI(p) SPI ## p
 
@@ -383,14 +395,16 @@ void spi_init (void)
     }
 }
 
-uint32_t spi_set_speed (uint32_t prescaler)
+// Returns the SPI clock in Hz for the given prescaler
+uint32_t spi_get_clock (uint32_t prescaler)
 {
-    uint32_t cur = spi_port.Instance->CR1 & SPI_BAUDRATEPRESCALER_256;
-
-    spi_port.Instance->CR1 &= ~SPI_BAUDRATEPRESCALER_256;
-    spi_port.Instance->CR1 |= prescaler;
+#if SPI_PORT == 1 || SPI_PORT == 11 || SPI_PORT == 12
+    uint32_t pclk = HAL_RCC_GetPCLK2Freq();
+#else
+    uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+#endif
 
-    return cur;
+    return pclk >> (((prescaler & SPI_BAUDRATEPRESCALER_256) >> SPI_CR1_BR_Pos) + 1);
 }
 
 uint8_t spi_get_byte (void)
@@ -431,6 +445,207 @@ void spi_read (uint8_t *data, uint16_t len)
     __HAL_DMA_DISABLE(&spi_dma_tx);
 }
 
+/*
+ * Bus manager
+ */
+
+#define SPI_CR1_CONFIG (SPI_BAUDRATEPRESCALER_256|SPI_CR1_CPOL|SPI_CR1_CPHA)
+
+static struct {
+    volatile bool claimed;
+    bool restore;                   // restore claim_cr1 on release
+    uint32_t claim_cr1;             // configuration saved by spi_claim_device()
+    spi_transaction_t *volatile active;
+    spi_transaction_t *queue;
+    uint32_t cr1;                   // configuration of blocking users, restored after each transaction
+} bus = {0};
+
+static inline void set_config (uint32_t cr1)
+{
+    if((spi_port.Instance->CR1 & SPI_CR1_CONFIG) != cr1) {
+        __HAL_SPI_DISABLE(&spi_port);
+        spi_port.Instance->CR1 = (spi_port.Instance->CR1 & ~SPI_CR1_CONFIG) | cr1;
+        __HAL_SPI_ENABLE(&spi_port);
+    }
+}
+
+// Starts the next queued transaction if the bus is free, called with interrupts disabled or from the DMA interrupt.
+static void start_next (void)
+{
+    spi_transaction_t *t;
+    HAL_StatusTypeDef status;
+
+    while(!bus.claimed && bus.active == NULL && (t = bus.queue)) {
+
+        bus.queue = t->next;
+        bus.active = t;
+        bus.cr1 = spi_port.Instance->CR1 & SPI_CR1_CONFIG;
+        t->state = SPIXfer_Active;
+
+        set_config(t->device->prescaler | t->device->mode);
+
+        if(t->device->cs_port)
+            DIGITAL_OUT(t->device->cs_port, t->device->cs_pin, 0);
+
+        if(t->rx) {
+            if(t->tx)
+                status = HAL_SPI_TransmitReceive_DMA(&spi_port, (uint8_t *)t->tx, t->rx, t->len);
+            else {
+                memset(t->rx, 0xFF, t->len); // Transmitted as dummy data
+                status = HAL_SPI_Receive_DMA(&spi_port, t->rx, t->len);
+            }
+        } else
+            status = HAL_SPI_Transmit_DMA(&spi_port, (uint8_t *)t->tx, t->len);
+
+        if(status != HAL_OK) {
+            if(t->device->cs_port)
+                DIGITAL_OUT(t->device->cs_port, t->device->cs_pin, 1);
+            set_config(bus.cr1);
+            bus.active = NULL;
+            t->state = SPIXfer_Failed;
+            if(t->on_complete)
+                t->on_complete(t);
+        }
+    }
+}
+
+static void transfer_complete (bool ok)
+{
+    spi_transaction_t *t = bus.active;
+
+    if(t == NULL) // Blocking transfer by spi_read() or spi_write()
+        return;
+
+    __HAL_DMA_DISABLE(&spi_dma_rx);
+    __HAL_DMA_DISABLE(&spi_dma_tx);
+    __HAL_SPI_CLEAR_OVRFLAG(&spi_port);
+
+    if(t->device->cs_port)
+        DIGITAL_OUT(t->device->cs_port, t->device->cs_pin, 1);
+
+    set_config(bus.cr1);
+
+    bus.active = NULL;
+    t->state = ok ? SPIXfer_Done : SPIXfer_Failed;
+
+    if(t->on_complete)
+        t->on_complete(t);
+
+    start_next();
+}
+
+void HAL_SPI_TxRxCpltCallback (SPI_HandleTypeDef *hspi)
+{
+    if(hspi == &spi_port)
+        transfer_complete(true);
+}
+
+void HAL_SPI_TxCpltCallback (SPI_HandleTypeDef *hspi)
+{
+    if(hspi == &spi_port)
+        transfer_complete(true);
+}
+
+// HAL_SPI_Receive_DMA() completes here in master mode.
+void HAL_SPI_RxCpltCallback (SPI_HandleTypeDef *hspi)
+{
+    if(hspi == &spi_port)
+        transfer_complete(true);
+}
+
+void HAL_SPI_ErrorCallback (SPI_HandleTypeDef *hspi)
+{
+    if(hspi == &spi_port)
+        transfer_complete(false);
+}
+
+// Queues a transaction, it is inserted after already queued transactions of the same or higher priority.
+// on_complete is called from the DMA interrupt.
+bool spi_submit (spi_transaction_t *transaction)
+{
+    spi_transaction_t **link;
+    uint32_t primask;
+
+    if(transaction->len == 0 || (transaction->tx == NULL && transaction->rx == NULL) ||
+        transaction->state == SPIXfer_Queued || transaction->state == SPIXfer_Active)
+        return false;
+
+    transaction->next = NULL;
+    transaction->state = SPIXfer_Queued;
+
+    // May be called from a completion callback, i.e. with interrupts already disabled.
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    link = &bus.queue;
+    while(*link && (*link)->device->priority <= transaction->device->priority)
+        link = &(*link)->next;
+
+    transaction->next = *link;
+    *link = transaction;
+
+    start_next();
+
+    __set_PRIMASK(primask);
+
+    return true;
+}
+
+// Sets the clock of blocking users, if a queued transaction is active the change
+// is applied when it completes as it restores the configuration on completion.
+uint32_t spi_set_speed (uint32_t prescaler)
+{
+    uint32_t cur, primask = __get_PRIMASK();
+
+    __disable_irq();
+
+    if(bus.active) {
+        cur = bus.cr1 & SPI_BAUDRATEPRESCALER_256;
+        bus.cr1 = (bus.cr1 & ~SPI_BAUDRATEPRESCALER_256) | prescaler;
+    } else {
+        cur = spi_port.Instance->CR1 & SPI_BAUDRATEPRESCALER_256;
+        set_config((spi_port.Instance->CR1 & SPI_CR1_CONFIG & ~SPI_BAUDRATEPRESCALER_256) | prescaler);
+    }
+
+    __set_PRIMASK(primask);
+
+    return cur;
+}
+
+// Holds off queued transactions and waits for the active transaction, if any, to complete.
+void spi_claim (void)
+{
+    bus.claimed = true;
+
+    while(bus.active);
+}
+
+// Claims the bus and applies the clock and mode of the device, the previous configuration is restored on release.
+void spi_claim_device (const spi_device_t *device)
+{
+    spi_claim();
+
+    bus.claim_cr1 = spi_port.Instance->CR1 & SPI_CR1_CONFIG;
+    bus.restore = true;
+    set_config(device->prescaler | device->mode);
+}
+
+// Releases the bus and starts queued transactions.
+void spi_release (void)
+{
+    if(bus.restore) {
+        bus.restore = false;
+        set_config(bus.claim_cr1);
+    }
+
+    __disable_irq();
+
+    bus.claimed = false;
+    start_next();
+
+    __enable_irq();
+}
+
 void DMA_RX_IRQ_HANDLER (void)
 {
   HAL_DMA_IRQHandler(&spi_dma_rx);
@@ -0,0 +1,130 @@
+/*
+
+  stream_stats.c - per stream throughput and health counters
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "driver.h"
+
+#if STREAM_STATS_ENABLE
+
+#include "stream_stats.h"
+
+#include "grbl/hal.h"
+#include "grbl/protocol.h"
+#include "grbl/nuts_bolts.h"
+
+static stream_stats_t *streams = NULL;
+
+static void report_counter (const char *label, uint32_t value)
+{
+    hal.stream.write(label);
+    hal.stream.write(uitoa(value));
+}
+
+static void stats_reset (stream_stats_t *stats)
+{
+    hal.irq_disable();
+
+    stats->rx_bytes = stats->tx_bytes = stats->rt_commands = stats->rx_overflows = stats->blocked_us = 0;
+    stats->rx_peak = stats->tx_peak = 0;
+
+    hal.irq_enable();
+}
+
+// $STREAMS - outputs the counters for all registered streams.
+// $STREAMS=R - resets the counters.
+static status_code_t report_streams (sys_state_t state, char *args)
+{
+    stream_stats_t *stats = streams;
+
+    if(args) {
+
+        if(!(*args == 'R' && *(args + 1) == '\0'))
+            return Status_InvalidStatement;
+
+        while(stats) {
+            stats_reset(stats);
+            stats = stats->next;
+        }
+
+    } else while(stats) {
+        hal.stream.write("[STREAM:");
+        hal.stream.write(stats->name);
+        report_counter("|RX:", stats->rx_bytes);
+        report_counter("|TX:", stats->tx_bytes);
+        report_counter("|RT:", stats->rt_commands);
+        report_counter("|OVF:", stats->rx_overflows);
+        report_counter("|RXP:", stats->rx_peak);
+        report_counter("|TXP:", stats->tx_peak);
+        report_counter("|BLK:", stats->blocked_us / 1000);
+        hal.stream.write("]" ASCII_EOL);
+        stats = stats->next;
+    }
+
+    return Status_OK;
+}
+
+// Wraps hal.stream_blocking_callback() and accumulates the time spent in it.
+bool stream_stats_blocking_callback (stream_stats_t *stats)
+{
+    uint32_t t = hal.get_micros();
+    bool ok = hal.stream_blocking_callback();
+
+    stats->blocked_us += hal.get_micros() - t;
+
+    return ok;
+}
+
+// Adds a stream to the $STREAMS report, the stats structure must be statically allocated.
+// Streams provided by plugins, e.g. networking, may register their own instances.
+void stream_stats_register (stream_stats_t *stats)
+{
+    static bool cmd_ok = false;
+
+    if(!cmd_ok) {
+
+        static const sys_command_t stats_command_list[] = {
+            {"STREAMS", report_streams, {0}, { .str = "output stream counters, $STREAMS=R resets them" } }
+        };
+
+        static sys_commands_t stats_commands = {
+            .n_commands = sizeof(stats_command_list) / sizeof(sys_command_t),
+            .commands = stats_command_list
+        };
+
+        system_register_commands(&stats_commands);
+
+        cmd_ok = true;
+    }
+
+    stream_stats_t *entry = streams;
+
+    while(entry) {
+        if(entry == stats)
+            return;
+        entry = entry->next;
+    }
+
+    stats->next = streams;
+    streams = stats;
+}
+
+#endif // STREAM_STATS_ENABLE
@@ -0,0 +1,297 @@
+/*
+
+  tmc_monitor.c - background health monitor for Trinamic SPI drivers
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  DRV_STATUS is read from all drivers configured by the Trinamic plugin every TRINAMIC_MONITOR ms
+  by a batched DMA read, the result is processed by the next poll. Newly raised fault flags are
+  reported as warnings, open load flags only while the motor is running as they are not reliable at standstill.
+  StallGuard load values are kept in a short history per motor while the motor is running.
+  The CPU time of each poll, including the DMA completion interrupts, is measured and the poll interval
+  is increased if needed to keep the load within TRINAMIC_MONITOR_BUDGET percent.
+  $TMON lists the driver status, $TMON=1 adds the StallGuard load of each driver to the real-time report as |SG:<load>,...
+*/
+
+#include "driver.h"
+
+#if TRINAMIC_MONITOR && TRINAMIC_SPI_DMA
+
+#include <string.h>
+
+#include "tmc_spi.h"
+#include "tmc_monitor.h"
+
+#include "grbl/hal.h"
+#include "grbl/task.h"
+#include "grbl/report.h"
+#include "grbl/nuts_bolts.h"
+
+#define REG_DRV_STATUS  0x6F
+
+#define DRV_SG_RESULT   0x3FFUL
+#define DRV_S2VSA       (1UL << 12) // TMC5160 only
+#define DRV_S2VSB       (1UL << 13) // TMC5160 only
+#define DRV_OT          (1UL << 25)
+#define DRV_OTPW        (1UL << 26)
+#define DRV_S2GA        (1UL << 27)
+#define DRV_S2GB        (1UL << 28)
+#define DRV_OLA         (1UL << 29)
+#define DRV_OLB         (1UL << 30)
+#define DRV_STST        (1UL << 31)
+#define DRV_FAULTS      (DRV_S2VSA|DRV_S2VSB|DRV_OT|DRV_OTPW|DRV_S2GA|DRV_S2GB|DRV_OLA|DRV_OLB)
+
+static const struct {
+    uint32_t flags;
+    const char *text;
+} fault[] = {
+    { DRV_OT, "overtemperature shutdown" },
+    { DRV_OTPW, "overtemperature prewarning" },
+    { DRV_S2GA|DRV_S2GB, "short to ground" },
+    { DRV_S2VSA|DRV_S2VSB, "short to supply" },
+    { DRV_OLA|DRV_OLB, "open load" }
+};
+
+static bool report_sg = false;
+static volatile bool result_ready = false;
+static uint8_t monitored = 0;
+static uint32_t active[TMC_N_MOTORS_MAX]; // fault flags present in the last poll
+static tmc_monitor_motor_t motor[TMC_N_MOTORS_MAX];
+static tmc_monitor_stats_t stats;
+static tmc_spi_batch_t batch = { .reg = REG_DRV_STATUS };
+static on_realtime_report_ptr on_realtime_report;
+
+// Called from the DMA interrupt.
+static void batch_complete (tmc_spi_batch_t *batch)
+{
+    result_ready = true;
+}
+
+static void report_faults (uint_fast8_t id, uint32_t flags)
+{
+    static char msg[50];
+
+    uint_fast8_t idx;
+
+    for(idx = 0; idx < sizeof(fault) / sizeof(fault[0]); idx++) {
+        if(flags & fault[idx].flags) {
+            strcpy(msg, "Motor driver ");
+            strcat(msg, uitoa(id));
+            strcat(msg, ": ");
+            strcat(msg, fault[idx].text);
+            report_warning(msg);
+        }
+    }
+}
+
+static void add_sample (tmc_monitor_motor_t *m, uint16_t sg)
+{
+    uint_fast8_t idx;
+    uint32_t sum = 0;
+
+    m->sg_result = sg;
+    m->history[m->head] = sg;
+    m->head = (m->head + 1) % TRINAMIC_MONITOR_HISTORY;
+    if(m->count < TRINAMIC_MONITOR_HISTORY)
+        m->count++;
+
+    m->sg_min = m->sg_max = sg;
+    for(idx = 0; idx < m->count; idx++) {
+        sum += m->history[idx];
+        m->sg_min = min(m->sg_min, m->history[idx]);
+        m->sg_max = max(m->sg_max, m->history[idx]);
+    }
+    m->sg_avg = sum / m->count;
+}
+
+static void process_results (void)
+{
+    uint_fast8_t id;
+    uint32_t status, raised;
+
+    if(!batch.ok) {
+        stats.failed++;
+        return;
+    }
+
+    monitored = batch.motors;
+
+    for(id = 0; id < TMC_N_MOTORS_MAX; id++) {
+
+        if(!(batch.motors & (1 << id)))
+            continue;
+
+        motor[id].drv_status = status = batch.value[id];
+
+        if(status & DRV_STST)
+            status &= ~(DRV_OLA|DRV_OLB);
+        else
+            add_sample(&motor[id], (uint16_t)(status & DRV_SG_RESULT));
+
+        raised = (status & DRV_FAULTS) & ~active[id];
+        active[id] = status & DRV_FAULTS;
+        motor[id].faults |= active[id];
+
+        if(raised)
+            report_faults(id, raised);
+    }
+}
+
+static void monitor_poll (void *data)
+{
+    uint32_t cycles = DWT->CYCCNT, isr_cycles = 0;
+
+    if(result_ready) {
+        result_ready = false;
+        isr_cycles = batch.cycles;
+        process_results();
+    }
+
+    if(!batch.busy && (batch.motors = tmc_spi_get_motors())) {
+        stats.polls++;
+        if(!tmc_spi_read_batch(&batch))
+            stats.failed++;
+    }
+
+    stats.cost_us = (DWT->CYCCNT - cycles + isr_cycles) / hal.f_mcu;
+    if(stats.cost_us > stats.cost_us_max)
+        stats.cost_us_max = stats.cost_us;
+
+    // cost_us / (interval * 1000) must not exceed TRINAMIC_MONITOR_BUDGET / 100.
+    stats.interval = max(stats.cost_us / (TRINAMIC_MONITOR_BUDGET * 10) + 1, TRINAMIC_MONITOR);
+
+    task_add_delayed(monitor_poll, NULL, stats.interval);
+}
+
+static void monitor_report (stream_write_ptr stream_write, report_tracking_flags_t report)
+{
+    if(report_sg && monitored) {
+
+        uint_fast8_t id;
+        const char *sep = "|SG:";
+
+        for(id = 0; id < TMC_N_MOTORS_MAX; id++) {
+            if(monitored & (1 << id)) {
+                stream_write(sep);
+                stream_write(uitoa(motor[id].sg_result));
+                sep = ",";
+            }
+        }
+    }
+
+    if(on_realtime_report)
+        on_realtime_report(stream_write, report);
+}
+
+// $TMON - lists driver status and the fault flags seen since the last listing.
+// $TMON=<0|1> - disables/enables StallGuard load values in the real-time report.
+static status_code_t monitor_command (sys_state_t state, char *args)
+{
+    uint_fast8_t id, idx;
+    const char *sep;
+
+    if(args) {
+        if(!((*args == '0' || *args == '1') && args[1] == '\0'))
+            return Status_InvalidStatement;
+        report_sg = *args == '1';
+        return Status_OK;
+    }
+
+    for(id = 0; id < TMC_N_MOTORS_MAX; id++) {
+
+        if(!(monitored & (1 << id)))
+            continue;
+
+        hal.stream.write("[TMON:");
+        hal.stream.write(uitoa(id));
+        hal.stream.write("|SG:");
+        hal.stream.write(uitoa(motor[id].sg_result));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(motor[id].sg_min));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(motor[id].sg_max));
+        hal.stream.write(",");
+        hal.stream.write(uitoa(motor[id].sg_avg));
+        hal.stream.write("|CS:");
+        hal.stream.write(uitoa((motor[id].drv_status >> 16) & 0x1F));
+        hal.stream.write(motor[id].drv_status & DRV_STST ? "|standstill" : "|running");
+
+        sep = "|";
+        for(idx = 0; idx < sizeof(fault) / sizeof(fault[0]); idx++) {
+            if(motor[id].faults & fault[idx].flags) {
+                hal.stream.write(sep);
+                hal.stream.write(fault[idx].text);
+                sep = ",";
+            }
+        }
+        hal.stream.write("]" ASCII_EOL);
+
+        motor[id].faults = active[id];
+    }
+
+    hal.stream.write("[TMON:polls ");
+    hal.stream.write(uitoa(stats.polls));
+    hal.stream.write("|failed ");
+    hal.stream.write(uitoa(stats.failed));
+    hal.stream.write("|interval ");
+    hal.stream.write(uitoa(stats.interval));
+    hal.stream.write(" ms|cost ");
+    hal.stream.write(uitoa(stats.cost_us));
+    hal.stream.write(" us|max ");
+    hal.stream.write(uitoa(stats.cost_us_max));
+    hal.stream.write(" us]" ASCII_EOL);
+
+    return Status_OK;
+}
+
+const tmc_monitor_motor_t *tmc_monitor_get (uint_fast8_t id)
+{
+    return id < TMC_N_MOTORS_MAX && (monitored & (1 << id)) ? &motor[id] : NULL;
+}
+
+const tmc_monitor_stats_t *tmc_monitor_get_stats (void)
+{
+    return &stats;
+}
+
+void tmc_monitor_init (void)
+{
+    static const sys_command_t monitor_command_list[] = {
+        {"TMON", monitor_command, {0}, { .str = "list Trinamic driver status, $TMON=1 adds StallGuard load to the real-time report" } }
+    };
+
+    static sys_commands_t monitor_commands = {
+        .n_commands = sizeof(monitor_command_list) / sizeof(sys_command_t),
+        .commands = monitor_command_list
+    };
+
+    batch.on_complete = batch_complete;
+    stats.interval = TRINAMIC_MONITOR;
+
+    on_realtime_report = grbl.on_realtime_report;
+    grbl.on_realtime_report = monitor_report;
+
+    system_register_commands(&monitor_commands);
+
+    task_add_delayed(monitor_poll, NULL, TRINAMIC_MONITOR);
+}
+
+#endif // TRINAMIC_MONITOR && TRINAMIC_SPI_DMA
@@ -19,12 +19,32 @@
   along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
 */
 
+/*
+  With TRINAMIC_SPI_CHAIN set the drivers are daisy-chained on a single chip select, each transfer
+  then exchanges one datagram with every driver in the chain. Drivers not addressed are sent a read
+  of their previous register so their read pipeline is kept.
+
+  With TRINAMIC_SPI_DMA set tmc_spi_read_batch() reads a register from several drivers in one
+  DMA driven sequence of chip select frames, sequenced from the DMA completion interrupt.
+  A driver returns the data of the previous read request so the request frame is skipped for drivers
+  already holding a request for the same register, repeated polling of a register then takes a single
+  frame per driver (or a single frame for the whole chain). If the drivers share the SPI port with the
+  SD card or a WIZnet module the frames are queued with the bus manager in spi.c, else the port has
+  its own DMA streams.
+*/
+
 #include "driver.h"
 
 #if TRINAMIC_SPI_ENABLE && defined(TRINAMIC_SPI_PORT) // && (defined(BOARD_FYSETC_S6) || defined(BOARD_BTT_SKR_PRO_1_1) || defined(BOARD_BTT_SKR_PRO_1_2) || defined(BOARD_MKS_ROBIN_NANO_30) || defined(BOARD_MORPHO_CNC))
 
+#include <string.h>
+
 #include "trinamic/common.h"
 
+#if TRINAMIC_SPI_DMA
+#include "tmc_spi.h"
+#endif
+
 #define SPIport(p) SPIportI(p)
 #define SPIportI(p) SPI ## p
 
@@ -34,6 +54,15 @@
 #define TMC_SPI_PORT SPIport(TRINAMIC_SPI_PORT)
 #endif
 
+#if SPI_ENABLE && (SPI_PORT == TRINAMIC_SPI_PORT || SPI_PORT == 11)
+#define TMC_SPI_SHARED 1 // Port is shared with spi.c, arbitrated by its bus manager
+#include "spi.h"
+#else
+#define TMC_SPI_SHARED 0
+#endif
+
+#define DATAGRAM_SIZE 5
+
 static SPI_HandleTypeDef spi_port = {
     .Instance = TMC_SPI_PORT,
     .Init.Mode = SPI_MODE_MASTER,
@@ -52,16 +81,115 @@ static SPI_HandleTypeDef spi_port = {
 static struct {
     GPIO_TypeDef *port;
     uint16_t pin;
-} cs[TMC_N_MOTORS_MAX];
+} cs[TMC_N_MOTORS_MAX]; // cs[0] is the chip select of the chain if TRINAMIC_SPI_CHAIN is set
 
-// XXXXX replace with something better...
-inline static void delay (void)
-{
-    volatile uint32_t dly = 10;
+static uint_fast8_t n_motors;
+static uint8_t pipeline[TMC_N_MOTORS_MAX]; // Address byte last sent to each driver (by id, by chain position if chained)
 
-    while(--dly)
-        __ASM volatile ("nop");
-}
+#if TRINAMIC_SPI_CHAIN
+static TMC_spi_datagram_t datagram[TMC_N_MOTORS_MAX];
+#endif
+
+#if TRINAMIC_SPI_DMA
+
+typedef struct {
+    uint8_t motor;          // chip select index
+    uint8_t offset;         // datagram offset in the transfer buffers
+    uint8_t len;
+    bool result;            // frame returns the register data
+} frame_t;
+
+static struct {
+    tmc_spi_batch_t *volatile batch;
+    uint_fast8_t frame;
+    uint_fast8_t frames;
+    frame_t frame_list[TMC_N_MOTORS_MAX * 2];
+    uint8_t tx[TMC_N_MOTORS_MAX * DATAGRAM_SIZE];
+    uint8_t rx[TMC_N_MOTORS_MAX * DATAGRAM_SIZE];
+#if TMC_SPI_SHARED
+    spi_device_t device[TMC_N_MOTORS_MAX];
+    spi_transaction_t transaction;
+#endif
+    uint8_t motors;         // Motors accessed by the driver plugin, by id
+#if TRINAMIC_SPI_CHAIN
+    uint8_t seq[TMC_N_MOTORS_MAX]; // Chain position by motor id, learned from register accesses
+#endif
+} xfer = {0};
+
+#if !TMC_SPI_SHARED
+
+#define DMAirq(d, p) DMAirqI(d, p)
+#define DMAirqI(d, p) DMA ## d ## _Stream ## p ## _IRQn
+
+#define DMAhandler(d, p) DMAhandlerI(d, p)
+#define DMAhandlerI(d, p) DMA ## d ## _Stream ## p ## _IRQHandler
+
+#if TRINAMIC_SPI_PORT == 2
+
+#define DMA_RX_STREAM DMA1_Stream3
+#define DMA_TX_STREAM DMA1_Stream4
+#define DMA_CHANNEL DMA_CHANNEL_0
+#define DMA_RX_IRQ DMAirq(1, 3)
+#define DMA_TX_IRQ DMAirq(1, 4)
+#define DMA_RX_IRQ_HANDLER DMAhandler(1, 3)
+#define DMA_TX_IRQ_HANDLER DMAhandler(1, 4)
+#define DMA_CLK_ENABLE __HAL_RCC_DMA1_CLK_ENABLE
+
+#elif TRINAMIC_SPI_PORT == 3
+
+#define DMA_RX_STREAM DMA1_Stream0
+#define DMA_TX_STREAM DMA1_Stream5
+#define DMA_CHANNEL DMA_CHANNEL_0
+#define DMA_RX_IRQ DMAirq(1, 0)
+#define DMA_TX_IRQ DMAirq(1, 5)
+#define DMA_RX_IRQ_HANDLER DMAhandler(1, 0)
+#define DMA_TX_IRQ_HANDLER DMAhandler(1, 5)
+#define DMA_CLK_ENABLE __HAL_RCC_DMA1_CLK_ENABLE
+
+#elif TRINAMIC_SPI_PORT == 4
+
+#define DMA_RX_STREAM DMA2_Stream0
+#define DMA_TX_STREAM DMA2_Stream1
+#define DMA_CHANNEL DMA_CHANNEL_4
+#define DMA_RX_IRQ DMAirq(2, 0)
+#define DMA_TX_IRQ DMAirq(2, 1)
+#define DMA_RX_IRQ_HANDLER DMAhandler(2, 0)
+#define DMA_TX_IRQ_HANDLER DMAhandler(2, 1)
+#define DMA_CLK_ENABLE __HAL_RCC_DMA2_CLK_ENABLE
+
+#else
+#error "TRINAMIC_SPI_DMA is not supported for this SPI port!"
+#endif
+
+static DMA_HandleTypeDef spi_dma_rx = {
+    .Instance = DMA_RX_STREAM,
+    .Init.Channel = DMA_CHANNEL,
+    .Init.Direction = DMA_PERIPH_TO_MEMORY,
+    .Init.PeriphInc = DMA_PINC_DISABLE,
+    .Init.MemInc = DMA_MINC_ENABLE,
+    .Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE,
+    .Init.MemDataAlignment = DMA_PDATAALIGN_BYTE,
+    .Init.Mode = DMA_NORMAL,
+    .Init.Priority = DMA_PRIORITY_HIGH,
+    .Init.FIFOMode = DMA_FIFOMODE_DISABLE
+};
+
+static DMA_HandleTypeDef spi_dma_tx = {
+    .Instance = DMA_TX_STREAM,
+    .Init.Channel = DMA_CHANNEL,
+    .Init.Direction = DMA_MEMORY_TO_PERIPH,
+    .Init.PeriphInc = DMA_PINC_DISABLE,
+    .Init.MemInc = DMA_MINC_ENABLE,
+    .Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE,
+    .Init.MemDataAlignment = DMA_PDATAALIGN_BYTE,
+    .Init.Mode = DMA_NORMAL,
+    .Init.Priority = DMA_PRIORITY_HIGH,
+    .Init.FIFOMode = DMA_FIFOMODE_DISABLE
+};
+
+#endif // !TMC_SPI_SHARED
+
+#endif // TRINAMIC_SPI_DMA
 
 static uint8_t spi_get_byte (void)
 {
@@ -84,10 +212,129 @@ static uint8_t spi_put_byte (uint8_t byte)
     return (uint8_t)spi_port.Instance->DR;
 }
 
+// Waits for a running batch to complete and claims the port for a blocking transfer.
+// A shared port is switched to the driver clock and mode, the bus manager restores
+// the configuration left by the other users on release.
+static inline void port_claim (void)
+{
+#if TRINAMIC_SPI_DMA
+    while(xfer.batch);
+#endif
+#if TMC_SPI_SHARED
+    spi_claim_device(&xfer.device[0]);
+#endif
+}
+
+static inline void port_release (void)
+{
+#if TMC_SPI_SHARED
+    spi_release();
+#endif
+}
+
+#if TRINAMIC_SPI_CHAIN
+
+// Exchanges the datagrams of all drivers in one chip select frame,
+// the datagram of the last driver in the chain is sent first.
+static TMC_spi_status_t chain_xfer (uint_fast8_t seq, TMC_spi_datagram_t *reg, bool write)
+{
+    uint8_t res;
+    TMC_spi_status_t status = 0;
+    uint_fast8_t idx = n_motors;
+
+    DIGITAL_OUT(cs[0].port, cs[0].pin, 0);
+
+    do {
+        res = spi_put_byte(datagram[--idx].addr.value);
+        pipeline[idx] = datagram[idx].addr.value;
+
+        if(idx == seq) {
+            status = res;
+            if(write) {
+                spi_put_byte(datagram[idx].payload.data[3]);
+                spi_put_byte(datagram[idx].payload.data[2]);
+                spi_put_byte(datagram[idx].payload.data[1]);
+                spi_put_byte(datagram[idx].payload.data[0]);
+            } else {
+                reg->payload.data[3] = spi_get_byte();
+                reg->payload.data[2] = spi_get_byte();
+                reg->payload.data[1] = spi_get_byte();
+                reg->payload.data[0] = spi_get_byte();
+            }
+        } else {
+            spi_get_byte();
+            spi_get_byte();
+            spi_get_byte();
+            spi_get_byte();
+        }
+    } while(idx);
+
+    DIGITAL_OUT(cs[0].port, cs[0].pin, 1);
+
+    return status;
+}
+
+TMC_spi_status_t tmc_spi_read (trinamic_motor_t driver, TMC_spi_datagram_t *reg)
+{
+    TMC_spi_status_t status;
+
+    port_claim();
+
+#if TRINAMIC_SPI_DMA
+    xfer.seq[driver.id] = driver.seq;
+    xfer.motors |= 1 << driver.id;
+#endif
+
+    datagram[driver.seq].addr.value = reg->addr.value;
+    datagram[driver.seq].addr.write = 0;
+
+    reg->payload.value = 0;
+
+    chain_xfer(driver.seq, reg, false);
+    delay_ns(TMC_SPI_CSN_HIGH_NS);
+    status = chain_xfer(driver.seq, reg, false);
+
+    port_release();
+
+    return status;
+}
+
+TMC_spi_status_t tmc_spi_write (trinamic_motor_t driver, TMC_spi_datagram_t *reg)
+{
+    TMC_spi_status_t status;
+
+    port_claim();
+
+#if TRINAMIC_SPI_DMA
+    xfer.seq[driver.id] = driver.seq;
+    xfer.motors |= 1 << driver.id;
+#endif
+
+    memcpy(&datagram[driver.seq], reg, sizeof(TMC_spi_datagram_t));
+    datagram[driver.seq].addr.write = 1;
+
+    status = chain_xfer(driver.seq, reg, true);
+
+    datagram[driver.seq].addr.idx = 0; // Subsequent transfers to other drivers read GCONF
+    datagram[driver.seq].addr.write = 0;
+
+    port_release();
+
+    return status;
+}
+
+#else
+
 TMC_spi_status_t tmc_spi_read (trinamic_motor_t driver, TMC_spi_datagram_t *datagram)
 {
     TMC_spi_status_t status;
 
+    port_claim();
+
+#if TRINAMIC_SPI_DMA
+    xfer.motors |= 1 << driver.id;
+#endif
+
     DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 0);
 
     datagram->payload.value = 0;
@@ -100,7 +347,7 @@ TMC_spi_status_t tmc_spi_read (trinamic_motor_t driver, TMC_spi_datagram_t *data
     spi_put_byte(0);
 
     DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 1);
-    delay();
+    delay_ns(TMC_SPI_CSN_HIGH_NS);
     DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 0);
 
     status = spi_put_byte(datagram->addr.value);
@@ -111,6 +358,10 @@ TMC_spi_status_t tmc_spi_read (trinamic_motor_t driver, TMC_spi_datagram_t *data
 
     DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 1);
 
+    pipeline[driver.id] = datagram->addr.value;
+
+    port_release();
+
     return status;
 }
 
@@ -118,6 +369,12 @@ TMC_spi_status_t tmc_spi_write (trinamic_motor_t driver, TMC_spi_datagram_t *dat
 {
     TMC_spi_status_t status;
 
+    port_claim();
+
+#if TRINAMIC_SPI_DMA
+    xfer.motors |= 1 << driver.id;
+#endif
+
     DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 0);
 
     datagram->addr.write = 1;
@@ -129,13 +386,21 @@ TMC_spi_status_t tmc_spi_write (trinamic_motor_t driver, TMC_spi_datagram_t *dat
 
     DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 1);
 
+    pipeline[driver.id] = datagram->addr.value;
+
+    port_release();
+
     return status;
 }
 
+#endif // TRINAMIC_SPI_CHAIN
+
 TMC_spi20_datagram_t tmc_spi20_write (trinamic_motor_t driver, TMC_spi20_datagram_t *datagram)
 {
     TMC_spi20_datagram_t status = {0};
 
+    port_claim();
+
     while(__HAL_SPI_GET_FLAG(&spi_port, SPI_FLAG_BSY)) {};
 
     DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 0);
@@ -146,16 +411,272 @@ TMC_spi20_datagram_t tmc_spi20_write (trinamic_motor_t driver, TMC_spi20_datagra
 
     DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 1);
 
+    port_release();
+
     status.value >>= 4;
 
     return status;
 }
 
+#if TRINAMIC_SPI_DMA
+
+static void batch_complete (bool ok);
+
+// Starts the current frame of the batch, called from the foreground or the DMA interrupt.
+static bool frame_start (void)
+{
+    const frame_t *frame = &xfer.frame_list[xfer.frame];
+
+#if TMC_SPI_SHARED
+
+    xfer.transaction.device = &xfer.device[frame->motor];
+    xfer.transaction.tx = &xfer.tx[frame->offset];
+    xfer.transaction.rx = &xfer.rx[frame->offset];
+    xfer.transaction.len = frame->len;
+
+    return spi_submit(&xfer.transaction);
+
+#else
+
+    __HAL_SPI_CLEAR_OVRFLAG(&spi_port);
+
+    if(HAL_DMA_Start_IT(&spi_dma_rx, (uint32_t)&spi_port.Instance->DR, (uint32_t)&xfer.rx[frame->offset], frame->len) != HAL_OK)
+        return false;
+
+    if(HAL_DMA_Start_IT(&spi_dma_tx, (uint32_t)&xfer.tx[frame->offset], (uint32_t)&spi_port.Instance->DR, frame->len) != HAL_OK) {
+        HAL_DMA_Abort(&spi_dma_rx);
+        return false;
+    }
+
+    DIGITAL_OUT(cs[frame->motor].port, cs[frame->motor].pin, 0);
+
+    // Clocking starts when the DMA requests are enabled.
+    SET_BIT(spi_port.Instance->CR2, SPI_CR2_RXDMAEN|SPI_CR2_TXDMAEN);
+
+    return true;
+
+#endif
+}
+
+static inline uint32_t get_value (uint_fast8_t offset)
+{
+    return ((uint32_t)xfer.rx[offset + 1] << 24) | ((uint32_t)xfer.rx[offset + 2] << 16) |
+            ((uint32_t)xfer.rx[offset + 3] << 8) | xfer.rx[offset + 4];
+}
+
+static void frame_complete (bool ok)
+{
+    uint32_t cycles = DWT->CYCCNT;
+    const frame_t *frame = &xfer.frame_list[xfer.frame];
+    tmc_spi_batch_t *batch = xfer.batch;
+
+    if(ok && frame->result) {
+#if TRINAMIC_SPI_CHAIN
+        uint_fast8_t motor = TMC_N_MOTORS_MAX, offset;
+        do {
+            if(batch->motors & (1 << --motor)) {
+                offset = (n_motors - 1 - xfer.seq[motor]) * DATAGRAM_SIZE;
+                batch->status[motor] = xfer.rx[offset];
+                batch->value[motor] = get_value(offset);
+            }
+        } while(motor);
+#else
+        batch->status[frame->motor] = xfer.rx[frame->offset];
+        batch->value[frame->motor] = get_value(frame->offset);
+#endif
+    }
+
+    if(ok && ++xfer.frame < xfer.frames) {
+#if !TMC_SPI_SHARED
+        delay_ns(TMC_SPI_CSN_HIGH_NS);
+#endif
+        ok = frame_start();
+        batch->cycles += DWT->CYCCNT - cycles;
+        if(!ok)
+            batch_complete(false);
+    } else {
+        batch->cycles += DWT->CYCCNT - cycles;
+        batch_complete(ok);
+    }
+}
+
+static void batch_complete (bool ok)
+{
+    tmc_spi_batch_t *batch = xfer.batch;
+
+    if(!ok) // Driver pipelines are unknown after a failed transfer
+        memset(pipeline, 0xFF, sizeof(pipeline));
+
+    batch->ok = ok;
+    batch->busy = false;
+    xfer.batch = NULL;
+
+    if(batch->on_complete)
+        batch->on_complete(batch);
+}
+
+#if TMC_SPI_SHARED
+
+static void transaction_complete (spi_transaction_t *transaction)
+{
+    frame_complete(transaction->state == SPIXfer_Done);
+}
+
+#else
+
+static void dma_rx_complete (DMA_HandleTypeDef *hdma)
+{
+    const frame_t *frame = &xfer.frame_list[xfer.frame];
+
+    CLEAR_BIT(spi_port.Instance->CR2, SPI_CR2_RXDMAEN|SPI_CR2_TXDMAEN);
+    DIGITAL_OUT(cs[frame->motor].port, cs[frame->motor].pin, 1);
+
+    frame_complete(hdma->ErrorCode == HAL_DMA_ERROR_NONE);
+}
+
+static void dma_tx_error (DMA_HandleTypeDef *hdma)
+{
+    HAL_DMA_Abort(&spi_dma_rx);
+    spi_dma_rx.ErrorCode = HAL_DMA_ERROR_TE;
+    dma_rx_complete(&spi_dma_rx);
+}
+
+void DMA_RX_IRQ_HANDLER (void)
+{
+    HAL_DMA_IRQHandler(&spi_dma_rx);
+}
+
+void DMA_TX_IRQ_HANDLER (void)
+{
+    HAL_DMA_IRQHandler(&spi_dma_tx);
+}
+
+#endif // TMC_SPI_SHARED
+
+bool tmc_spi_read_batch (tmc_spi_batch_t *batch)
+{
+    uint_fast8_t offset;
+
+    if(xfer.batch || batch->busy || batch->motors == 0 || n_motors == 0)
+        return false;
+
+    xfer.frames = xfer.frame = 0;
+
+#if TRINAMIC_SPI_CHAIN
+
+    bool primed = true;
+    uint_fast8_t seq;
+
+    for(seq = 0; seq < n_motors; seq++) {
+        primed &= pipeline[seq] == (batch->reg & 0x7F);
+        pipeline[seq] = datagram[seq].addr.value = batch->reg & 0x7F;
+        offset = (n_motors - 1 - seq) * DATAGRAM_SIZE;
+        memset(&xfer.tx[offset], 0, DATAGRAM_SIZE);
+        xfer.tx[offset] = batch->reg & 0x7F;
+    }
+
+    if(!primed)
+        xfer.frame_list[xfer.frames++] = (frame_t){ .motor = 0, .offset = 0, .len = n_motors * DATAGRAM_SIZE };
+
+    xfer.frame_list[xfer.frames++] = (frame_t){ .motor = 0, .offset = 0, .len = n_motors * DATAGRAM_SIZE, .result = true };
+
+#else
+
+    uint_fast8_t motor;
+
+    // Request frames for drivers not already holding a request for the register...
+    for(motor = 0; motor < TMC_N_MOTORS_MAX; motor++) {
+        if((batch->motors & (1 << motor)) && cs[motor].port) {
+            offset = motor * DATAGRAM_SIZE;
+            memset(&xfer.tx[offset], 0, DATAGRAM_SIZE);
+            xfer.tx[offset] = batch->reg & 0x7F;
+            if(pipeline[motor] != xfer.tx[offset])
+                xfer.frame_list[xfer.frames++] = (frame_t){ .motor = motor, .offset = offset, .len = DATAGRAM_SIZE };
+        }
+    }
+
+    // ...followed by the frames returning the data.
+    for(motor = 0; motor < TMC_N_MOTORS_MAX; motor++) {
+        if((batch->motors & (1 << motor)) && cs[motor].port) {
+            pipeline[motor] = batch->reg & 0x7F;
+            xfer.frame_list[xfer.frames++] = (frame_t){ .motor = motor, .offset = motor * DATAGRAM_SIZE, .len = DATAGRAM_SIZE, .result = true };
+        }
+    }
+
+    if(xfer.frames == 0)
+        return false;
+
+#endif
+
+    batch->busy = true;
+    batch->ok = false;
+    batch->cycles = 0;
+    xfer.batch = batch;
+
+    if(!frame_start()) {
+        memset(pipeline, 0xFF, sizeof(pipeline));
+        xfer.batch = NULL;
+        batch->busy = false;
+        return false;
+    }
+
+    return true;
+}
+
+bool tmc_spi_batch_busy (void)
+{
+    return xfer.batch != NULL;
+}
+
+uint8_t tmc_spi_get_motors (void)
+{
+    return xfer.motors;
+}
+
+static void dma_init (void)
+{
+#if TMC_SPI_SHARED
+
+    uint_fast8_t motor;
+
+    for(motor = 0; motor < TMC_N_MOTORS_MAX; motor++) {
+        xfer.device[motor].cs_port = cs[motor].port;
+        xfer.device[motor].cs_pin = cs[motor].pin;
+        xfer.device[motor].prescaler = SPI_BAUDRATEPRESCALER_32;
+        xfer.device[motor].mode = SPI_POLARITY_LOW|SPI_PHASE_1EDGE;
+        xfer.device[motor].priority = 1;
+    }
+
+    xfer.transaction.on_complete = transaction_complete;
+
+#else
+
+    DMA_CLK_ENABLE();
+
+    HAL_DMA_Init(&spi_dma_rx);
+    HAL_DMA_Init(&spi_dma_tx);
+
+    spi_dma_rx.XferCpltCallback = dma_rx_complete;
+    spi_dma_rx.XferErrorCallback = dma_rx_complete;
+    spi_dma_tx.XferErrorCallback = dma_tx_error;
+
+    HAL_NVIC_SetPriority(DMA_RX_IRQ, 3, 0);
+    HAL_NVIC_EnableIRQ(DMA_RX_IRQ);
+
+    HAL_NVIC_SetPriority(DMA_TX_IRQ, 3, 0);
+    HAL_NVIC_EnableIRQ(DMA_TX_IRQ);
+
+#endif
+}
+
+#endif // TRINAMIC_SPI_DMA
+
 static void add_cs_pin (xbar_t *gpio, void *data)
 {
     if (gpio->group == PinGroup_MotorChipSelect)
       switch (gpio->function) {
 
+        case Output_MotorChipSelect: // Daisy-chained drivers
         case Output_MotorChipSelectX:
             cs[X_AXIS].port = (GPIO_TypeDef *)gpio->port;
             cs[X_AXIS].pin = gpio->pin;
@@ -195,7 +716,8 @@ static void if_init (uint8_t motors, axes_signals_t enabled)
 {
     static bool init_ok = false;
 
-    UNUSED(motors);
+    n_motors = motors;
+    memset(pipeline, 0xFF, sizeof(pipeline));
 
     if(!init_ok) {
 
@@ -330,6 +852,10 @@ static void if_init (uint8_t motors, axes_signals_t enabled)
         hal.periph_port.register_pin(&sdo);
         hal.periph_port.register_pin(&sdi);
         hal.enumerate_pins(true, add_cs_pin, NULL);
+
+#if TRINAMIC_SPI_DMA
+        dma_init();
+#endif
     }
 }
 
@@ -0,0 +1,266 @@
+/*
+
+  usb_enet.c - lwIP network interface over USB CDC-NCM
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  Provides the same networking services as the WIZnet driver over the USB cable,
+  the host sees a standard CDC-NCM Ethernet adapter next to the USB serial port.
+
+  The link has no DHCP server so the address is static by default, the host interface
+  must then be configured with an address in the same subnet. Configuration is compile time only.
+*/
+
+#include "driver.h"
+
+#if USB_NETWORK_ENABLE
+
+#include <string.h>
+
+#include "usb_enet.h"
+#include "usbd_cdc_ncm.h"
+
+#include "lwip/init.h"
+#include "lwip/netif.h"
+#include "lwip/timeouts.h"
+#include "lwip/dhcp.h"
+#include "lwip/autoip.h"
+#include "lwip/etharp.h"
+#include "netif/ethernet.h"
+
+#include "grbl/hal.h"
+
+#if TELNET_ENABLE
+#include "networking/telnetd.h"
+#endif
+#if WEBSOCKET_ENABLE
+#include "networking/websocketd.h"
+#endif
+#if HTTP_ENABLE
+#include "networking/httpd.h"
+#endif
+#if FTP_ENABLE
+#include "networking/ftpd.h"
+#endif
+
+#ifndef USB_NETWORK_IPMODE
+#define USB_NETWORK_IPMODE 0 // 0 = static, 1 = DHCP, 2 = AutoIP
+#endif
+#ifndef NETWORK_HOSTNAME
+#define NETWORK_HOSTNAME "grblHAL"
+#endif
+#ifndef NETWORK_IP
+#define NETWORK_IP "192.168.5.1"
+#endif
+#ifndef NETWORK_GATEWAY
+#define NETWORK_GATEWAY "192.168.5.1"
+#endif
+#ifndef NETWORK_MASK
+#define NETWORK_MASK "255.255.255.0"
+#endif
+#ifndef NETWORK_TELNET_PORT
+#define NETWORK_TELNET_PORT 23
+#endif
+#ifndef NETWORK_WEBSOCKET_PORT
+#define NETWORK_WEBSOCKET_PORT 81
+#endif
+#ifndef NETWORK_HTTP_PORT
+#define NETWORK_HTTP_PORT 80
+#endif
+#ifndef NETWORK_FTP_PORT
+#define NETWORK_FTP_PORT 21
+#endif
+
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+static struct netif netif;
+static bool link_up = false;
+static char ip_address[IP4ADDR_STRLEN_MAX] = "";
+static struct {
+    bool telnet;
+    bool websocket;
+    bool http;
+    bool ftp;
+} services = {0};
+static on_execute_realtime_ptr on_execute_realtime;
+static on_report_options_ptr on_report_options;
+
+static err_t low_level_output (struct netif *netif, struct pbuf *p)
+{
+    uint8_t *frame;
+
+    UNUSED(netif);
+
+    if((frame = USBD_NCM_TxAlloc(&hUsbDeviceFS, p->tot_len)) == NULL)
+        return ERR_MEM;
+
+    pbuf_copy_partial(p, frame, p->tot_len, 0);
+    USBD_NCM_TxCommit(&hUsbDeviceFS);
+
+    return ERR_OK;
+}
+
+static void low_level_input (const uint8_t *frame, uint16_t length)
+{
+    struct pbuf *p;
+
+    if((p = pbuf_alloc(PBUF_RAW, length, PBUF_POOL))) {
+        pbuf_take(p, frame, length);
+        if(netif.input(p, &netif) != ERR_OK)
+            pbuf_free(p);
+    }
+}
+
+static err_t netif_init_callback (struct netif *netif)
+{
+    netif->name[0] = 'u';
+    netif->name[1] = 's';
+#if LWIP_NETIF_HOSTNAME
+    netif->hostname = NETWORK_HOSTNAME;
+#endif
+    netif->output = etharp_output;
+    netif->linkoutput = low_level_output;
+    netif->mtu = NCM_MAX_SEGMENT_SIZE - 14;
+    netif->hwaddr_len = ETH_HWADDR_LEN;
+    netif->flags = NETIF_FLAG_BROADCAST|NETIF_FLAG_ETHARP|NETIF_FLAG_ETHERNET|NETIF_FLAG_IGMP;
+
+    USBD_NCM_GetMACAddress(netif->hwaddr, false);
+
+    return ERR_OK;
+}
+
+// Starts the services when the interface has got an address.
+static void netif_status_callback (struct netif *netif)
+{
+    if(ip4_addr_isany_val(*netif_ip4_addr(netif)))
+        return;
+
+    ip4addr_ntoa_r(netif_ip4_addr(netif), ip_address, IP4ADDR_STRLEN_MAX);
+
+#if TELNET_ENABLE
+    if(!services.telnet)
+        services.telnet = telnetd_init(NETWORK_TELNET_PORT);
+#endif
+#if FTP_ENABLE
+    if(!services.ftp)
+        services.ftp = ftpd_init(NETWORK_FTP_PORT);
+#endif
+#if HTTP_ENABLE
+    if(!services.http)
+        services.http = httpd_init(NETWORK_HTTP_PORT);
+#endif
+#if WEBSOCKET_ENABLE
+    if(!services.websocket)
+        services.websocket = websocketd_init(NETWORK_WEBSOCKET_PORT);
+#endif
+}
+
+static void enet_poll (sys_state_t state)
+{
+    on_execute_realtime(state);
+
+    if(link_up != USBD_NCM_LinkUp()) {
+        if((link_up = !link_up)) {
+            netif_set_link_up(&netif);
+#if USB_NETWORK_IPMODE == 1
+            dhcp_start(&netif);
+#elif USB_NETWORK_IPMODE == 2
+            autoip_start(&netif);
+#endif
+        } else
+            netif_set_link_down(&netif);
+    }
+
+    USBD_NCM_Process(&hUsbDeviceFS, low_level_input);
+
+    sys_check_timeouts();
+
+    if(link_up) {
+#if TELNET_ENABLE
+        if(services.telnet)
+            telnetd_poll();
+#endif
+#if FTP_ENABLE
+        if(services.ftp)
+            ftpd_poll();
+#endif
+#if WEBSOCKET_ENABLE
+        if(services.websocket)
+            websocketd_poll();
+#endif
+    }
+}
+
+static void report_options (bool newopt)
+{
+    on_report_options(newopt);
+
+    if(!newopt) {
+        hal.stream.write("[PLUGIN:USB NCM networking v0.01]" ASCII_EOL);
+        if(*ip_address) {
+            hal.stream.write("[IP:");
+            hal.stream.write(ip_address);
+            hal.stream.write("]" ASCII_EOL);
+        }
+    }
+}
+
+u32_t sys_now (void)
+{
+    return hal.get_elapsed_ticks();
+}
+
+bool enet_start (void)
+{
+    ip4_addr_t ip, mask, gw;
+
+    lwip_init();
+
+#if USB_NETWORK_IPMODE == 0
+    ip4addr_aton(NETWORK_IP, &ip);
+    ip4addr_aton(NETWORK_MASK, &mask);
+    ip4addr_aton(NETWORK_GATEWAY, &gw);
+#else
+    ip4_addr_set_zero(&ip);
+    ip4_addr_set_zero(&mask);
+    ip4_addr_set_zero(&gw);
+#endif
+
+    netif_add(&netif, &ip, &mask, &gw, NULL, netif_init_callback, ethernet_input);
+    netif_set_default(&netif);
+    netif_set_status_callback(&netif, netif_status_callback);
+    netif_set_up(&netif);
+
+    on_execute_realtime = grbl.on_execute_realtime;
+    grbl.on_execute_realtime = enet_poll;
+
+    return true;
+}
+
+bool enet_init (void)
+{
+    on_report_options = grbl.on_report_options;
+    grbl.on_report_options = report_options;
+
+    return true;
+}
+
+#endif // USB_NETWORK_ENABLE
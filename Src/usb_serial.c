@@ -33,190 +33,534 @@
 #include "usbd_cdc_if.h"
 #include "usb_device.h"
 
-static stream_rx_buffer_t rxbuf = {0};
-static stream_block_tx_buffer2_t txbuf = {0};
-static enqueue_realtime_command_ptr enqueue_realtime_command = protocol_enqueue_realtime_command;
+#if STREAM_STATS_ENABLE
+#include "stream_stats.h"
+#endif
+
+#if USB_MSC_ENABLE
+#include "usbd_msc_if.h"
+#endif
+
+#ifndef USB_SERIAL_TX_BUFFERS
+#define USB_SERIAL_TX_BUFFERS 4
+#endif
+
+#if USB_SERIAL_TX_BUFFERS < 2
+#error "USB_SERIAL_TX_BUFFERS must be 2 or more!"
+#endif
+
+#define TXQ_NEXT(i) (((i) + 1) % USB_SERIAL_TX_BUFFERS)
+
+typedef struct {
+    uint16_t length;
+    char data[BLOCK_TX_BUFFER_SIZE];
+} usb_tx_block_t;
+
+// Output queue, blocks from tail up to head are queued for transmission and
+// the block at tail is being transmitted when busy is set. The block at head is being filled.
+typedef struct {
+    volatile uint_fast8_t head;
+    volatile uint_fast8_t tail;
+    volatile bool busy;
+    usb_tx_block_t block[USB_SERIAL_TX_BUFFERS];
+} usb_tx_queue_t;
+
+// Each CDC ACM interface has its own endpoints, input buffer and output queue.
+typedef struct {
+    stream_rx_buffer_t rxbuf;
+    usb_tx_queue_t txq;
+    enqueue_realtime_command_ptr enqueue_realtime_command;
+    volatile bool tx_lock;
+    volatile bool rx_held;
+    volatile usb_linestate_t *linestate;
+    uint8_t (*transmit)(uint8_t *buf, uint16_t length);
+    void (*receive_resume)(void);
+#if STREAM_STATS_ENABLE
+    stream_stats_t stats;
+#endif
+} usb_port_t;
 
 volatile usb_linestate_t usb_linestate = {0};
 
-static bool is_connected (void)
+static usb_port_t usb = {
+    .enqueue_realtime_command = protocol_enqueue_realtime_command,
+    .linestate = &usb_linestate,
+    .transmit = CDC_Transmit_FS,
+    .receive_resume = CDC_ReceiveResume_FS,
+#if STREAM_STATS_ENABLE
+    .stats.name = "USB"
+#endif
+};
+
+#if USB_SERIAL_DUAL
+
+volatile usb_linestate_t usb2_linestate = {0};
+
+static const io_stream_t *usb2Init (uint32_t baud_rate);
+
+static usb_port_t usb2 = {
+    .enqueue_realtime_command = protocol_enqueue_realtime_command,
+    .linestate = &usb2_linestate,
+    .transmit = CDC2_Transmit_FS,
+    .receive_resume = CDC2_ReceiveResume_FS,
+#if STREAM_STATS_ENABLE
+    .stats.name = "USB2"
+#endif
+};
+
+#endif
+
+#if STREAM_STATS_ENABLE
+#define usb_blocking_callback(port) stream_stats_blocking_callback(&(port)->stats)
+#else
+#define usb_blocking_callback(port) hal.stream_blocking_callback()
+#endif
+
+static inline bool usb_is_connected (usb_port_t *port)
 {
-    return usb_linestate.pin.dtr && hal.get_elapsed_ticks() - usb_linestate.timestamp >= 15;
+    return port->linestate->pin.dtr && hal.get_elapsed_ticks() - port->linestate->timestamp >= 15;
 }
 
 //
 // Returns number of free characters in the input buffer
 //
-static uint16_t usbRxFree (void)
+static inline uint16_t usb_rx_free (usb_port_t *port)
 {
-    uint16_t tail = rxbuf.tail, head = rxbuf.head;
+    uint16_t tail = port->rxbuf.tail, head = port->rxbuf.head;
 
     return RX_BUFFER_SIZE - BUFCOUNT(head, tail, RX_BUFFER_SIZE);
 }
 
+//
+// Returns true if the input buffer has room for a full packet
+//
+static inline bool usb_rx_room (usb_port_t *port)
+{
+    return RX_BUFFER_SIZE - 1 - BUFCOUNT(port->rxbuf.head, port->rxbuf.tail, RX_BUFFER_SIZE) >= CDC_DATA_FS_MAX_PACKET_SIZE;
+}
+
+//
+// Resumes reception if the OUT endpoint was left NAKing by usb_buffer_input() and there is room for a packet
+//
+static inline void usb_rx_resume (usb_port_t *port)
+{
+    if(port->rx_held && usb_rx_room(port)) {
+        port->rx_held = false;
+        port->receive_resume();
+    }
+}
+
 //
 // Flushes the input buffer
 //
-static void usbRxFlush (void)
+static void usb_rx_flush (usb_port_t *port)
 {
-    rxbuf.tail = rxbuf.head;
+    port->rxbuf.tail = port->rxbuf.head;
+    usb_rx_resume(port);
 }
 
 //
 // Flushes and adds a CAN character to the input buffer
 //
-static void usbRxCancel (void)
+static void usb_rx_cancel (usb_port_t *port)
 {
-    rxbuf.data[rxbuf.head] = ASCII_CAN;
-    rxbuf.tail = rxbuf.head;
-    rxbuf.head = BUFNEXT(rxbuf.head, rxbuf);
+    port->rxbuf.data[port->rxbuf.head] = ASCII_CAN;
+    port->rxbuf.tail = port->rxbuf.head;
+    port->rxbuf.head = BUFNEXT(port->rxbuf.head, port->rxbuf);
+    usb_rx_resume(port);
 }
 
 //
-// Writes current buffer to the USB output stream, swaps buffers
+// Starts transmission of the block at the tail of the queue if the IN endpoint is idle.
+// Must be called from the USB interrupt or with it disabled.
+// The CDC class appends a zero length packet when the length is a multiple of the packet size.
+// Queued output is discarded if the device is not configured.
 //
-static inline bool usb_write (void)
+static void usb_tx_start (usb_port_t *port)
 {
-    static uint8_t dummy = 0;
+    usb_tx_queue_t *txq = &port->txq;
+
+    if(txq->busy || txq->tail == txq->head)
+        return;
 
-    txbuf.s = txbuf.use_tx2data ? txbuf.data2 : txbuf.data;
+    switch(port->transmit((uint8_t *)txq->block[txq->tail].data, txq->block[txq->tail].length)) {
 
-    while(CDC_Transmit_FS((uint8_t *)txbuf.s, txbuf.length) == USBD_BUSY) {
-        if(!hal.stream_blocking_callback())
-            return false;
+        case USBD_OK:
+            txq->busy = true;
+            break;
+
+        case USBD_BUSY: // retried from next start of frame
+            break;
+
+        default:
+            txq->tail = txq->head;
+            break;
     }
+}
 
-    if(txbuf.length % 64 == 0) {
-        while(CDC_Transmit_FS(&dummy, 0) == USBD_BUSY) {
-            if(!hal.stream_blocking_callback())
-                return false;
-        }
+//
+// Queues the block being filled for transmission, blocks if all buffers are in use
+//
+static bool usb_tx_commit (usb_port_t *port)
+{
+    usb_tx_queue_t *txq = &port->txq;
+    uint_fast8_t next_head = TXQ_NEXT(txq->head);
+
+    while(next_head == txq->tail) {
+        if(!usb_blocking_callback(port))
+            return false;
     }
 
-    txbuf.use_tx2data = !txbuf.use_tx2data;
-    txbuf.s = txbuf.use_tx2data ? txbuf.data2 : txbuf.data;
-    txbuf.length = 0;
+    txq->block[next_head].length = 0;
+
+    HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+    txq->head = next_head;
+    usb_tx_start(port);
+    HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
 
     return true;
 }
 
+// Output is coalesced in the queue blocks and committed when a block is full, at end of line (LF)
+// or by usbTxFlush() from the next start of frame or transmit completion.
+// tx_lock keeps the latter out while the foreground is adding to the block.
+
+static inline void usb_tx_lock (usb_port_t *port, bool on)
+{
+    __DMB();
+    port->tx_lock = on;
+    __DMB();
+}
+
 //
-// Writes a single character to the USB output stream, blocks if buffer full
+// Adds characters to the output queue, commits the current block when full and on EOL (LF)
 //
-static bool usbPutC (const char c)
+static bool usb_add (usb_port_t *port, const char *s, size_t length)
 {
-    static uint8_t buf[1];
+    size_t n;
+    usb_tx_block_t *block;
+    bool eol = s[length - 1] == ASCII_LF;
+
+    while(length) {
+
+        block = &port->txq.block[port->txq.head];
+
+        if((n = BLOCK_TX_BUFFER_SIZE - block->length) > length)
+            n = length;
 
-    *buf = c;
+        memcpy(&block->data[block->length], s, n);
+        block->length += n;
+        length -= n;
+        s += n;
 
-    while(CDC_Transmit_FS(buf, 1) == USBD_BUSY) {
-        if(!hal.stream_blocking_callback())
+        if(block->length == BLOCK_TX_BUFFER_SIZE && !usb_tx_commit(port))
             return false;
     }
 
-    return true;
+    return eol && port->txq.block[port->txq.head].length ? usb_tx_commit(port) : true;
 }
 
 //
-// Writes a null terminated string to the USB output stream, blocks if buffer full
-// Buffers string up to EOL (LF) before transmitting
+// Writes a number of characters to the output stream, blocks if the output queue is full
 //
-static void usbWriteS (const char *s)
+static bool usb_write (usb_port_t *port, const char *s, size_t length)
 {
-    size_t length = strlen(s);
+    bool ok;
 
     if(length == 0)
-        return;
+        return true;
 
-    if(txbuf.length && (txbuf.length + length) > txbuf.max_length) {
-        if(!usb_write())
-            return;
-    }
+#if STREAM_STATS_ENABLE
+    stream_stats_tx(&port->stats, length, port->txq.block[port->txq.head].length + length);
+#endif
 
-    while(length > txbuf.max_length) {
-        txbuf.length = txbuf.max_length;
-        memcpy(txbuf.s, s, txbuf.length);
-        if(!usb_write())
-            return;
-        length -= txbuf.max_length;
-        s += txbuf.max_length;
-    }
+    usb_tx_lock(port, true);
+    ok = usb_add(port, s, length);
+    usb_tx_lock(port, false);
 
-    if(length) {
-        memcpy(txbuf.s, s, length);
-        txbuf.length += length;
-        txbuf.s += length;
-        if(s[length - 1] == ASCII_LF)
-            usb_write();
-    }
+    return ok;
 }
 
 //
-// Writes a number of characters from string to the USB output stream, blocks if buffer full
+// Returns -1 if no data available
 //
-static void usbWrite (const char *s, uint16_t length)
+static int16_t usb_getc (usb_port_t *port)
 {
-    if(length == 0)
-        return;
+    uint_fast16_t tail = port->rxbuf.tail;      // Get buffer pointer
 
-    if(txbuf.length && (txbuf.length + length) > txbuf.max_length) {
-        if(!usb_write())
-            return;
-    }
+    if(tail == port->rxbuf.head)
+        return -1; // no data available
+
+    char data = port->rxbuf.data[tail];         // Get next character
+    port->rxbuf.tail = BUFNEXT(tail, port->rxbuf); // and update pointer
+
+    usb_rx_resume(port);
+
+    return (int16_t)data;
+}
 
-    while(length > txbuf.max_length) {
-        txbuf.length = txbuf.max_length;
-        memcpy(txbuf.s, s, txbuf.length);
-        if(!usb_write())
-            return;
-        length -= txbuf.max_length;
-        s += txbuf.max_length;
+static enqueue_realtime_command_ptr usb_set_rt_handler (usb_port_t *port, enqueue_realtime_command_ptr handler)
+{
+    enqueue_realtime_command_ptr prev = port->enqueue_realtime_command;
+
+    if(handler)
+        port->enqueue_realtime_command = handler;
+
+    return prev;
+}
+
+// Queues output left in the block being filled by the foreground when the IN endpoint is idle.
+static void usb_tx_flush (usb_port_t *port)
+{
+    usb_tx_queue_t *txq = &port->txq;
+
+    if(!txq->busy) {
+        if(!port->tx_lock && txq->block[txq->head].length && TXQ_NEXT(txq->head) != txq->tail) {
+            txq->block[TXQ_NEXT(txq->head)].length = 0;
+            txq->head = TXQ_NEXT(txq->head);
+        }
+        usb_tx_start(port);
     }
+}
 
-    if(length) {
-        memcpy(txbuf.s, s, length);
-        txbuf.length += length;
-        txbuf.s += length;
-        usb_write();
+// Releases the transmitted block and starts transmission of the next, if any.
+static void usb_tx_complete (usb_port_t *port)
+{
+    usb_tx_queue_t *txq = &port->txq;
+
+    txq->busy = false;
+    txq->tail = TXQ_NEXT(txq->tail);
+
+    if(txq->tail == txq->head)
+        usb_tx_flush(port);
+    else
+        usb_tx_start(port);
+}
+
+// Discards queued output on disconnect or bus reset, a pending transfer will not complete.
+static void usb_tx_abort (usb_port_t *port)
+{
+    port->txq.busy = false;
+    port->txq.tail = port->txq.head;
+}
+
+// Returns false if there is no room for another packet, the OUT endpoint is then left
+// NAKing in order to throttle the host until the buffer has been drained.
+static bool usb_buffer_input (usb_port_t *port, uint8_t *data, uint32_t length)
+{
+    stream_rx_buffer_t *rxbuf = &port->rxbuf;
+
+#if STREAM_STATS_ENABLE
+    port->stats.rx_bytes += length;
+#endif
+
+    while(length--) {
+        if(!port->enqueue_realtime_command(*data)) {            // Check and strip realtime commands,
+            uint16_t next_head = BUFNEXT(rxbuf->head, (*rxbuf)); // Get and increment buffer pointer
+            if(next_head == rxbuf->tail) {                      // If buffer full
+                rxbuf->overflow = 1;                            // flag overflow
+#if STREAM_STATS_ENABLE
+                port->stats.rx_overflows++;
+#endif
+            } else {
+                rxbuf->data[rxbuf->head] = *data;               // if not add data to buffer
+                rxbuf->head = next_head;                        // and update pointer
+            }
+        }
+#if STREAM_STATS_ENABLE
+        else
+            port->stats.rt_commands++;
+#endif
+        data++;                                                 // next...
     }
+
+#if STREAM_STATS_ENABLE
+    stream_stats_rx_fill(&port->stats, BUFCOUNT(rxbuf->head, rxbuf->tail, RX_BUFFER_SIZE));
+#endif
+
+    return !(port->rx_held = !usb_rx_room(port));
+}
+
+/*
+ * Primary port, io_stream_t entry points
+ */
+
+static bool is_connected (void)
+{
+    return usb_is_connected(&usb);
+}
+
+static uint16_t usbRxFree (void)
+{
+    return usb_rx_free(&usb);
+}
+
+static void usbRxFlush (void)
+{
+    usb_rx_flush(&usb);
+}
+
+static void usbRxCancel (void)
+{
+    usb_rx_cancel(&usb);
 }
 
 //
-// usbGetC - returns -1 if no data available
+// Writes a single character to the USB output stream, blocks if the output queue is full
 //
-static int16_t usbGetC (void)
+static bool usbPutC (const char c)
 {
-    uint_fast16_t tail = rxbuf.tail;    // Get buffer pointer
+    return usb_write(&usb, &c, 1);
+}
 
-    if(tail == rxbuf.head)
-        return -1; // no data available
+//
+// Writes a null terminated string to the USB output stream, blocks if the output queue is full
+// Buffers string up to EOL (LF) before transmitting
+//
+static void usbWriteS (const char *s)
+{
+    usb_write(&usb, s, strlen(s));
+}
 
-    char data = rxbuf.data[tail];       // Get next character
-    rxbuf.tail = BUFNEXT(tail, rxbuf);  // and update pointer
+//
+// Writes a number of characters from string to the USB output stream, blocks if the output queue is full
+//
+static void usbWrite (const char *s, uint16_t length)
+{
+    usb_write(&usb, s, length);
+}
 
-    return (int16_t)data;
+//
+// usbGetC - returns -1 if no data available
+//
+static int16_t usbGetC (void)
+{
+    return usb_getc(&usb);
 }
 
 static bool usbSuspendInput (bool suspend)
 {
-    return stream_rx_suspend(&rxbuf, suspend);
+    return stream_rx_suspend(&usb.rxbuf, suspend);
 }
 
 static bool usbEnqueueRtCommand (char c)
 {
-    return enqueue_realtime_command(c);
+    return usb.enqueue_realtime_command(c);
 }
 
 static enqueue_realtime_command_ptr usbSetRtHandler (enqueue_realtime_command_ptr handler)
 {
-    enqueue_realtime_command_ptr prev = enqueue_realtime_command;
+    return usb_set_rt_handler(&usb, handler);
+}
 
-    if(handler)
-        enqueue_realtime_command = handler;
+#if USB_SERIAL_DUAL
 
-    return prev;
+/*
+ * Secondary port, io_stream_t entry points
+ */
+
+static bool usb2IsConnected (void)
+{
+    return usb_is_connected(&usb2);
 }
 
+static uint16_t usb2RxFree (void)
+{
+    return usb_rx_free(&usb2);
+}
+
+static void usb2RxFlush (void)
+{
+    usb_rx_flush(&usb2);
+}
+
+static void usb2RxCancel (void)
+{
+    usb_rx_cancel(&usb2);
+}
+
+static bool usb2PutC (const char c)
+{
+    return usb_write(&usb2, &c, 1);
+}
+
+static void usb2WriteS (const char *s)
+{
+    usb_write(&usb2, s, strlen(s));
+}
+
+static void usb2Write (const char *s, uint16_t length)
+{
+    usb_write(&usb2, s, length);
+}
+
+static int16_t usb2GetC (void)
+{
+    return usb_getc(&usb2);
+}
+
+static bool usb2SuspendInput (bool suspend)
+{
+    return stream_rx_suspend(&usb2.rxbuf, suspend);
+}
+
+static bool usb2EnqueueRtCommand (char c)
+{
+    return usb2.enqueue_realtime_command(c);
+}
+
+static enqueue_realtime_command_ptr usb2SetRtHandler (enqueue_realtime_command_ptr handler)
+{
+    return usb_set_rt_handler(&usb2, handler);
+}
+
+static io_stream_properties_t usb_streams[] = {
+    {
+      .type = StreamType_Serial,
+      .instance = USB_SERIAL2_STREAM,
+      .flags.claimable = On,
+      .flags.claimed = Off,
+      .flags.can_set_baud = Off,
+      .claim = usb2Init
+    }
+};
+
+// Claims the second CDC ACM interface, the baud rate is ignored.
+static const io_stream_t *usb2Init (uint32_t baud_rate)
+{
+    static const io_stream_t stream = {
+        .type = StreamType_Serial,
+        .instance = USB_SERIAL2_STREAM,
+        .state.is_usb = On,
+        .is_connected = usb2IsConnected,
+        .read = usb2GetC,
+        .write = usb2WriteS,
+        .write_char = usb2PutC,
+        .write_n = usb2Write,
+        .enqueue_rt_command = usb2EnqueueRtCommand,
+        .get_rx_buffer_free = usb2RxFree,
+        .reset_read_buffer = usb2RxFlush,
+        .cancel_read_buffer = usb2RxCancel,
+        .suspend_read = usb2SuspendInput,
+        .set_enqueue_rt_handler = usb2SetRtHandler
+    };
+
+    UNUSED(baud_rate);
+
+    if(usb_streams[0].flags.claimed)
+        return NULL;
+
+    usb_streams[0].flags.claimed = On;
+
+#if STREAM_STATS_ENABLE
+    stream_stats_register(&usb2.stats);
+#endif
+
+    return &stream;
+}
+
+#endif // USB_SERIAL_DUAL
+
 // NOTE: USB interrupt priority should be set lower than stepper/step timer to avoid jitter
 // It is set in HAL_PCD_MspInit() in usbd_conf.c
 const io_stream_t *usbInit (void)
@@ -239,27 +583,76 @@ const io_stream_t *usbInit (void)
 
     MX_USB_DEVICE_Init();
 
-    txbuf.s = txbuf.data;
-    txbuf.max_length = BLOCK_TX_BUFFER_SIZE;
+#if USB_MSC_ENABLE
+    usbMscInit();
+#endif
+
+#if USB_SERIAL_DUAL
+
+    static io_stream_details_t streams = {
+        .n_streams = sizeof(usb_streams) / sizeof(io_stream_properties_t),
+        .streams = usb_streams,
+    };
+
+    stream_register_streams(&streams);
+
+#endif
+
+#if STREAM_STATS_ENABLE
+    stream_stats_register(&usb.stats);
+#endif
 
     return &stream;
 }
 
+// NOTE: add a call to this function to HAL_PCD_SOFCallback() in usbd_conf.c, SOF interrupts must be enabled
+// Queues output left in the block being filled by the foreground when the IN endpoint is idle,
+// called every ms from the USB interrupt.
+void usbTxFlush (void)
+{
+    usb_tx_flush(&usb);
+#if USB_SERIAL_DUAL
+    usb_tx_flush(&usb2);
+#endif
+}
+
+// NOTE: add a call to this function to CDC_TransmitCplt_FS() in usbd_cdc_if.c
+void usbTxComplete (void)
+{
+    usb_tx_complete(&usb);
+}
+
+// NOTE: add a call to this function to CDC_DeInit_FS() in usbd_cdc_if.c
+void usbTxAbort (void)
+{
+    usb_tx_abort(&usb);
+}
+
 // NOTE: add a call to this function as the first line CDC_Receive_FS() in usbd_cdc_if.c
-void usbBufferInput (uint8_t *data, uint32_t length)
+bool usbBufferInput (uint8_t *data, uint32_t length)
 {
-    while(length--) {
-        if(!enqueue_realtime_command(*data)) {                  // Check and strip realtime commands,
-            uint16_t next_head = BUFNEXT(rxbuf.head, rxbuf);    // Get and increment buffer pointer
-            if(next_head == rxbuf.tail)                         // If buffer full
-                rxbuf.overflow = 1;                             // flag overflow
-            else {
-                rxbuf.data[rxbuf.head] = *data;                 // if not add data to buffer
-                rxbuf.head = next_head;                         // and update pointer
-            }
-        }
-        data++;                                                 // next...
-    }
+    return usb_buffer_input(&usb, data, length);
+}
+
+#if USB_SERIAL_DUAL
+
+// NOTE: the following are called from the second CDC interface callbacks in usbd_cdc_if.c
+
+void usb2TxComplete (void)
+{
+    usb_tx_complete(&usb2);
 }
 
+void usb2TxAbort (void)
+{
+    usb_tx_abort(&usb2);
+}
+
+bool usb2BufferInput (uint8_t *data, uint32_t length)
+{
+    return usb_buffer_input(&usb2, data, length);
+}
+
+#endif // USB_SERIAL_DUAL
+
 #endif
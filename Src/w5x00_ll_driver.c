@@ -37,6 +37,8 @@ static volatile bool spin_lock = false;
 
 static void wizchip_select (void)
 {
+    spi_claim();
+
     if(prescaler != WIZCHIP_SPI_PRESCALER)
         prescaler = spi_set_speed(WIZCHIP_SPI_PRESCALER);
 
@@ -49,6 +51,8 @@ static void wizchip_deselect (void)
 
     if(prescaler != WIZCHIP_SPI_PRESCALER)
         spi_set_speed(prescaler);
+
+    spi_release();
 }
 
 static void wizchip_critical_section_lock(void)
@@ -28,6 +28,14 @@
 #include "usbd_cdc_if.h"
 
 /* USER CODE BEGIN Includes */
+#include "driver.h"
+#if USB_MSC_ENABLE
+#include "usbd_msc_if.h"
+#elif USB_SERIAL_DUAL
+#include "usbd_cdc_dual.h"
+#elif USB_NETWORK_ENABLE
+#include "usbd_cdc_ncm.h"
+#endif
 
 /* USER CODE END Includes */
 
@@ -73,10 +81,35 @@ void MX_USB_DEVICE_Init(void)
   {
     Error_Handler();
   }
+#if USB_MSC_ENABLE
+  if (USBD_RegisterClass(&hUsbDeviceFS, &USBD_CDC_MSC) != USBD_OK)
+  {
+    Error_Handler();
+  }
+  if (USBD_MSC_RegisterStorage(&hUsbDeviceFS, &USBD_Storage_fops_FS) != USBD_OK)
+  {
+    Error_Handler();
+  }
+#elif USB_SERIAL_DUAL
+  if (USBD_RegisterClass(&hUsbDeviceFS, &USBD_CDC_DUAL) != USBD_OK)
+  {
+    Error_Handler();
+  }
+  if (USBD_CDC2_RegisterInterface(&hUsbDeviceFS, &USBD_Interface2_fops_FS) != USBD_OK)
+  {
+    Error_Handler();
+  }
+#elif USB_NETWORK_ENABLE
+  if (USBD_RegisterClass(&hUsbDeviceFS, &USBD_CDC_NCM) != USBD_OK)
+  {
+    Error_Handler();
+  }
+#else
   if (USBD_RegisterClass(&hUsbDeviceFS, &USBD_CDC) != USBD_OK)
   {
     Error_Handler();
   }
+#endif
   if (USBD_CDC_RegisterInterface(&hUsbDeviceFS, &USBD_Interface_fops_FS) != USBD_OK)
   {
     Error_Handler();
@@ -0,0 +1,386 @@
+/*
+
+  usbd_cdc_dual.c - composite USB device with two CDC ACM interfaces
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  The first CDC ACM function (interfaces 0 and 1) is handled by the ST CDC class, this class wraps it
+  and adds a second function (interfaces 2 and 3) with its own endpoints and state.
+
+  Three IN endpoints are needed per function so the OTG FS core must have at least
+  six endpoints, e.g. STM32F412 and STM32F446.
+*/
+
+#include "driver.h"
+
+#if USB_SERIAL_DUAL
+
+#include <string.h>
+
+#include "usbd_cdc_dual.h"
+#include "usbd_ctlreq.h"
+
+static USBD_CDC_HandleTypeDef cdc2 = { .CmdOpCode = 0xFFU };
+static USBD_CDC_ItfTypeDef *fops2 = NULL;
+static volatile bool active = false;
+
+#define CDC_ACM_FUNCTION(comm_itf, data_itf, in_ep, out_ep, cmd_ep) \
+  /* Interface Association Descriptor */ \
+  0x08,                                       /* bLength */ \
+  0x0B,                                       /* bDescriptorType: IAD */ \
+  comm_itf,                                   /* bFirstInterface */ \
+  0x02,                                       /* bInterfaceCount */ \
+  0x02,                                       /* bFunctionClass: Communication Interface Class */ \
+  0x02,                                       /* bFunctionSubClass: Abstract Control Model */ \
+  0x01,                                       /* bFunctionProtocol: Common AT commands */ \
+  0x00,                                       /* iFunction */ \
+  /* CDC Interface Descriptor */ \
+  0x09,                                       /* bLength: Interface Descriptor size */ \
+  USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: Interface */ \
+  comm_itf,                                   /* bInterfaceNumber: Number of Interface */ \
+  0x00,                                       /* bAlternateSetting: Alternate setting */ \
+  0x01,                                       /* bNumEndpoints: One endpoints used */ \
+  0x02,                                       /* bInterfaceClass: Communication Interface Class */ \
+  0x02,                                       /* bInterfaceSubClass: Abstract Control Model */ \
+  0x01,                                       /* bInterfaceProtocol: Common AT commands */ \
+  0x00,                                       /* iInterface: */ \
+  /* Header Functional Descriptor */ \
+  0x05,                                       /* bLength: Endpoint Descriptor size */ \
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */ \
+  0x00,                                       /* bDescriptorSubtype: Header Func Desc */ \
+  0x10,                                       /* bcdCDC: spec release number */ \
+  0x01, \
+  /* Call Management Functional Descriptor */ \
+  0x05,                                       /* bFunctionLength */ \
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */ \
+  0x01,                                       /* bDescriptorSubtype: Call Management Func Desc */ \
+  0x00,                                       /* bmCapabilities: D0+D1 */ \
+  data_itf,                                   /* bDataInterface */ \
+  /* ACM Functional Descriptor */ \
+  0x04,                                       /* bFunctionLength */ \
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */ \
+  0x02,                                       /* bDescriptorSubtype: Abstract Control Management desc */ \
+  0x02,                                       /* bmCapabilities */ \
+  /* Union Functional Descriptor */ \
+  0x05,                                       /* bFunctionLength */ \
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */ \
+  0x06,                                       /* bDescriptorSubtype: Union func desc */ \
+  comm_itf,                                   /* bMasterInterface: Communication class interface */ \
+  data_itf,                                   /* bSlaveInterface0: Data Class Interface */ \
+  /* CDC Command Endpoint Descriptor */ \
+  0x07,                                       /* bLength: Endpoint Descriptor size */ \
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */ \
+  cmd_ep,                                     /* bEndpointAddress */ \
+  0x03,                                       /* bmAttributes: Interrupt */ \
+  LOBYTE(CDC_CMD_PACKET_SIZE),                /* wMaxPacketSize: */ \
+  HIBYTE(CDC_CMD_PACKET_SIZE), \
+  CDC_FS_BINTERVAL,                           /* bInterval: */ \
+  /* CDC Data Interface Descriptor */ \
+  0x09,                                       /* bLength: Endpoint Descriptor size */ \
+  USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: */ \
+  data_itf,                                   /* bInterfaceNumber: Number of Interface */ \
+  0x00,                                       /* bAlternateSetting: Alternate setting */ \
+  0x02,                                       /* bNumEndpoints: Two endpoints used */ \
+  0x0A,                                       /* bInterfaceClass: CDC */ \
+  0x00,                                       /* bInterfaceSubClass: */ \
+  0x00,                                       /* bInterfaceProtocol: */ \
+  0x00,                                       /* iInterface: */ \
+  /* CDC Data OUT Endpoint Descriptor */ \
+  0x07,                                       /* bLength: Endpoint Descriptor size */ \
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */ \
+  out_ep,                                     /* bEndpointAddress */ \
+  0x02,                                       /* bmAttributes: Bulk */ \
+  LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),        /* wMaxPacketSize: */ \
+  HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE), \
+  0x00,                                       /* bInterval: ignore for Bulk transfer */ \
+  /* CDC Data IN Endpoint Descriptor */ \
+  0x07,                                       /* bLength: Endpoint Descriptor size */ \
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */ \
+  in_ep,                                      /* bEndpointAddress */ \
+  0x02,                                       /* bmAttributes: Bulk */ \
+  LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),        /* wMaxPacketSize: */ \
+  HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE), \
+  0x00                                        /* bInterval: ignore for Bulk transfer */
+
+__ALIGN_BEGIN static uint8_t USBD_CDC_DUAL_CfgFSDesc[USB_CDC_DUAL_CONFIG_DESC_SIZ] __ALIGN_END =
+{
+  /* Configuration Descriptor */
+  0x09,                                       /* bLength: Configuration Descriptor size */
+  USB_DESC_TYPE_CONFIGURATION,                /* bDescriptorType: Configuration */
+  LOBYTE(USB_CDC_DUAL_CONFIG_DESC_SIZ),       /* wTotalLength */
+  HIBYTE(USB_CDC_DUAL_CONFIG_DESC_SIZ),
+  0x04,                                       /* bNumInterfaces: 4 interfaces */
+  0x01,                                       /* bConfigurationValue: Configuration value */
+  0x00,                                       /* iConfiguration: Index of string descriptor describing the configuration */
+  0xC0,                                       /* bmAttributes: self powered */
+  0x32,                                       /* MaxPower 100 mA */
+
+  CDC_ACM_FUNCTION(0x00, 0x01, CDC_IN_EP, CDC_OUT_EP, CDC_CMD_EP),
+  CDC_ACM_FUNCTION(CDC2_COMM_INTERFACE, CDC2_DATA_INTERFACE, CDC2_IN_EP, CDC2_OUT_EP, CDC2_CMD_EP)
+};
+
+/*
+ * Second CDC ACM function, mirrors the ST CDC class
+ */
+
+static uint8_t cdc2_setup (USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    static uint8_t ifalt = 0;
+    static uint16_t status_info = 0;
+
+    switch(req->bmRequest & USB_REQ_TYPE_MASK) {
+
+        case USB_REQ_TYPE_CLASS:
+            if(req->wLength == 0)
+                fops2->Control(req->bRequest, (uint8_t *)req, 0);
+            else if(req->bmRequest & 0x80U) {
+                fops2->Control(req->bRequest, (uint8_t *)cdc2.data, req->wLength);
+                USBD_CtlSendData(pdev, (uint8_t *)cdc2.data, req->wLength);
+            } else {
+                cdc2.CmdOpCode = req->bRequest;
+                cdc2.CmdLength = (uint8_t)req->wLength;
+                USBD_CtlPrepareRx(pdev, (uint8_t *)cdc2.data, req->wLength);
+            }
+            break;
+
+        case USB_REQ_TYPE_STANDARD:
+            switch(req->bRequest) {
+
+                case USB_REQ_GET_STATUS:
+                    USBD_CtlSendData(pdev, (uint8_t *)&status_info, 2);
+                    break;
+
+                case USB_REQ_GET_INTERFACE:
+                    USBD_CtlSendData(pdev, &ifalt, 1);
+                    break;
+
+                case USB_REQ_SET_INTERFACE:
+                case USB_REQ_CLEAR_FEATURE:
+                    break;
+
+                default:
+                    USBD_CtlError(pdev, req);
+                    return USBD_FAIL;
+            }
+            break;
+
+        default:
+            USBD_CtlError(pdev, req);
+            return USBD_FAIL;
+    }
+
+    return USBD_OK;
+}
+
+/*
+ * Composite class callbacks
+ */
+
+static uint8_t USBD_CDC_DUAL_Init (USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    uint8_t ret = USBD_CDC.Init(pdev, cfgidx);
+
+    if(ret == USBD_OK && fops2) {
+
+        USBD_LL_OpenEP(pdev, CDC2_IN_EP, USBD_EP_TYPE_BULK, CDC_DATA_FS_IN_PACKET_SIZE);
+        pdev->ep_in[CDC2_IN_EP & 0xFU].is_used = 1U;
+
+        USBD_LL_OpenEP(pdev, CDC2_OUT_EP, USBD_EP_TYPE_BULK, CDC_DATA_FS_OUT_PACKET_SIZE);
+        pdev->ep_out[CDC2_OUT_EP & 0xFU].is_used = 1U;
+
+        pdev->ep_in[CDC2_CMD_EP & 0xFU].bInterval = CDC_FS_BINTERVAL;
+        USBD_LL_OpenEP(pdev, CDC2_CMD_EP, USBD_EP_TYPE_INTR, CDC_CMD_PACKET_SIZE);
+        pdev->ep_in[CDC2_CMD_EP & 0xFU].is_used = 1U;
+
+        cdc2.CmdOpCode = 0xFFU;
+        cdc2.TxState = cdc2.RxState = 0U;
+        fops2->Init();
+        active = true;
+
+        USBD_LL_PrepareReceive(pdev, CDC2_OUT_EP, cdc2.RxBuffer, CDC_DATA_FS_OUT_PACKET_SIZE);
+    }
+
+    return ret;
+}
+
+static uint8_t USBD_CDC_DUAL_DeInit (USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    USBD_LL_CloseEP(pdev, CDC2_IN_EP);
+    pdev->ep_in[CDC2_IN_EP & 0xFU].is_used = 0U;
+
+    USBD_LL_CloseEP(pdev, CDC2_OUT_EP);
+    pdev->ep_out[CDC2_OUT_EP & 0xFU].is_used = 0U;
+
+    USBD_LL_CloseEP(pdev, CDC2_CMD_EP);
+    pdev->ep_in[CDC2_CMD_EP & 0xFU].is_used = 0U;
+    pdev->ep_in[CDC2_CMD_EP & 0xFU].bInterval = 0U;
+
+    if(active) {
+        active = false;
+        fops2->DeInit();
+    }
+
+    return USBD_CDC.DeInit(pdev, cfgidx);
+}
+
+static uint8_t USBD_CDC_DUAL_Setup (USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    if((req->bmRequest & USB_REQ_RECIPIENT_MASK) == USB_REQ_RECIPIENT_INTERFACE &&
+         (LOBYTE(req->wIndex) == CDC2_COMM_INTERFACE || LOBYTE(req->wIndex) == CDC2_DATA_INTERFACE))
+        return active ? cdc2_setup(pdev, req) : USBD_FAIL;
+
+    return USBD_CDC.Setup(pdev, req);
+}
+
+static uint8_t USBD_CDC_DUAL_EP0_RxReady (USBD_HandleTypeDef *pdev)
+{
+    if(cdc2.CmdOpCode != 0xFFU) {
+        if(active)
+            fops2->Control(cdc2.CmdOpCode, (uint8_t *)cdc2.data, (uint16_t)cdc2.CmdLength);
+        cdc2.CmdOpCode = 0xFFU;
+        return USBD_OK;
+    }
+
+    return USBD_CDC.EP0_RxReady(pdev);
+}
+
+static uint8_t USBD_CDC_DUAL_DataIn (USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    if(epnum == (CDC2_CMD_EP & 0x7FU))
+        return USBD_OK;
+
+    if(epnum != (CDC2_IN_EP & 0x7FU))
+        return USBD_CDC.DataIn(pdev, epnum);
+
+    PCD_HandleTypeDef *hpcd = pdev->pData;
+
+    // Terminate transfers that are a multiple of the packet size with a zero length packet
+    if(pdev->ep_in[epnum].total_length > 0U && (pdev->ep_in[epnum].total_length % hpcd->IN_ep[epnum].maxpacket) == 0U) {
+        pdev->ep_in[epnum].total_length = 0U;
+        USBD_LL_Transmit(pdev, epnum, NULL, 0U);
+    } else {
+        cdc2.TxState = 0U;
+        if(active)
+            fops2->TransmitCplt(cdc2.TxBuffer, &cdc2.TxLength, epnum);
+    }
+
+    return USBD_OK;
+}
+
+static uint8_t USBD_CDC_DUAL_DataOut (USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    if(epnum != CDC2_OUT_EP)
+        return USBD_CDC.DataOut(pdev, epnum);
+
+    cdc2.RxLength = USBD_LL_GetRxDataSize(pdev, epnum);
+
+    if(active)
+        fops2->Receive(cdc2.RxBuffer, &cdc2.RxLength);
+
+    return USBD_OK;
+}
+
+static uint8_t *USBD_CDC_DUAL_GetCfgDesc (uint16_t *length)
+{
+    *length = (uint16_t)sizeof(USBD_CDC_DUAL_CfgFSDesc);
+
+    return USBD_CDC_DUAL_CfgFSDesc;
+}
+
+static uint8_t *USBD_CDC_DUAL_GetDeviceQualifierDescriptor (uint16_t *length)
+{
+    return USBD_CDC.GetDeviceQualifierDescriptor(length);
+}
+
+USBD_ClassTypeDef USBD_CDC_DUAL = {
+    .Init = USBD_CDC_DUAL_Init,
+    .DeInit = USBD_CDC_DUAL_DeInit,
+    .Setup = USBD_CDC_DUAL_Setup,
+    .EP0_RxReady = USBD_CDC_DUAL_EP0_RxReady,
+    .DataIn = USBD_CDC_DUAL_DataIn,
+    .DataOut = USBD_CDC_DUAL_DataOut,
+    .GetHSConfigDescriptor = USBD_CDC_DUAL_GetCfgDesc,
+    .GetFSConfigDescriptor = USBD_CDC_DUAL_GetCfgDesc,
+    .GetOtherSpeedConfigDescriptor = USBD_CDC_DUAL_GetCfgDesc,
+    .GetDeviceQualifierDescriptor = USBD_CDC_DUAL_GetDeviceQualifierDescriptor
+};
+
+/*
+ * Second CDC ACM function API
+ */
+
+uint8_t USBD_CDC2_RegisterInterface (USBD_HandleTypeDef *pdev, USBD_CDC_ItfTypeDef *fops)
+{
+    UNUSED(pdev);
+
+    if(fops == NULL)
+        return USBD_FAIL;
+
+    fops2 = fops;
+
+    return USBD_OK;
+}
+
+uint8_t USBD_CDC2_SetTxBuffer (USBD_HandleTypeDef *pdev, uint8_t *pbuff, uint32_t length)
+{
+    UNUSED(pdev);
+
+    cdc2.TxBuffer = pbuff;
+    cdc2.TxLength = length;
+
+    return USBD_OK;
+}
+
+uint8_t USBD_CDC2_SetRxBuffer (USBD_HandleTypeDef *pdev, uint8_t *pbuff)
+{
+    UNUSED(pdev);
+
+    cdc2.RxBuffer = pbuff;
+
+    return USBD_OK;
+}
+
+uint8_t USBD_CDC2_ReceivePacket (USBD_HandleTypeDef *pdev)
+{
+    if(!active)
+        return USBD_FAIL;
+
+    USBD_LL_PrepareReceive(pdev, CDC2_OUT_EP, cdc2.RxBuffer, CDC_DATA_FS_OUT_PACKET_SIZE);
+
+    return USBD_OK;
+}
+
+uint8_t USBD_CDC2_TransmitPacket (USBD_HandleTypeDef *pdev)
+{
+    if(!active)
+        return USBD_FAIL;
+
+    if(cdc2.TxState != 0U)
+        return USBD_BUSY;
+
+    cdc2.TxState = 1U;
+    pdev->ep_in[CDC2_IN_EP & 0xFU].total_length = cdc2.TxLength;
+    USBD_LL_Transmit(pdev, CDC2_IN_EP, cdc2.TxBuffer, cdc2.TxLength);
+
+    return USBD_OK;
+}
+
+#endif // USB_SERIAL_DUAL
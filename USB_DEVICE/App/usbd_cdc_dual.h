@@ -0,0 +1,47 @@
+/*
+
+  usbd_cdc_dual.h - composite USB device with two CDC ACM interfaces
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "usbd_cdc.h"
+
+#define CDC2_IN_EP              0x83U
+#define CDC2_OUT_EP             0x03U
+#define CDC2_CMD_EP             0x84U
+#define CDC2_COMM_INTERFACE     0x02U
+#define CDC2_DATA_INTERFACE     0x03U
+
+#define USB_CDC_DUAL_CONFIG_DESC_SIZ 141U
+
+extern USBD_ClassTypeDef USBD_CDC_DUAL;
+
+// The first interface is handled by the ST CDC class and its USBD_CDC_xxx() functions,
+// the following are the equivalents for the second interface.
+
+uint8_t USBD_CDC2_RegisterInterface (USBD_HandleTypeDef *pdev, USBD_CDC_ItfTypeDef *fops);
+uint8_t USBD_CDC2_SetTxBuffer (USBD_HandleTypeDef *pdev, uint8_t *pbuff, uint32_t length);
+uint8_t USBD_CDC2_SetRxBuffer (USBD_HandleTypeDef *pdev, uint8_t *pbuff);
+uint8_t USBD_CDC2_ReceivePacket (USBD_HandleTypeDef *pdev);
+uint8_t USBD_CDC2_TransmitPacket (USBD_HandleTypeDef *pdev);
+
+/*EOF*/
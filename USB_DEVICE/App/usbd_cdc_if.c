@@ -25,6 +25,9 @@
 /* USER CODE BEGIN INCLUDE */
 #include "driver.h"
 #include "usb_serial.h"
+#if USB_SERIAL_DUAL
+#include "usbd_cdc_dual.h"
+#endif
 /* USER CODE END INCLUDE */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -96,6 +99,11 @@ uint8_t UserRxBufferFS[APP_RX_DATA_SIZE];
 uint8_t UserTxBufferFS[APP_TX_DATA_SIZE];
 
 /* USER CODE BEGIN PRIVATE_VARIABLES */
+static volatile bool rx_paused = false;
+#if USB_SERIAL_DUAL
+static uint8_t UserRx2BufferFS[CDC_DATA_FS_MAX_PACKET_SIZE];
+static volatile bool rx2_paused = false;
+#endif
 
 /* USER CODE END PRIVATE_VARIABLES */
 
@@ -130,6 +138,22 @@ static int8_t CDC_Receive_FS(uint8_t* pbuf, uint32_t *Len);
 static int8_t CDC_TransmitCplt_FS(uint8_t *pbuf, uint32_t *Len, uint8_t epnum);
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_DECLARATION */
+#if USB_SERIAL_DUAL
+static int8_t CDC2_Init_FS(void);
+static int8_t CDC2_DeInit_FS(void);
+static int8_t CDC2_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length);
+static int8_t CDC2_Receive_FS(uint8_t* pbuf, uint32_t *Len);
+static int8_t CDC2_TransmitCplt_FS(uint8_t *pbuf, uint32_t *Len, uint8_t epnum);
+
+USBD_CDC_ItfTypeDef USBD_Interface2_fops_FS =
+{
+  CDC2_Init_FS,
+  CDC2_DeInit_FS,
+  CDC2_Control_FS,
+  CDC2_Receive_FS,
+  CDC2_TransmitCplt_FS
+};
+#endif
 
 /* USER CODE END PRIVATE_FUNCTIONS_DECLARATION */
 
@@ -157,6 +181,7 @@ static int8_t CDC_Init_FS(void)
   /* Set Application Buffers */
   USBD_CDC_SetTxBuffer(&hUsbDeviceFS, UserTxBufferFS, 0);
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
+  rx_paused = false;
   return (USBD_OK);
   /* USER CODE END 3 */
 }
@@ -168,6 +193,9 @@ static int8_t CDC_Init_FS(void)
 static int8_t CDC_DeInit_FS(void)
 {
   /* USER CODE BEGIN 4 */
+#if USB_SERIAL_CDC
+  usbTxAbort();
+#endif
   return (USBD_OK);
   /* USER CODE END 4 */
 }
@@ -265,7 +293,12 @@ static int8_t CDC_Receive_FS(uint8_t* Buf, uint32_t *Len)
 {
   /* USER CODE BEGIN 6 */
 #if USB_SERIAL_CDC
-  usbBufferInput(Buf, *Len);
+  // Leave the OUT endpoint NAKing if there is no room for another packet,
+  // reception is resumed by CDC_ReceiveResume_FS() when the input buffer is drained.
+  if(!usbBufferInput(Buf, *Len)) {
+    rx_paused = true;
+    return (USBD_OK);
+  }
 #endif
   USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
   USBD_CDC_ReceivePacket(&hUsbDeviceFS);
@@ -289,6 +322,9 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
   uint8_t result = USBD_OK;
   /* USER CODE BEGIN 7 */
   USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
+  if (hcdc == NULL){
+    return USBD_FAIL;
+  }
   if (hcdc->TxState != 0){
     return USBD_BUSY;
   }
@@ -317,12 +353,130 @@ static int8_t CDC_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
   UNUSED(Buf);
   UNUSED(Len);
   UNUSED(epnum);
+#if USB_SERIAL_CDC
+  usbTxComplete();
+#endif
   /* USER CODE END 13 */
   return result;
 }
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
+/**
+  * @brief  CDC_ReceiveResume_FS
+  *         Rearms the OUT endpoint if reception was paused by CDC_Receive_FS.
+  * @retval None
+  */
+void CDC_ReceiveResume_FS(void)
+{
+  HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+
+  if(rx_paused) {
+    rx_paused = false;
+    USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
+    USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+  }
+
+  HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+}
+
+#if USB_SERIAL_DUAL
+
+/*
+ * Second CDC ACM interface, see usbd_cdc_dual.c.
+ * Line coding is not used, only the control line state is tracked.
+ */
+
+static int8_t CDC2_Init_FS(void)
+{
+  USBD_CDC2_SetTxBuffer(&hUsbDeviceFS, NULL, 0);
+  USBD_CDC2_SetRxBuffer(&hUsbDeviceFS, UserRx2BufferFS);
+  rx2_paused = false;
+  return (USBD_OK);
+}
+
+static int8_t CDC2_DeInit_FS(void)
+{
+  usb2TxAbort();
+  return (USBD_OK);
+}
+
+static int8_t CDC2_Control_FS(uint8_t cmd, uint8_t* pbuf, uint16_t length)
+{
+  UNUSED(length);
+
+  switch(cmd)
+  {
+    case CDC_GET_LINE_CODING: // report 115200 8N1
+      pbuf[0] = 0x00;
+      pbuf[1] = 0xC2;
+      pbuf[2] = 0x01;
+      pbuf[3] = 0x00;
+      pbuf[4] = 0;
+      pbuf[5] = 0;
+      pbuf[6] = 8;
+    break;
+
+    case CDC_SET_CONTROL_LINE_STATE:
+        usb2_linestate.pin.value = pbuf[2];
+        usb2_linestate.timestamp = hal.get_elapsed_ticks();
+    break;
+
+  default:
+    break;
+  }
+  return (USBD_OK);
+}
+
+static int8_t CDC2_Receive_FS(uint8_t* Buf, uint32_t *Len)
+{
+  if(!usb2BufferInput(Buf, *Len)) {
+    rx2_paused = true;
+    return (USBD_OK);
+  }
+  USBD_CDC2_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
+  USBD_CDC2_ReceivePacket(&hUsbDeviceFS);
+  return (USBD_OK);
+}
+
+static int8_t CDC2_TransmitCplt_FS(uint8_t *Buf, uint32_t *Len, uint8_t epnum)
+{
+  UNUSED(Buf);
+  UNUSED(Len);
+  UNUSED(epnum);
+  usb2TxComplete();
+  return (USBD_OK);
+}
+
+/**
+  * @brief  CDC2_Transmit_FS
+  *         Data to send over the second CDC interface IN endpoint.
+  * @retval USBD_OK if all operations are OK else USBD_FAIL or USBD_BUSY
+  */
+uint8_t CDC2_Transmit_FS(uint8_t* Buf, uint16_t Len)
+{
+  USBD_CDC2_SetTxBuffer(&hUsbDeviceFS, Buf, Len);
+  return USBD_CDC2_TransmitPacket(&hUsbDeviceFS);
+}
+
+/**
+  * @brief  CDC2_ReceiveResume_FS
+  *         Rearms the second CDC interface OUT endpoint if reception was paused by CDC2_Receive_FS.
+  * @retval None
+  */
+void CDC2_ReceiveResume_FS(void)
+{
+  HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+  if(rx2_paused) {
+    rx2_paused = false;
+    USBD_CDC2_SetRxBuffer(&hUsbDeviceFS, UserRx2BufferFS);
+    USBD_CDC2_ReceivePacket(&hUsbDeviceFS);
+  }
+  HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+}
+
+#endif // USB_SERIAL_DUAL
+
 /* USER CODE END PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
 /**
@@ -95,6 +95,7 @@
 extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 
 /* USER CODE BEGIN EXPORTED_VARIABLES */
+extern USBD_CDC_ItfTypeDef USBD_Interface2_fops_FS;
 
 /* USER CODE END EXPORTED_VARIABLES */
 
@@ -110,6 +111,9 @@ extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
+void CDC_ReceiveResume_FS(void);
+uint8_t CDC2_Transmit_FS(uint8_t* Buf, uint16_t Len);
+void CDC2_ReceiveResume_FS(void);
 
 /* USER CODE END EXPORTED_FUNCTIONS */
 
@@ -0,0 +1,798 @@
+/*
+
+  usbd_cdc_msc.c - composite USB CDC ACM + Mass Storage (Bulk-Only Transport) class
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  The CDC interfaces are handled by the ST CDC class, this class wraps it and adds
+  a mass storage interface with a single LUN.
+
+  SCSI commands are decoded in the USB interrupt, sector reads and writes are deferred to the
+  foreground by USBD_MSC_Process() since the storage (SD card) shares the SPI bus with FatFs.
+  The bulk endpoints are left NAKing while a sector transfer is pending.
+*/
+
+#include "driver.h"
+
+#if USB_MSC_ENABLE
+
+#include <string.h>
+#include <stdbool.h>
+
+#include "usbd_cdc_msc.h"
+#include "usbd_ctlreq.h"
+#include "usbd_ioreq.h"
+
+#define BOT_GET_MAX_LUN         0xFEU
+#define BOT_RESET               0xFFU
+
+#define CBW_SIGNATURE           0x43425355U
+#define CSW_SIGNATURE           0x53425355U
+#define CBW_LENGTH              31U
+#define CSW_LENGTH              13U
+#define CBW_FLAG_IN             0x80U
+
+#define CSW_CMD_PASSED          0x00U
+#define CSW_CMD_FAILED          0x01U
+
+#define SCSI_TEST_UNIT_READY            0x00U
+#define SCSI_REQUEST_SENSE              0x03U
+#define SCSI_INQUIRY                    0x12U
+#define SCSI_MODE_SENSE6                0x1AU
+#define SCSI_START_STOP_UNIT            0x1BU
+#define SCSI_PREVENT_ALLOW_REMOVAL      0x1EU
+#define SCSI_READ_FORMAT_CAPACITIES     0x23U
+#define SCSI_READ_CAPACITY10            0x25U
+#define SCSI_READ10                     0x28U
+#define SCSI_WRITE10                    0x2AU
+#define SCSI_VERIFY10                   0x2FU
+#define SCSI_SYNCHRONIZE_CACHE10        0x35U
+#define SCSI_MODE_SENSE10               0x5AU
+
+#define SENSE_NO_SENSE          0x00U
+#define SENSE_NOT_READY         0x02U
+#define SENSE_MEDIUM_ERROR      0x03U
+#define SENSE_ILLEGAL_REQUEST   0x05U
+#define SENSE_UNIT_ATTENTION    0x06U
+#define SENSE_DATA_PROTECT      0x07U
+
+#define ASC_WRITE_FAULT         0x03U
+#define ASC_READ_ERROR          0x11U
+#define ASC_INVALID_COMMAND     0x20U
+#define ASC_ADDRESS_OUT_OF_RANGE 0x21U
+#define ASC_INVALID_FIELD_IN_CDB 0x24U
+#define ASC_WRITE_PROTECTED     0x27U
+#define ASC_MEDIUM_CHANGED      0x28U
+#define ASC_MEDIUM_NOT_PRESENT  0x3AU
+
+#define MSC_LOCK()   HAL_NVIC_DisableIRQ(OTG_FS_IRQn)
+#define MSC_UNLOCK() HAL_NVIC_EnableIRQ(OTG_FS_IRQn)
+
+typedef enum {
+    BOT_Idle = 0,       // waiting for CBW
+    BOT_DataIn,         // command response being sent, CSW follows
+    BOT_Read,           // READ(10) data being sent
+    BOT_Write,          // WRITE(10) data being received
+    BOT_Status,         // CSW being sent
+    BOT_StallStatus,    // data endpoint stalled, CSW is sent when the host clears the halt
+    BOT_Error           // invalid CBW, endpoints stalled until reset
+} bot_state_t;
+
+typedef struct {
+    volatile bot_state_t state;
+    volatile bool io_pending;
+    uint8_t status;
+    uint8_t sense_key;
+    uint8_t asc;
+    uint8_t flags;
+    uint32_t tag;
+    uint32_t residue;
+    uint32_t lba;
+    uint32_t blocks;
+    uint16_t chunk;
+    uint16_t block_size;
+    uint32_t block_count;
+} msc_t;
+
+static msc_t msc = {0};
+static USBD_MSC_StorageTypeDef *storage = NULL;
+
+__ALIGN_BEGIN static uint8_t cbw[MSC_MAX_FS_PACKET] __ALIGN_END;
+__ALIGN_BEGIN static uint8_t csw[CSW_LENGTH] __ALIGN_END;
+__ALIGN_BEGIN static uint8_t buf[USB_MSC_MEDIA_PACKET] __ALIGN_END;
+
+__ALIGN_BEGIN static uint8_t USBD_CDC_MSC_CfgFSDesc[USB_CDC_MSC_CONFIG_DESC_SIZ] __ALIGN_END =
+{
+  /* Configuration Descriptor */
+  0x09,                                       /* bLength: Configuration Descriptor size */
+  USB_DESC_TYPE_CONFIGURATION,                /* bDescriptorType: Configuration */
+  LOBYTE(USB_CDC_MSC_CONFIG_DESC_SIZ),        /* wTotalLength */
+  HIBYTE(USB_CDC_MSC_CONFIG_DESC_SIZ),
+  0x03,                                       /* bNumInterfaces: 3 interfaces */
+  0x01,                                       /* bConfigurationValue: Configuration value */
+  0x00,                                       /* iConfiguration: Index of string descriptor describing the configuration */
+  0xC0,                                       /* bmAttributes: self powered */
+  0x32,                                       /* MaxPower 100 mA */
+
+  /* Interface Association Descriptor: CDC */
+  0x08,                                       /* bLength */
+  0x0B,                                       /* bDescriptorType: IAD */
+  0x00,                                       /* bFirstInterface */
+  0x02,                                       /* bInterfaceCount */
+  0x02,                                       /* bFunctionClass: Communication Interface Class */
+  0x02,                                       /* bFunctionSubClass: Abstract Control Model */
+  0x01,                                       /* bFunctionProtocol: Common AT commands */
+  0x00,                                       /* iFunction */
+
+  /* CDC Interface Descriptor */
+  0x09,                                       /* bLength: Interface Descriptor size */
+  USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: Interface */
+  0x00,                                       /* bInterfaceNumber: Number of Interface */
+  0x00,                                       /* bAlternateSetting: Alternate setting */
+  0x01,                                       /* bNumEndpoints: One endpoints used */
+  0x02,                                       /* bInterfaceClass: Communication Interface Class */
+  0x02,                                       /* bInterfaceSubClass: Abstract Control Model */
+  0x01,                                       /* bInterfaceProtocol: Common AT commands */
+  0x00,                                       /* iInterface: */
+
+  /* Header Functional Descriptor */
+  0x05,                                       /* bLength: Endpoint Descriptor size */
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */
+  0x00,                                       /* bDescriptorSubtype: Header Func Desc */
+  0x10,                                       /* bcdCDC: spec release number */
+  0x01,
+
+  /* Call Management Functional Descriptor */
+  0x05,                                       /* bFunctionLength */
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */
+  0x01,                                       /* bDescriptorSubtype: Call Management Func Desc */
+  0x00,                                       /* bmCapabilities: D0+D1 */
+  0x01,                                       /* bDataInterface: 1 */
+
+  /* ACM Functional Descriptor */
+  0x04,                                       /* bFunctionLength */
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */
+  0x02,                                       /* bDescriptorSubtype: Abstract Control Management desc */
+  0x02,                                       /* bmCapabilities */
+
+  /* Union Functional Descriptor */
+  0x05,                                       /* bFunctionLength */
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */
+  0x06,                                       /* bDescriptorSubtype: Union func desc */
+  0x00,                                       /* bMasterInterface: Communication class interface */
+  0x01,                                       /* bSlaveInterface0: Data Class Interface */
+
+  /* CDC Command Endpoint Descriptor */
+  0x07,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */
+  CDC_CMD_EP,                                 /* bEndpointAddress */
+  0x03,                                       /* bmAttributes: Interrupt */
+  LOBYTE(CDC_CMD_PACKET_SIZE),                /* wMaxPacketSize: */
+  HIBYTE(CDC_CMD_PACKET_SIZE),
+  CDC_FS_BINTERVAL,                           /* bInterval: */
+
+  /* CDC Data Interface Descriptor */
+  0x09,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: */
+  0x01,                                       /* bInterfaceNumber: Number of Interface */
+  0x00,                                       /* bAlternateSetting: Alternate setting */
+  0x02,                                       /* bNumEndpoints: Two endpoints used */
+  0x0A,                                       /* bInterfaceClass: CDC */
+  0x00,                                       /* bInterfaceSubClass: */
+  0x00,                                       /* bInterfaceProtocol: */
+  0x00,                                       /* iInterface: */
+
+  /* CDC Data OUT Endpoint Descriptor */
+  0x07,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */
+  CDC_OUT_EP,                                 /* bEndpointAddress */
+  0x02,                                       /* bmAttributes: Bulk */
+  LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),        /* wMaxPacketSize: */
+  HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),
+  0x00,                                       /* bInterval: ignore for Bulk transfer */
+
+  /* CDC Data IN Endpoint Descriptor */
+  0x07,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */
+  CDC_IN_EP,                                  /* bEndpointAddress */
+  0x02,                                       /* bmAttributes: Bulk */
+  LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),        /* wMaxPacketSize: */
+  HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),
+  0x00,                                       /* bInterval: ignore for Bulk transfer */
+
+  /* Mass Storage Interface Descriptor */
+  0x09,                                       /* bLength: Interface Descriptor size */
+  USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: Interface */
+  MSC_INTERFACE,                              /* bInterfaceNumber: Number of Interface */
+  0x00,                                       /* bAlternateSetting: Alternate setting */
+  0x02,                                       /* bNumEndpoints: Two endpoints used */
+  0x08,                                       /* bInterfaceClass: Mass Storage */
+  0x06,                                       /* bInterfaceSubClass: SCSI transparent */
+  0x50,                                       /* bInterfaceProtocol: Bulk-Only Transport */
+  0x00,                                       /* iInterface: */
+
+  /* Mass Storage IN Endpoint Descriptor */
+  0x07,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */
+  MSC_IN_EP,                                  /* bEndpointAddress */
+  0x02,                                       /* bmAttributes: Bulk */
+  LOBYTE(MSC_MAX_FS_PACKET),                  /* wMaxPacketSize: */
+  HIBYTE(MSC_MAX_FS_PACKET),
+  0x00,                                       /* bInterval: ignore for Bulk transfer */
+
+  /* Mass Storage OUT Endpoint Descriptor */
+  0x07,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */
+  MSC_OUT_EP,                                 /* bEndpointAddress */
+  0x02,                                       /* bmAttributes: Bulk */
+  LOBYTE(MSC_MAX_FS_PACKET),                  /* wMaxPacketSize: */
+  HIBYTE(MSC_MAX_FS_PACKET),
+  0x00                                        /* bInterval: ignore for Bulk transfer */
+};
+
+static inline uint32_t get_le32 (const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint32_t get_be32 (const uint8_t *p)
+{
+    return (uint32_t)p[3] | ((uint32_t)p[2] << 8) | ((uint32_t)p[1] << 16) | ((uint32_t)p[0] << 24);
+}
+
+static inline uint16_t get_be16 (const uint8_t *p)
+{
+    return (uint16_t)p[1] | ((uint16_t)p[0] << 8);
+}
+
+static inline void put_le32 (uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static inline void put_be32 (uint8_t *p, uint32_t v)
+{
+    p[3] = (uint8_t)v;
+    p[2] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)(v >> 16);
+    p[0] = (uint8_t)(v >> 24);
+}
+
+/*
+ * Bulk-Only Transport
+ */
+
+static void msc_receive_cbw (USBD_HandleTypeDef *pdev)
+{
+    msc.state = BOT_Idle;
+    USBD_LL_PrepareReceive(pdev, MSC_OUT_EP, cbw, MSC_MAX_FS_PACKET);
+}
+
+static void msc_send_csw (USBD_HandleTypeDef *pdev, uint8_t status)
+{
+    put_le32(&csw[0], CSW_SIGNATURE);
+    put_le32(&csw[4], msc.tag);
+    put_le32(&csw[8], msc.residue);
+    csw[12] = status;
+
+    msc.state = BOT_Status;
+    USBD_LL_Transmit(pdev, MSC_IN_EP, csw, CSW_LENGTH);
+}
+
+// Fails the current command, the data endpoint is stalled if the host expects more data.
+static void msc_fail (USBD_HandleTypeDef *pdev, uint8_t sense_key, uint8_t asc)
+{
+    msc.sense_key = sense_key;
+    msc.asc = asc;
+    msc.status = CSW_CMD_FAILED;
+
+    if(msc.residue) {
+        msc.state = BOT_StallStatus;
+        USBD_LL_StallEP(pdev, (msc.flags & CBW_FLAG_IN) ? MSC_IN_EP : MSC_OUT_EP);
+    } else
+        msc_send_csw(pdev, CSW_CMD_FAILED);
+}
+
+// Sends length bytes of response data from buf, CSW follows.
+static void msc_send_data (USBD_HandleTypeDef *pdev, uint32_t length)
+{
+    if(msc.residue == 0)
+        msc_send_csw(pdev, CSW_CMD_PASSED);
+    else if(!(msc.flags & CBW_FLAG_IN))
+        msc_fail(pdev, SENSE_ILLEGAL_REQUEST, ASC_INVALID_FIELD_IN_CDB);
+    else {
+        if(length > msc.residue)
+            length = msc.residue;
+        msc.residue -= length;
+        msc.status = CSW_CMD_PASSED;
+        msc.state = BOT_DataIn;
+        USBD_LL_Transmit(pdev, MSC_IN_EP, buf, length);
+    }
+}
+
+static void msc_receive_chunk (USBD_HandleTypeDef *pdev)
+{
+    msc.chunk = msc.blocks > USB_MSC_MEDIA_PACKET / msc.block_size ? USB_MSC_MEDIA_PACKET / msc.block_size : (uint16_t)msc.blocks;
+
+    USBD_LL_PrepareReceive(pdev, MSC_OUT_EP, buf, msc.chunk * msc.block_size);
+}
+
+static void msc_reset (USBD_HandleTypeDef *pdev)
+{
+    msc.io_pending = false;
+    USBD_LL_ClearStallEP(pdev, MSC_IN_EP);
+    USBD_LL_ClearStallEP(pdev, MSC_OUT_EP);
+    msc_receive_cbw(pdev);
+}
+
+/*
+ * SCSI
+ */
+
+// Returns true if the medium is ready, fails the command if not.
+static bool msc_medium_ready (USBD_HandleTypeDef *pdev)
+{
+    switch(storage ? storage->GetState() : MSC_MediumNotPresent) {
+
+        case MSC_MediumReady:
+            if(storage->GetCapacity(&msc.block_count, &msc.block_size) == 0 && msc.block_size)
+                return true;
+            break;
+
+        case MSC_MediumChanged:
+            msc_fail(pdev, SENSE_UNIT_ATTENTION, ASC_MEDIUM_CHANGED);
+            return false;
+
+        default:
+            break;
+    }
+
+    msc_fail(pdev, SENSE_NOT_READY, ASC_MEDIUM_NOT_PRESENT);
+
+    return false;
+}
+
+static void msc_read_write (USBD_HandleTypeDef *pdev, const uint8_t *cb, bool write)
+{
+    if(!msc_medium_ready(pdev))
+        return;
+
+    if(write && storage->IsWriteProtected()) {
+        msc_fail(pdev, SENSE_DATA_PROTECT, ASC_WRITE_PROTECTED);
+        return;
+    }
+
+    msc.lba = get_be32(&cb[2]);
+    msc.blocks = get_be16(&cb[7]);
+
+    if(msc.lba + msc.blocks > msc.block_count) {
+        msc_fail(pdev, SENSE_ILLEGAL_REQUEST, ASC_ADDRESS_OUT_OF_RANGE);
+        return;
+    }
+
+    if(msc.residue != msc.blocks * msc.block_size || (msc.blocks && !(msc.flags & CBW_FLAG_IN) != write)) {
+        msc_fail(pdev, SENSE_ILLEGAL_REQUEST, ASC_INVALID_FIELD_IN_CDB);
+        return;
+    }
+
+    msc.status = CSW_CMD_PASSED;
+
+    if(msc.blocks == 0)
+        msc_send_csw(pdev, CSW_CMD_PASSED);
+    else if(write) {
+        msc.state = BOT_Write;
+        msc_receive_chunk(pdev);
+    } else {
+        msc.state = BOT_Read;
+        msc.io_pending = true;
+    }
+}
+
+static void msc_scsi (USBD_HandleTypeDef *pdev, const uint8_t *cb)
+{
+    switch(cb[0]) {
+
+        case SCSI_TEST_UNIT_READY:
+            if(msc_medium_ready(pdev))
+                msc_send_csw(pdev, CSW_CMD_PASSED);
+            break;
+
+        case SCSI_REQUEST_SENSE:
+            memset(buf, 0, 18);
+            buf[0] = 0x70;
+            buf[2] = msc.sense_key;
+            buf[7] = 10;
+            buf[12] = msc.asc;
+            msc.sense_key = msc.asc = 0;
+            msc_send_data(pdev, cb[4] < 18 ? cb[4] : 18);
+            break;
+
+        case SCSI_INQUIRY:
+            if(cb[1] & 0x01) { // EVPD, only the supported pages page is available
+                memset(buf, 0, 5);
+                msc_send_data(pdev, get_be16(&cb[3]) < 5 ? get_be16(&cb[3]) : 5);
+            } else if(storage) {
+                memcpy(buf, storage->pInquiry, 36);
+                msc_send_data(pdev, get_be16(&cb[3]) < 36 ? get_be16(&cb[3]) : 36);
+            } else
+                msc_fail(pdev, SENSE_NOT_READY, ASC_MEDIUM_NOT_PRESENT);
+            break;
+
+        case SCSI_MODE_SENSE6:
+            memset(buf, 0, 4);
+            buf[0] = 0x03;
+            buf[2] = storage && storage->IsWriteProtected() ? 0x80 : 0x00;
+            msc_send_data(pdev, cb[4] < 4 ? cb[4] : 4);
+            break;
+
+        case SCSI_MODE_SENSE10:
+            memset(buf, 0, 8);
+            buf[1] = 0x06;
+            buf[3] = storage && storage->IsWriteProtected() ? 0x80 : 0x00;
+            msc_send_data(pdev, get_be16(&cb[7]) < 8 ? get_be16(&cb[7]) : 8);
+            break;
+
+        case SCSI_START_STOP_UNIT:
+            if((cb[4] & 0x03) == 0x02 && storage && storage->Eject) // LoEj set, Start cleared
+                storage->Eject();
+            msc_send_csw(pdev, CSW_CMD_PASSED);
+            break;
+
+        case SCSI_PREVENT_ALLOW_REMOVAL:
+        case SCSI_VERIFY10:
+        case SCSI_SYNCHRONIZE_CACHE10: // writes are not cached
+            msc_send_csw(pdev, CSW_CMD_PASSED);
+            break;
+
+        case SCSI_READ_FORMAT_CAPACITIES:
+            if(msc_medium_ready(pdev)) {
+                memset(buf, 0, 12);
+                buf[3] = 0x08;
+                put_be32(&buf[4], msc.block_count);
+                buf[8] = 0x02; // formatted media
+                buf[10] = (uint8_t)(msc.block_size >> 8);
+                buf[11] = (uint8_t)msc.block_size;
+                msc_send_data(pdev, get_be16(&cb[7]) < 12 ? get_be16(&cb[7]) : 12);
+            }
+            break;
+
+        case SCSI_READ_CAPACITY10:
+            if(msc_medium_ready(pdev)) {
+                put_be32(&buf[0], msc.block_count - 1);
+                put_be32(&buf[4], msc.block_size);
+                msc_send_data(pdev, 8);
+            }
+            break;
+
+        case SCSI_READ10:
+            msc_read_write(pdev, cb, false);
+            break;
+
+        case SCSI_WRITE10:
+            msc_read_write(pdev, cb, true);
+            break;
+
+        default:
+            msc_fail(pdev, SENSE_ILLEGAL_REQUEST, ASC_INVALID_COMMAND);
+            break;
+    }
+}
+
+static void msc_decode_cbw (USBD_HandleTypeDef *pdev)
+{
+    if(USBD_LL_GetRxDataSize(pdev, MSC_OUT_EP) != CBW_LENGTH || get_le32(cbw) != CBW_SIGNATURE ||
+        cbw[13] != 0 || cbw[14] < 1 || cbw[14] > 16) {
+        msc.state = BOT_Error;
+        USBD_LL_StallEP(pdev, MSC_IN_EP);
+        USBD_LL_StallEP(pdev, MSC_OUT_EP);
+        return;
+    }
+
+    msc.tag = get_le32(&cbw[4]);
+    msc.residue = get_le32(&cbw[8]);
+    msc.flags = cbw[12];
+
+    msc_scsi(pdev, &cbw[15]);
+}
+
+static uint8_t msc_setup_interface (USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    static uint8_t data[2];
+
+    bool ok = true;
+
+    switch(req->bmRequest & USB_REQ_TYPE_MASK) {
+
+        case USB_REQ_TYPE_CLASS:
+            switch(req->bRequest) {
+
+                case BOT_GET_MAX_LUN:
+                    if((ok = req->wValue == 0 && req->wLength == 1 && (req->bmRequest & 0x80))) {
+                        data[0] = 0;
+                        USBD_CtlSendData(pdev, data, 1);
+                    }
+                    break;
+
+                case BOT_RESET:
+                    if((ok = req->wValue == 0 && req->wLength == 0 && !(req->bmRequest & 0x80)))
+                        msc_reset(pdev);
+                    break;
+
+                default:
+                    ok = false;
+                    break;
+            }
+            break;
+
+        case USB_REQ_TYPE_STANDARD:
+            switch(req->bRequest) {
+
+                case USB_REQ_GET_STATUS:
+                    data[0] = data[1] = 0;
+                    USBD_CtlSendData(pdev, data, 2);
+                    break;
+
+                case USB_REQ_GET_INTERFACE:
+                    data[0] = 0;
+                    USBD_CtlSendData(pdev, data, 1);
+                    break;
+
+                case USB_REQ_SET_INTERFACE:
+                    ok = req->wValue == 0;
+                    break;
+
+                default:
+                    ok = false;
+                    break;
+            }
+            break;
+
+        default:
+            ok = false;
+            break;
+    }
+
+    if(!ok)
+        USBD_CtlError(pdev, req);
+
+    return ok ? USBD_OK : USBD_FAIL;
+}
+
+// Called by the core after a CLEAR_FEATURE(ENDPOINT_HALT) request has been handled.
+static uint8_t msc_setup_endpoint (USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    if((req->bmRequest & USB_REQ_TYPE_MASK) == USB_REQ_TYPE_STANDARD && req->bRequest == USB_REQ_CLEAR_FEATURE) {
+        if(msc.state == BOT_Error) // the endpoints stay halted until a Bulk-Only reset
+            USBD_LL_StallEP(pdev, LOBYTE(req->wIndex));
+        else if(msc.state == BOT_StallStatus)
+            msc_send_csw(pdev, msc.status);
+    }
+
+    return USBD_OK;
+}
+
+/*
+ * Composite class callbacks
+ */
+
+static uint8_t USBD_CDC_MSC_Init (USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    uint8_t ret = USBD_CDC.Init(pdev, cfgidx);
+
+    if(ret == USBD_OK) {
+
+        USBD_LL_OpenEP(pdev, MSC_IN_EP, USBD_EP_TYPE_BULK, MSC_MAX_FS_PACKET);
+        pdev->ep_in[MSC_IN_EP & 0xFU].is_used = 1U;
+
+        USBD_LL_OpenEP(pdev, MSC_OUT_EP, USBD_EP_TYPE_BULK, MSC_MAX_FS_PACKET);
+        pdev->ep_out[MSC_OUT_EP & 0xFU].is_used = 1U;
+
+        if(storage)
+            storage->Init();
+
+        msc.sense_key = msc.asc = 0;
+        msc.io_pending = false;
+        msc_receive_cbw(pdev);
+    }
+
+    return ret;
+}
+
+static uint8_t USBD_CDC_MSC_DeInit (USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    msc.io_pending = false;
+    msc.state = BOT_Idle;
+
+    USBD_LL_CloseEP(pdev, MSC_IN_EP);
+    pdev->ep_in[MSC_IN_EP & 0xFU].is_used = 0U;
+
+    USBD_LL_CloseEP(pdev, MSC_OUT_EP);
+    pdev->ep_out[MSC_OUT_EP & 0xFU].is_used = 0U;
+
+    return USBD_CDC.DeInit(pdev, cfgidx);
+}
+
+static uint8_t USBD_CDC_MSC_Setup (USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    switch(req->bmRequest & USB_REQ_RECIPIENT_MASK) {
+
+        case USB_REQ_RECIPIENT_INTERFACE:
+            if(LOBYTE(req->wIndex) == MSC_INTERFACE)
+                return msc_setup_interface(pdev, req);
+            break;
+
+        case USB_REQ_RECIPIENT_ENDPOINT:
+            if((LOBYTE(req->wIndex) & 0x7FU) == (MSC_IN_EP & 0x7FU))
+                return msc_setup_endpoint(pdev, req);
+            break;
+    }
+
+    return USBD_CDC.Setup(pdev, req);
+}
+
+static uint8_t USBD_CDC_MSC_EP0_RxReady (USBD_HandleTypeDef *pdev)
+{
+    return USBD_CDC.EP0_RxReady(pdev);
+}
+
+static uint8_t USBD_CDC_MSC_DataIn (USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    if(epnum != (MSC_IN_EP & 0x7FU))
+        return USBD_CDC.DataIn(pdev, epnum);
+
+    switch(msc.state) {
+
+        case BOT_DataIn:
+            msc_send_csw(pdev, msc.status);
+            break;
+
+        case BOT_Read:
+            if(msc.blocks)
+                msc.io_pending = true;
+            else
+                msc_send_csw(pdev, CSW_CMD_PASSED);
+            break;
+
+        case BOT_Status:
+            msc_receive_cbw(pdev);
+            break;
+
+        default:
+            break;
+    }
+
+    return USBD_OK;
+}
+
+static uint8_t USBD_CDC_MSC_DataOut (USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    if(epnum != MSC_OUT_EP)
+        return USBD_CDC.DataOut(pdev, epnum);
+
+    switch(msc.state) {
+
+        case BOT_Idle:
+            msc_decode_cbw(pdev);
+            break;
+
+        case BOT_Write:
+            msc.io_pending = true;
+            break;
+
+        default:
+            break;
+    }
+
+    return USBD_OK;
+}
+
+static uint8_t *USBD_CDC_MSC_GetCfgDesc (uint16_t *length)
+{
+    *length = (uint16_t)sizeof(USBD_CDC_MSC_CfgFSDesc);
+
+    return USBD_CDC_MSC_CfgFSDesc;
+}
+
+static uint8_t *USBD_CDC_MSC_GetDeviceQualifierDescriptor (uint16_t *length)
+{
+    return USBD_CDC.GetDeviceQualifierDescriptor(length);
+}
+
+USBD_ClassTypeDef USBD_CDC_MSC = {
+    .Init = USBD_CDC_MSC_Init,
+    .DeInit = USBD_CDC_MSC_DeInit,
+    .Setup = USBD_CDC_MSC_Setup,
+    .EP0_RxReady = USBD_CDC_MSC_EP0_RxReady,
+    .DataIn = USBD_CDC_MSC_DataIn,
+    .DataOut = USBD_CDC_MSC_DataOut,
+    .GetHSConfigDescriptor = USBD_CDC_MSC_GetCfgDesc,
+    .GetFSConfigDescriptor = USBD_CDC_MSC_GetCfgDesc,
+    .GetOtherSpeedConfigDescriptor = USBD_CDC_MSC_GetCfgDesc,
+    .GetDeviceQualifierDescriptor = USBD_CDC_MSC_GetDeviceQualifierDescriptor
+};
+
+uint8_t USBD_MSC_RegisterStorage (USBD_HandleTypeDef *pdev, USBD_MSC_StorageTypeDef *fops)
+{
+    UNUSED(pdev);
+
+    if(fops == NULL)
+        return USBD_FAIL;
+
+    storage = fops;
+
+    return USBD_OK;
+}
+
+// Performs pending sector reads and writes, must be called regularly from the foreground.
+void USBD_MSC_Process (USBD_HandleTypeDef *pdev)
+{
+    if(!msc.io_pending || storage == NULL)
+        return;
+
+    msc.io_pending = false;
+
+    if(msc.state == BOT_Read) {
+
+        uint16_t chunk = msc.blocks > USB_MSC_MEDIA_PACKET / msc.block_size ? USB_MSC_MEDIA_PACKET / msc.block_size : (uint16_t)msc.blocks;
+        bool ok = storage->Read(buf, msc.lba, chunk) == 0;
+
+        MSC_LOCK();
+
+        if(msc.state == BOT_Read) { // may have been reset while reading
+            if(ok) {
+                msc.lba += chunk;
+                msc.blocks -= chunk;
+                msc.residue -= chunk * msc.block_size;
+                USBD_LL_Transmit(pdev, MSC_IN_EP, buf, chunk * msc.block_size);
+            } else
+                msc_fail(pdev, SENSE_MEDIUM_ERROR, ASC_READ_ERROR);
+        }
+
+        MSC_UNLOCK();
+
+    } else if(msc.state == BOT_Write) {
+
+        bool ok = storage->Write(buf, msc.lba, msc.chunk) == 0;
+
+        MSC_LOCK();
+
+        if(msc.state == BOT_Write) {
+            if(ok) {
+                msc.lba += msc.chunk;
+                msc.blocks -= msc.chunk;
+                msc.residue -= msc.chunk * msc.block_size;
+                if(msc.blocks)
+                    msc_receive_chunk(pdev);
+                else
+                    msc_send_csw(pdev, CSW_CMD_PASSED);
+            } else
+                msc_fail(pdev, SENSE_MEDIUM_ERROR, ASC_WRITE_FAULT);
+        }
+
+        MSC_UNLOCK();
+    }
+}
+
+#endif // USB_MSC_ENABLE
+
@@ -0,0 +1,63 @@
+/*
+
+  usbd_cdc_msc.h - composite USB CDC ACM + Mass Storage (Bulk-Only Transport) class
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "usbd_cdc.h"
+
+#define MSC_IN_EP               0x83U
+#define MSC_OUT_EP              0x03U
+#define MSC_MAX_FS_PACKET       64U
+#define MSC_INTERFACE           0x02U
+
+#define USB_CDC_MSC_CONFIG_DESC_SIZ 98U
+
+#ifndef USB_MSC_MEDIA_PACKET
+#define USB_MSC_MEDIA_PACKET    2048U // Must be a multiple of the block size (512)
+#endif
+
+typedef enum {
+    MSC_MediumReady = 0,
+    MSC_MediumNotPresent,
+    MSC_MediumChanged       // Ready, the host is notified with an unit attention condition
+} msc_medium_state_t;
+
+// Storage callbacks, Read() and Write() are called from the foreground via USBD_MSC_Process().
+// Return 0 on success.
+typedef struct {
+    int8_t (*Init)(void);
+    msc_medium_state_t (*GetState)(void);
+    int8_t (*GetCapacity)(uint32_t *block_num, uint16_t *block_size);
+    int8_t (*IsWriteProtected)(void);
+    int8_t (*Read)(uint8_t *buf, uint32_t blk_addr, uint16_t blk_len);
+    int8_t (*Write)(uint8_t *buf, uint32_t blk_addr, uint16_t blk_len);
+    void (*Eject)(void);
+    const uint8_t *pInquiry;    // 36 byte standard inquiry data
+} USBD_MSC_StorageTypeDef;
+
+extern USBD_ClassTypeDef USBD_CDC_MSC;
+
+uint8_t USBD_MSC_RegisterStorage (USBD_HandleTypeDef *pdev, USBD_MSC_StorageTypeDef *fops);
+void USBD_MSC_Process (USBD_HandleTypeDef *pdev);
+
+/*EOF*/
@@ -0,0 +1,807 @@
+/*
+
+  usbd_cdc_ncm.c - composite USB CDC ACM + CDC NCM (Network Control Model) class
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  The CDC ACM interfaces are handled by the ST CDC class, this class wraps it and adds
+  a CDC NCM function with 16-bit transfer blocks (NTB16) only.
+
+  Received transfer blocks are parsed in the foreground by USBD_NCM_Process(), the OUT endpoint
+  is left NAKing until then. Frames to the host are copied into one of two transfer blocks,
+  while one is being transmitted frames are batched in the other.
+*/
+
+#include "driver.h"
+
+#if USB_NETWORK_ENABLE
+
+#include <string.h>
+
+#include "usbd_cdc_ncm.h"
+#include "usbd_ctlreq.h"
+
+#define NCM_SET_ETHERNET_MULTICAST_FILTERS  0x40U
+#define NCM_SET_ETHERNET_PACKET_FILTER      0x43U
+#define NCM_GET_NTB_PARAMETERS              0x80U
+#define NCM_GET_NTB_FORMAT                  0x83U
+#define NCM_SET_NTB_FORMAT                  0x84U
+#define NCM_GET_NTB_INPUT_SIZE              0x85U
+#define NCM_SET_NTB_INPUT_SIZE              0x86U
+
+#define NCM_NOTIFY_NETWORK_CONNECTION       0x00U
+#define NCM_NOTIFY_SPEED_CHANGE             0x2AU
+
+#define NTH16_SIGNATURE         0x484D434EU // "NCMH"
+#define NDP16_SIGNATURE         0x304D434EU // "NCM0", no CRC
+#define NTH16_LENGTH            12U
+#define NDP16_LENGTH(n)         (8U + 4U * ((n) + 1U))
+#define NTB_ALIGN(i)            (((i) + 3U) & ~3U)
+#define NTB_IN_PAYLOAD_OFFSET   NTB_ALIGN(NTH16_LENGTH + NDP16_LENGTH(USB_NCM_MAX_DATAGRAMS))
+
+#define NCM_LOCK()   HAL_NVIC_DisableIRQ(OTG_FS_IRQn)
+#define NCM_UNLOCK() HAL_NVIC_EnableIRQ(OTG_FS_IRQn)
+
+typedef enum {
+    Notify_Idle = 0,
+    Notify_Speed,
+    Notify_Connection
+} ncm_notify_state_t;
+
+typedef struct {
+    uint16_t length;                            // next free offset, 0 if empty
+    uint8_t count;                              // number of datagrams
+    uint16_t index[USB_NCM_MAX_DATAGRAMS];
+    uint16_t size[USB_NCM_MAX_DATAGRAMS];
+    uint32_t data[USB_NCM_NTB_MAX_SIZE / 4];    // word aligned
+} ntb_in_t;
+
+typedef struct {
+    volatile bool link_up;
+    volatile bool tx_busy;                      // block other than tx_fill is being transmitted
+    volatile bool tx_writing;                   // frame is being copied into the block at tx_fill
+    volatile uint8_t tx_fill;
+    volatile uint16_t rx_length;                // length of received block waiting to be processed
+    volatile ncm_notify_state_t notify;
+    uint8_t alt_setting;
+    uint8_t cmd;
+    uint16_t tx_seq;
+    uint32_t ntb_in_max;
+} ncm_t;
+
+static ncm_t ncm = { .cmd = 0xFFU };
+static ntb_in_t ntb_in[2];
+static uint32_t ntb_out[USB_NCM_NTB_MAX_SIZE / 4];
+
+__ALIGN_BEGIN static uint8_t notification[NCM_NOTIFY_PACKET_SIZE] __ALIGN_END;
+__ALIGN_BEGIN static uint8_t ctl_data[32] __ALIGN_END;
+
+__ALIGN_BEGIN static uint8_t USBD_CDC_NCM_CfgFSDesc[USB_CDC_NCM_CONFIG_DESC_SIZ] __ALIGN_END =
+{
+  /* Configuration Descriptor */
+  0x09,                                       /* bLength: Configuration Descriptor size */
+  USB_DESC_TYPE_CONFIGURATION,                /* bDescriptorType: Configuration */
+  LOBYTE(USB_CDC_NCM_CONFIG_DESC_SIZ),        /* wTotalLength */
+  HIBYTE(USB_CDC_NCM_CONFIG_DESC_SIZ),
+  0x04,                                       /* bNumInterfaces: 4 interfaces */
+  0x01,                                       /* bConfigurationValue: Configuration value */
+  0x00,                                       /* iConfiguration: Index of string descriptor describing the configuration */
+  0xC0,                                       /* bmAttributes: self powered */
+  0x32,                                       /* MaxPower 100 mA */
+
+  /* Interface Association Descriptor: CDC */
+  0x08,                                       /* bLength */
+  0x0B,                                       /* bDescriptorType: IAD */
+  0x00,                                       /* bFirstInterface */
+  0x02,                                       /* bInterfaceCount */
+  0x02,                                       /* bFunctionClass: Communication Interface Class */
+  0x02,                                       /* bFunctionSubClass: Abstract Control Model */
+  0x01,                                       /* bFunctionProtocol: Common AT commands */
+  0x00,                                       /* iFunction */
+
+  /* CDC Interface Descriptor */
+  0x09,                                       /* bLength: Interface Descriptor size */
+  USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: Interface */
+  0x00,                                       /* bInterfaceNumber: Number of Interface */
+  0x00,                                       /* bAlternateSetting: Alternate setting */
+  0x01,                                       /* bNumEndpoints: One endpoints used */
+  0x02,                                       /* bInterfaceClass: Communication Interface Class */
+  0x02,                                       /* bInterfaceSubClass: Abstract Control Model */
+  0x01,                                       /* bInterfaceProtocol: Common AT commands */
+  0x00,                                       /* iInterface: */
+
+  /* Header Functional Descriptor */
+  0x05,                                       /* bLength: Endpoint Descriptor size */
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */
+  0x00,                                       /* bDescriptorSubtype: Header Func Desc */
+  0x10,                                       /* bcdCDC: spec release number */
+  0x01,
+
+  /* Call Management Functional Descriptor */
+  0x05,                                       /* bFunctionLength */
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */
+  0x01,                                       /* bDescriptorSubtype: Call Management Func Desc */
+  0x00,                                       /* bmCapabilities: D0+D1 */
+  0x01,                                       /* bDataInterface: 1 */
+
+  /* ACM Functional Descriptor */
+  0x04,                                       /* bFunctionLength */
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */
+  0x02,                                       /* bDescriptorSubtype: Abstract Control Management desc */
+  0x02,                                       /* bmCapabilities */
+
+  /* Union Functional Descriptor */
+  0x05,                                       /* bFunctionLength */
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */
+  0x06,                                       /* bDescriptorSubtype: Union func desc */
+  0x00,                                       /* bMasterInterface: Communication class interface */
+  0x01,                                       /* bSlaveInterface0: Data Class Interface */
+
+  /* CDC Command Endpoint Descriptor */
+  0x07,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */
+  CDC_CMD_EP,                                 /* bEndpointAddress */
+  0x03,                                       /* bmAttributes: Interrupt */
+  LOBYTE(CDC_CMD_PACKET_SIZE),                /* wMaxPacketSize: */
+  HIBYTE(CDC_CMD_PACKET_SIZE),
+  CDC_FS_BINTERVAL,                           /* bInterval: */
+
+  /* CDC Data Interface Descriptor */
+  0x09,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: */
+  0x01,                                       /* bInterfaceNumber: Number of Interface */
+  0x00,                                       /* bAlternateSetting: Alternate setting */
+  0x02,                                       /* bNumEndpoints: Two endpoints used */
+  0x0A,                                       /* bInterfaceClass: CDC */
+  0x00,                                       /* bInterfaceSubClass: */
+  0x00,                                       /* bInterfaceProtocol: */
+  0x00,                                       /* iInterface: */
+
+  /* CDC Data OUT Endpoint Descriptor */
+  0x07,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */
+  CDC_OUT_EP,                                 /* bEndpointAddress */
+  0x02,                                       /* bmAttributes: Bulk */
+  LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),        /* wMaxPacketSize: */
+  HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),
+  0x00,                                       /* bInterval: ignore for Bulk transfer */
+
+  /* CDC Data IN Endpoint Descriptor */
+  0x07,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */
+  CDC_IN_EP,                                  /* bEndpointAddress */
+  0x02,                                       /* bmAttributes: Bulk */
+  LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),        /* wMaxPacketSize: */
+  HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),
+  0x00,                                       /* bInterval: ignore for Bulk transfer */
+
+
+  /* Interface Association Descriptor: NCM */
+  0x08,                                       /* bLength */
+  0x0B,                                       /* bDescriptorType: IAD */
+  NCM_COMM_INTERFACE,                         /* bFirstInterface */
+  0x02,                                       /* bInterfaceCount */
+  0x02,                                       /* bFunctionClass: Communication Interface Class */
+  0x0D,                                       /* bFunctionSubClass: Network Control Model */
+  0x00,                                       /* bFunctionProtocol: none */
+  0x00,                                       /* iFunction */
+
+  /* NCM Communication Interface Descriptor */
+  0x09,                                       /* bLength: Interface Descriptor size */
+  USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: Interface */
+  NCM_COMM_INTERFACE,                         /* bInterfaceNumber: Number of Interface */
+  0x00,                                       /* bAlternateSetting: Alternate setting */
+  0x01,                                       /* bNumEndpoints: One endpoint used */
+  0x02,                                       /* bInterfaceClass: Communication Interface Class */
+  0x0D,                                       /* bInterfaceSubClass: Network Control Model */
+  0x00,                                       /* bInterfaceProtocol: none */
+  0x00,                                       /* iInterface: */
+
+  /* Header Functional Descriptor */
+  0x05,                                       /* bLength */
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */
+  0x00,                                       /* bDescriptorSubtype: Header Func Desc */
+  0x10,                                       /* bcdCDC: spec release number */
+  0x01,
+
+  /* Union Functional Descriptor */
+  0x05,                                       /* bFunctionLength */
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */
+  0x06,                                       /* bDescriptorSubtype: Union func desc */
+  NCM_COMM_INTERFACE,                         /* bMasterInterface: Communication class interface */
+  NCM_DATA_INTERFACE,                         /* bSlaveInterface0: Data Class Interface */
+
+  /* Ethernet Networking Functional Descriptor */
+  0x0D,                                       /* bFunctionLength */
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */
+  0x0F,                                       /* bDescriptorSubtype: Ethernet Networking */
+  NCM_MAC_STR_INDEX,                          /* iMACAddress */
+  0x00, 0x00, 0x00, 0x00,                     /* bmEthernetStatistics: none */
+  LOBYTE(NCM_MAX_SEGMENT_SIZE),               /* wMaxSegmentSize */
+  HIBYTE(NCM_MAX_SEGMENT_SIZE),
+  0x00, 0x00,                                 /* wNumberMCFilters: none */
+  0x00,                                       /* bNumberPowerFilters: none */
+
+  /* NCM Functional Descriptor */
+  0x06,                                       /* bFunctionLength */
+  0x24,                                       /* bDescriptorType: CS_INTERFACE */
+  0x1A,                                       /* bDescriptorSubtype: NCM */
+  0x00,                                       /* bcdNcmVersion: 1.0 */
+  0x01,
+  0x00,                                       /* bmNetworkCapabilities: none */
+
+  /* NCM Notification Endpoint Descriptor */
+  0x07,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */
+  NCM_NOTIFY_EP,                              /* bEndpointAddress */
+  0x03,                                       /* bmAttributes: Interrupt */
+  LOBYTE(NCM_NOTIFY_PACKET_SIZE),             /* wMaxPacketSize: */
+  HIBYTE(NCM_NOTIFY_PACKET_SIZE),
+  CDC_FS_BINTERVAL,                           /* bInterval: */
+
+  /* NCM Data Interface Descriptor, alternate setting 0: no endpoints */
+  0x09,                                       /* bLength: Interface Descriptor size */
+  USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: */
+  NCM_DATA_INTERFACE,                         /* bInterfaceNumber: Number of Interface */
+  0x00,                                       /* bAlternateSetting: Alternate setting */
+  0x00,                                       /* bNumEndpoints: No endpoints used */
+  0x0A,                                       /* bInterfaceClass: CDC Data */
+  0x00,                                       /* bInterfaceSubClass: */
+  0x01,                                       /* bInterfaceProtocol: NTB */
+  0x00,                                       /* iInterface: */
+
+  /* NCM Data Interface Descriptor, alternate setting 1: operational */
+  0x09,                                       /* bLength: Interface Descriptor size */
+  USB_DESC_TYPE_INTERFACE,                    /* bDescriptorType: */
+  NCM_DATA_INTERFACE,                         /* bInterfaceNumber: Number of Interface */
+  0x01,                                       /* bAlternateSetting: Alternate setting */
+  0x02,                                       /* bNumEndpoints: Two endpoints used */
+  0x0A,                                       /* bInterfaceClass: CDC Data */
+  0x00,                                       /* bInterfaceSubClass: */
+  0x01,                                       /* bInterfaceProtocol: NTB */
+  0x00,                                       /* iInterface: */
+
+  /* NCM Data OUT Endpoint Descriptor */
+  0x07,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */
+  NCM_OUT_EP,                                 /* bEndpointAddress */
+  0x02,                                       /* bmAttributes: Bulk */
+  LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),        /* wMaxPacketSize: */
+  HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),
+  0x00,                                       /* bInterval: ignore for Bulk transfer */
+
+  /* NCM Data IN Endpoint Descriptor */
+  0x07,                                       /* bLength: Endpoint Descriptor size */
+  USB_DESC_TYPE_ENDPOINT,                     /* bDescriptorType: Endpoint */
+  NCM_IN_EP,                                  /* bEndpointAddress */
+  0x02,                                       /* bmAttributes: Bulk */
+  LOBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),        /* wMaxPacketSize: */
+  HIBYTE(CDC_DATA_FS_MAX_PACKET_SIZE),
+  0x00                                        /* bInterval: ignore for Bulk transfer */
+};
+
+static inline uint16_t get_le16 (const uint8_t *p)
+{
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static inline uint32_t get_le32 (const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void put_le16 (uint8_t *p, uint16_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void put_le32 (uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+// Locally administered addresses derived from the MCU unique id,
+// the host and device ends of the link differ in the first octet.
+void USBD_NCM_GetMACAddress (uint8_t mac[6], bool host)
+{
+    uint32_t uid = HAL_GetUIDw0() ^ HAL_GetUIDw1() ^ HAL_GetUIDw2();
+
+    mac[0] = host ? 0x02 : 0x06;
+    mac[1] = (uint8_t)(HAL_GetUIDw2() >> 8);
+    put_le32(&mac[2], uid);
+}
+
+/*
+ * Transfer blocks to the host
+ */
+
+static inline uint8_t *ntb_in_data (ntb_in_t *ntb)
+{
+    return (uint8_t *)ntb->data;
+}
+
+// Completes the headers of the block being filled and starts transmitting it.
+// Must be called from the USB interrupt or with it disabled.
+static void ncm_tx_start (USBD_HandleTypeDef *pdev)
+{
+    ntb_in_t *ntb = &ntb_in[ncm.tx_fill];
+    uint8_t *p = ntb_in_data(ntb), *ndp = p + NTH16_LENGTH;
+    uint_fast8_t i;
+
+    if(ntb->count == 0 || ncm.tx_busy || ncm.tx_writing)
+        return;
+
+    put_le32(p, NTH16_SIGNATURE);
+    put_le16(p + 4, NTH16_LENGTH);
+    put_le16(p + 6, ncm.tx_seq++);
+    put_le16(p + 8, ntb->length);
+    put_le16(p + 10, NTH16_LENGTH);
+
+    put_le32(ndp, NDP16_SIGNATURE);
+    put_le16(ndp + 4, NDP16_LENGTH(ntb->count));
+    put_le16(ndp + 6, 0);
+    for(i = 0; i < ntb->count; i++) {
+        put_le16(ndp + 8 + i * 4, ntb->index[i]);
+        put_le16(ndp + 10 + i * 4, ntb->size[i]);
+    }
+    put_le32(ndp + 8 + i * 4, 0);
+
+    ncm.tx_busy = true;
+    pdev->ep_in[NCM_IN_EP & 0xFU].total_length = ntb->length;
+    USBD_LL_Transmit(pdev, NCM_IN_EP, p, ntb->length);
+
+    ncm.tx_fill ^= 1;
+    ntb_in[ncm.tx_fill].length = ntb_in[ncm.tx_fill].count = 0;
+}
+
+// Reserves space for a frame in the block being filled, returns NULL if no space is available.
+// The frame must be copied to the returned address before calling USBD_NCM_TxCommit().
+uint8_t *USBD_NCM_TxAlloc (USBD_HandleTypeDef *pdev, uint16_t length)
+{
+    uint8_t *frame = NULL;
+
+    if(!ncm.link_up || length > NCM_MAX_SEGMENT_SIZE)
+        return NULL;
+
+    NCM_LOCK();
+
+    ntb_in_t *ntb = &ntb_in[ncm.tx_fill];
+    uint32_t offset = ntb->count ? NTB_ALIGN(ntb->length) : NTB_IN_PAYLOAD_OFFSET;
+
+    if(ntb->count == USB_NCM_MAX_DATAGRAMS || offset + length > ncm.ntb_in_max) {
+        if(ncm.tx_busy) // block is full, wait for the one in transit to complete
+            ntb = NULL;
+        else {
+            ncm_tx_start(pdev);
+            ntb = &ntb_in[ncm.tx_fill];
+            offset = NTB_IN_PAYLOAD_OFFSET;
+        }
+    }
+
+    if(ntb) {
+        ntb->index[ntb->count] = (uint16_t)offset;
+        ntb->size[ntb->count] = length;
+        ntb->length = (uint16_t)(offset + length);
+        ncm.tx_writing = true;
+        frame = ntb_in_data(ntb) + offset;
+    }
+
+    NCM_UNLOCK();
+
+    return frame;
+}
+
+// Adds the frame reserved by USBD_NCM_TxAlloc() to the block, starts transmission if the IN endpoint is idle.
+void USBD_NCM_TxCommit (USBD_HandleTypeDef *pdev)
+{
+    NCM_LOCK();
+
+    if(ncm.tx_writing) {
+        ntb_in[ncm.tx_fill].count++;
+        ncm.tx_writing = false;
+        ncm_tx_start(pdev);
+    }
+
+    NCM_UNLOCK();
+}
+
+/*
+ * Transfer blocks from the host
+ */
+
+static void ncm_rx_arm (USBD_HandleTypeDef *pdev)
+{
+    ncm.rx_length = 0;
+    USBD_LL_PrepareReceive(pdev, NCM_OUT_EP, (uint8_t *)ntb_out, USB_NCM_NTB_MAX_SIZE);
+}
+
+// Passes the frames in a received transfer block to input() and rearms the OUT endpoint,
+// must be called regularly from the foreground.
+void USBD_NCM_Process (USBD_HandleTypeDef *pdev, ncm_input_ptr input)
+{
+    uint_fast8_t ndps = 4; // max number of datagram pointer tables processed, guards against loops
+    uint_fast16_t length = ncm.rx_length, ndp_index, index, size;
+    const uint8_t *ntb = (const uint8_t *)ntb_out, *ndp;
+
+    if(length == 0)
+        return;
+
+    if(length >= NTH16_LENGTH && get_le32(ntb) == NTH16_SIGNATURE && get_le16(ntb + 4) == NTH16_LENGTH && get_le16(ntb + 8) <= length) {
+
+        length = get_le16(ntb + 8);
+        ndp_index = get_le16(ntb + 10);
+
+        while(ndps-- && ndp_index >= NTH16_LENGTH && ndp_index + 8 <= length && !(ndp_index & 0x03)) {
+
+            ndp = ntb + ndp_index;
+
+            if(get_le32(ndp) != NDP16_SIGNATURE || ndp_index + get_le16(ndp + 4) > length)
+                break;
+
+            const uint8_t *entry = ndp + 8, *end = ndp + get_le16(ndp + 4);
+
+            while(entry + 4 <= end && (index = get_le16(entry)) && (size = get_le16(entry + 2))) {
+                if(index + size <= length)
+                    input(ntb + index, (uint16_t)size);
+                entry += 4;
+            }
+
+            ndp_index = get_le16(ndp + 6);
+        }
+    }
+
+    // The block is consumed or dropped, always release it. With the data interface
+    // in alternate setting 0 the OUT endpoint is closed, it is rearmed on reselection.
+    NCM_LOCK();
+    if(ncm.link_up)
+        ncm_rx_arm(pdev);
+    else
+        ncm.rx_length = 0;
+    NCM_UNLOCK();
+}
+
+bool USBD_NCM_LinkUp (void)
+{
+    return ncm.link_up;
+}
+
+/*
+ * Control
+ */
+
+static void ncm_notify (USBD_HandleTypeDef *pdev, ncm_notify_state_t state)
+{
+    ncm.notify = state;
+
+    notification[0] = 0xA1;
+    notification[2] = 0;
+    notification[3] = 0;
+    put_le16(&notification[4], NCM_COMM_INTERFACE);
+
+    switch(state) {
+
+        case Notify_Speed:
+            notification[1] = NCM_NOTIFY_SPEED_CHANGE;
+            put_le16(&notification[6], 8);
+            put_le32(&notification[8], 12000000UL);  // downstream bit rate
+            put_le32(&notification[12], 12000000UL); // upstream bit rate
+            USBD_LL_Transmit(pdev, NCM_NOTIFY_EP, notification, 16);
+            break;
+
+        case Notify_Connection:
+            notification[1] = NCM_NOTIFY_NETWORK_CONNECTION;
+            notification[2] = ncm.link_up ? 1 : 0;
+            put_le16(&notification[6], 0);
+            USBD_LL_Transmit(pdev, NCM_NOTIFY_EP, notification, 8);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Alternate setting 1 of the data interface enables the bulk endpoints and brings the link up.
+static void ncm_set_alt (USBD_HandleTypeDef *pdev, uint8_t alt)
+{
+    if(alt == ncm.alt_setting)
+        return;
+
+    if((ncm.alt_setting = alt)) {
+
+        USBD_LL_OpenEP(pdev, NCM_IN_EP, USBD_EP_TYPE_BULK, CDC_DATA_FS_MAX_PACKET_SIZE);
+        pdev->ep_in[NCM_IN_EP & 0xFU].is_used = 1U;
+
+        USBD_LL_OpenEP(pdev, NCM_OUT_EP, USBD_EP_TYPE_BULK, CDC_DATA_FS_MAX_PACKET_SIZE);
+        pdev->ep_out[NCM_OUT_EP & 0xFU].is_used = 1U;
+
+        ncm.tx_busy = ncm.tx_writing = false;
+        ntb_in[0].length = ntb_in[0].count = ntb_in[1].length = ntb_in[1].count = 0;
+        ncm.link_up = true;
+        ncm_rx_arm(pdev);
+
+    } else {
+
+        ncm.link_up = false;
+
+        USBD_LL_CloseEP(pdev, NCM_IN_EP);
+        pdev->ep_in[NCM_IN_EP & 0xFU].is_used = 0U;
+
+        USBD_LL_CloseEP(pdev, NCM_OUT_EP);
+        pdev->ep_out[NCM_OUT_EP & 0xFU].is_used = 0U;
+    }
+}
+
+static uint8_t ncm_setup (USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    bool ok = true;
+
+    switch(req->bmRequest & USB_REQ_TYPE_MASK) {
+
+        case USB_REQ_TYPE_CLASS:
+            switch(req->bRequest) {
+
+                case NCM_GET_NTB_PARAMETERS:
+                    put_le16(&ctl_data[0], 28);                     // wLength
+                    put_le16(&ctl_data[2], 0x0001);                 // bmNtbFormatsSupported: NTB16
+                    put_le32(&ctl_data[4], USB_NCM_NTB_MAX_SIZE);   // dwNtbInMaxSize
+                    put_le16(&ctl_data[8], 4);                      // wNdpInDivisor
+                    put_le16(&ctl_data[10], 0);                     // wNdpInPayloadRemainder
+                    put_le16(&ctl_data[12], 4);                     // wNdpInAlignment
+                    put_le16(&ctl_data[14], 0);
+                    put_le32(&ctl_data[16], USB_NCM_NTB_MAX_SIZE);  // dwNtbOutMaxSize
+                    put_le16(&ctl_data[20], 4);                     // wNdpOutDivisor
+                    put_le16(&ctl_data[22], 0);                     // wNdpOutPayloadRemainder
+                    put_le16(&ctl_data[24], 4);                     // wNdpOutAlignment
+                    put_le16(&ctl_data[26], 0);                     // wNtbOutMaxDatagrams: no limit
+                    USBD_CtlSendData(pdev, ctl_data, req->wLength < 28 ? req->wLength : 28);
+                    break;
+
+                case NCM_GET_NTB_INPUT_SIZE:
+                    put_le32(ctl_data, ncm.ntb_in_max);
+                    USBD_CtlSendData(pdev, ctl_data, req->wLength < 4 ? req->wLength : 4);
+                    break;
+
+                case NCM_GET_NTB_FORMAT:
+                    put_le16(ctl_data, 0);
+                    USBD_CtlSendData(pdev, ctl_data, req->wLength < 2 ? req->wLength : 2);
+                    break;
+
+                case NCM_SET_NTB_FORMAT:
+                    ok = req->wValue == 0;
+                    break;
+
+                case NCM_SET_ETHERNET_PACKET_FILTER: // all frames are passed to the stack
+                    break;
+
+                case NCM_SET_NTB_INPUT_SIZE:
+                case NCM_SET_ETHERNET_MULTICAST_FILTERS:
+                    if((ok = !(req->bmRequest & 0x80) && req->wLength <= sizeof(ctl_data))) {
+                        if(req->wLength) {
+                            ncm.cmd = req->bRequest;
+                            USBD_CtlPrepareRx(pdev, ctl_data, req->wLength);
+                        }
+                    }
+                    break;
+
+                default:
+                    ok = false;
+                    break;
+            }
+            break;
+
+        case USB_REQ_TYPE_STANDARD:
+            switch(req->bRequest) {
+
+                case USB_REQ_GET_STATUS:
+                    ctl_data[0] = ctl_data[1] = 0;
+                    USBD_CtlSendData(pdev, ctl_data, 2);
+                    break;
+
+                case USB_REQ_GET_INTERFACE:
+                    ctl_data[0] = LOBYTE(req->wIndex) == NCM_DATA_INTERFACE ? ncm.alt_setting : 0;
+                    USBD_CtlSendData(pdev, ctl_data, 1);
+                    break;
+
+                case USB_REQ_SET_INTERFACE:
+                    if(LOBYTE(req->wIndex) == NCM_DATA_INTERFACE && req->wValue <= 1) {
+                        ncm_set_alt(pdev, (uint8_t)req->wValue);
+                        ncm_notify(pdev, Notify_Speed); // followed by the connection state
+                    } else
+                        ok = req->wValue == 0;
+                    break;
+
+                case USB_REQ_CLEAR_FEATURE:
+                    break;
+
+                default:
+                    ok = false;
+                    break;
+            }
+            break;
+
+        default:
+            ok = false;
+            break;
+    }
+
+    if(!ok)
+        USBD_CtlError(pdev, req);
+
+    return ok ? USBD_OK : USBD_FAIL;
+}
+
+/*
+ * Composite class callbacks
+ */
+
+static uint8_t USBD_CDC_NCM_Init (USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    uint8_t ret = USBD_CDC.Init(pdev, cfgidx);
+
+    if(ret == USBD_OK) {
+
+        pdev->ep_in[NCM_NOTIFY_EP & 0xFU].bInterval = CDC_FS_BINTERVAL;
+        USBD_LL_OpenEP(pdev, NCM_NOTIFY_EP, USBD_EP_TYPE_INTR, NCM_NOTIFY_PACKET_SIZE);
+        pdev->ep_in[NCM_NOTIFY_EP & 0xFU].is_used = 1U;
+
+        ncm.alt_setting = 0;
+        ncm.link_up = false;
+        ncm.notify = Notify_Idle;
+        ncm.cmd = 0xFFU;
+        ncm.ntb_in_max = USB_NCM_NTB_MAX_SIZE;
+    }
+
+    return ret;
+}
+
+static uint8_t USBD_CDC_NCM_DeInit (USBD_HandleTypeDef *pdev, uint8_t cfgidx)
+{
+    if(ncm.alt_setting)
+        ncm_set_alt(pdev, 0);
+
+    ncm.notify = Notify_Idle;
+
+    USBD_LL_CloseEP(pdev, NCM_NOTIFY_EP);
+    pdev->ep_in[NCM_NOTIFY_EP & 0xFU].is_used = 0U;
+    pdev->ep_in[NCM_NOTIFY_EP & 0xFU].bInterval = 0U;
+
+    return USBD_CDC.DeInit(pdev, cfgidx);
+}
+
+static uint8_t USBD_CDC_NCM_Setup (USBD_HandleTypeDef *pdev, USBD_SetupReqTypedef *req)
+{
+    if((req->bmRequest & USB_REQ_RECIPIENT_MASK) == USB_REQ_RECIPIENT_INTERFACE &&
+         (LOBYTE(req->wIndex) == NCM_COMM_INTERFACE || LOBYTE(req->wIndex) == NCM_DATA_INTERFACE))
+        return ncm_setup(pdev, req);
+
+    return USBD_CDC.Setup(pdev, req);
+}
+
+static uint8_t USBD_CDC_NCM_EP0_RxReady (USBD_HandleTypeDef *pdev)
+{
+    if(ncm.cmd != 0xFFU) {
+        if(ncm.cmd == NCM_SET_NTB_INPUT_SIZE) {
+            uint32_t size = get_le32(ctl_data);
+            ncm.ntb_in_max = size < USB_NCM_NTB_MAX_SIZE && size >= NTB_IN_PAYLOAD_OFFSET + NCM_MAX_SEGMENT_SIZE ? size : USB_NCM_NTB_MAX_SIZE;
+        }
+        ncm.cmd = 0xFFU;
+        return USBD_OK;
+    }
+
+    return USBD_CDC.EP0_RxReady(pdev);
+}
+
+static uint8_t USBD_CDC_NCM_DataIn (USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    if(epnum == (NCM_NOTIFY_EP & 0x7FU)) {
+        if(ncm.notify == Notify_Speed)
+            ncm_notify(pdev, Notify_Connection);
+        else
+            ncm.notify = Notify_Idle;
+        return USBD_OK;
+    }
+
+    if(epnum != (NCM_IN_EP & 0x7FU))
+        return USBD_CDC.DataIn(pdev, epnum);
+
+    PCD_HandleTypeDef *hpcd = pdev->pData;
+
+    // Terminate transfers that are a multiple of the packet size with a zero length packet
+    if(pdev->ep_in[epnum].total_length > 0U && (pdev->ep_in[epnum].total_length % hpcd->IN_ep[epnum].maxpacket) == 0U) {
+        pdev->ep_in[epnum].total_length = 0U;
+        USBD_LL_Transmit(pdev, epnum, NULL, 0U);
+    } else {
+        ncm.tx_busy = false;
+        ncm_tx_start(pdev); // send frames batched while busy, if any
+    }
+
+    return USBD_OK;
+}
+
+static uint8_t USBD_CDC_NCM_DataOut (USBD_HandleTypeDef *pdev, uint8_t epnum)
+{
+    if(epnum != NCM_OUT_EP)
+        return USBD_CDC.DataOut(pdev, epnum);
+
+    ncm.rx_length = (uint16_t)USBD_LL_GetRxDataSize(pdev, epnum);
+
+    return USBD_OK;
+}
+
+static uint8_t *USBD_CDC_NCM_GetCfgDesc (uint16_t *length)
+{
+    *length = (uint16_t)sizeof(USBD_CDC_NCM_CfgFSDesc);
+
+    return USBD_CDC_NCM_CfgFSDesc;
+}
+
+static uint8_t *USBD_CDC_NCM_GetDeviceQualifierDescriptor (uint16_t *length)
+{
+    return USBD_CDC.GetDeviceQualifierDescriptor(length);
+}
+
+// Returns the host MAC address string referenced by the Ethernet Networking Functional Descriptor.
+static uint8_t *USBD_CDC_NCM_GetUsrStrDescriptor (USBD_HandleTypeDef *pdev, uint8_t index, uint16_t *length)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    __ALIGN_BEGIN static uint8_t desc[2 + 12 * 2] __ALIGN_END;
+
+    uint8_t mac[6];
+    char str[13];
+    uint_fast8_t i;
+
+    UNUSED(pdev);
+
+    if(index != NCM_MAC_STR_INDEX)
+        return NULL;
+
+    USBD_NCM_GetMACAddress(mac, true);
+
+    for(i = 0; i < 6; i++) {
+        str[i * 2] = hex[mac[i] >> 4];
+        str[i * 2 + 1] = hex[mac[i] & 0x0F];
+    }
+    str[12] = '\0';
+
+    USBD_GetString((uint8_t *)str, desc, length);
+
+    return desc;
+}
+
+USBD_ClassTypeDef USBD_CDC_NCM = {
+    .Init = USBD_CDC_NCM_Init,
+    .DeInit = USBD_CDC_NCM_DeInit,
+    .Setup = USBD_CDC_NCM_Setup,
+    .EP0_RxReady = USBD_CDC_NCM_EP0_RxReady,
+    .DataIn = USBD_CDC_NCM_DataIn,
+    .DataOut = USBD_CDC_NCM_DataOut,
+    .GetHSConfigDescriptor = USBD_CDC_NCM_GetCfgDesc,
+    .GetFSConfigDescriptor = USBD_CDC_NCM_GetCfgDesc,
+    .GetOtherSpeedConfigDescriptor = USBD_CDC_NCM_GetCfgDesc,
+    .GetDeviceQualifierDescriptor = USBD_CDC_NCM_GetDeviceQualifierDescriptor,
+    .GetUsrStrDescriptor = USBD_CDC_NCM_GetUsrStrDescriptor
+};
+
+#endif // USB_NETWORK_ENABLE
@@ -0,0 +1,60 @@
+/*
+
+  usbd_cdc_ncm.h - composite USB CDC ACM + CDC NCM (Network Control Model) class
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include <stdbool.h>
+
+#include "usbd_cdc.h"
+
+#define NCM_IN_EP               0x83U
+#define NCM_OUT_EP              0x03U
+#define NCM_NOTIFY_EP           0x84U
+#define NCM_NOTIFY_PACKET_SIZE  16U
+#define NCM_COMM_INTERFACE      0x02U
+#define NCM_DATA_INTERFACE      0x03U
+#define NCM_MAC_STR_INDEX       0x10U
+
+#define USB_CDC_NCM_CONFIG_DESC_SIZ 160U
+
+#ifndef USB_NCM_NTB_MAX_SIZE
+#define USB_NCM_NTB_MAX_SIZE    2048U // Transfer block size in each direction, must be large enough for a full size Ethernet frame
+#endif
+
+#ifndef USB_NCM_MAX_DATAGRAMS
+#define USB_NCM_MAX_DATAGRAMS   8U    // Max number of Ethernet frames batched in a transfer block to the host
+#endif
+
+#define NCM_MAX_SEGMENT_SIZE    1514U
+
+typedef void (*ncm_input_ptr)(const uint8_t *frame, uint16_t length);
+
+extern USBD_ClassTypeDef USBD_CDC_NCM;
+
+void USBD_NCM_GetMACAddress (uint8_t mac[6], bool host);
+bool USBD_NCM_LinkUp (void);
+uint8_t *USBD_NCM_TxAlloc (USBD_HandleTypeDef *pdev, uint16_t length);
+void USBD_NCM_TxCommit (USBD_HandleTypeDef *pdev);
+void USBD_NCM_Process (USBD_HandleTypeDef *pdev, ncm_input_ptr input);
+
+/*EOF*/
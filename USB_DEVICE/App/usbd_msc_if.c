@@ -0,0 +1,252 @@
+/*
+
+  usbd_msc_if.c - USB mass storage access to the SD card
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+/*
+  Sectors are read and written via the diskio.c functions used by FatFs, from a delayed foreground task.
+  Card probing and sector transfers, including the card programming waits, are only performed when the
+  machine is idle or in alarm state. Otherwise the transfer is left pending with the bulk endpoints NAKing
+  until the machine stops, so the host may time out and reset the device while a job is running.
+
+  The card is owned either by FatFs or by the host, never by both. It is presented to the host
+  only while FatFs has no volume mounted, the host sees the medium removed when the card is
+  mounted ($FM or a job started) and changed when it has been unmounted again ($FU).
+  The card is probed when the device is configured, when FatFs releases it and when the card
+  detect input, if available, changes. A failed probe or transfer is not retried until then.
+  FatFs is forced to remount the volume after the host has written to the card.
+*/
+
+#include "driver.h"
+
+#if USB_MSC_ENABLE
+
+#include "usbd_msc_if.h"
+#include "ff.h"
+#include "diskio.h"
+#if SDCARD_SDIO
+#include "bsp_driver_sd.h"
+#endif
+
+#include "grbl/hal.h"
+#include "grbl/task.h"
+#include "grbl/state_machine.h"
+
+#define POLL_INTERVAL 1 // ms
+
+extern USBD_HandleTypeDef hUsbDeviceFS;
+
+static volatile msc_medium_state_t medium = MSC_MediumNotPresent;
+static volatile bool ejected = false;
+static volatile bool probe = false;
+static bool mounted = false, detected = false;
+static uint32_t block_count = 0;
+
+static const uint8_t inquiry_data[36] = {
+    0x00,           // direct access device
+    0x80,           // removable medium
+    0x02,           // SPC-2
+    0x02,           // response data format
+    31,             // additional length
+    0x00, 0x00, 0x00,
+    'g', 'r', 'b', 'l', 'H', 'A', 'L', ' ',                                         // vendor, 8 characters
+    'S', 'D', ' ', 'c', 'a', 'r', 'd', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', ' ', // product, 16 characters
+    '1', '.', '0', '0'                                                              // revision, 4 characters
+};
+
+static void set_medium (msc_medium_state_t state)
+{
+    HAL_NVIC_DisableIRQ(OTG_FS_IRQn);
+    medium = state;
+    HAL_NVIC_EnableIRQ(OTG_FS_IRQn);
+}
+
+static bool card_detected (void)
+{
+#if SDCARD_SDIO
+    return BSP_SD_IsDetected() == SD_PRESENT;
+#elif defined(SD_DETECT_PIN)
+    return !DIGITAL_IN(SD_DETECT_PORT, SD_DETECT_PIN); // Switch is closed to ground when a card is inserted
+#else
+    return true;
+#endif
+}
+
+// Called from the USB interrupt when the device is configured.
+static int8_t msc_init (void)
+{
+    ejected = false;
+    probe = true;
+
+    return 0;
+}
+
+// Called from the USB interrupt, the medium changed state is reported once.
+static msc_medium_state_t msc_get_state (void)
+{
+    msc_medium_state_t state = medium;
+
+    if(state == MSC_MediumChanged)
+        medium = MSC_MediumReady;
+
+    return state;
+}
+
+static int8_t msc_get_capacity (uint32_t *block_num, uint16_t *block_size)
+{
+    *block_num = block_count;
+    *block_size = FF_MAX_SS;
+
+    return block_count ? 0 : -1;
+}
+
+static int8_t msc_is_write_protected (void)
+{
+    return 0;
+}
+
+static int8_t msc_read (uint8_t *buf, uint32_t blk_addr, uint16_t blk_len)
+{
+    if(medium == MSC_MediumNotPresent)
+        return -1;
+
+    if(disk_read(0, buf, blk_addr, blk_len) != RES_OK) {
+        set_medium(MSC_MediumNotPresent);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int8_t msc_write (uint8_t *buf, uint32_t blk_addr, uint16_t blk_len)
+{
+    if(medium == MSC_MediumNotPresent)
+        return -1;
+
+    if(disk_write(0, buf, blk_addr, blk_len) != RES_OK) {
+        set_medium(MSC_MediumNotPresent);
+        return -1;
+    }
+
+    disk_ioctl(0, CTRL_EJECT, NULL); // Content changed, have FatFs remount the volume on next access.
+
+    return 0;
+}
+
+// Called from the USB interrupt when the host ejects the medium,
+// it is not presented again until the device is reconnected.
+static void msc_eject (void)
+{
+    ejected = true;
+    medium = MSC_MediumNotPresent;
+}
+
+USBD_MSC_StorageTypeDef USBD_Storage_fops_FS = {
+    .Init = msc_init,
+    .GetState = msc_get_state,
+    .GetCapacity = msc_get_capacity,
+    .IsWriteProtected = msc_is_write_protected,
+    .Read = msc_read,
+    .Write = msc_write,
+    .Eject = msc_eject,
+    .pInquiry = inquiry_data
+};
+
+static void msc_poll (void *data)
+{
+    bool present;
+    sys_state_t state;
+
+    task_add_delayed(msc_poll, NULL, POLL_INTERVAL);
+
+    if(hUsbDeviceFS.dev_state != USBD_STATE_CONFIGURED)
+        return;
+
+    if((present = card_detected()) != detected) {
+        if((detected = present))
+            probe = true;
+        else if(medium != MSC_MediumNotPresent)
+            set_medium(MSC_MediumNotPresent);
+    }
+
+    if(mounted || hal.stream.type == StreamType_SDCard) {
+        // FatFs owns the card
+        if(medium != MSC_MediumNotPresent)
+            set_medium(MSC_MediumNotPresent);
+    }
+
+    if(!((state = state_get()) == STATE_IDLE || state == STATE_ALARM))
+        return; // Card access is held off while the machine is busy
+
+    if(probe && !(mounted || hal.stream.type == StreamType_SDCard)) {
+
+        DWORD sectors;
+
+        probe = false;
+
+        if(detected && !ejected && medium == MSC_MediumNotPresent &&
+            !(disk_initialize(0) & STA_NOINIT) && disk_ioctl(0, GET_SECTOR_COUNT, &sectors) == RES_OK) {
+            block_count = sectors;
+            set_medium(MSC_MediumChanged);
+        }
+    }
+
+    USBD_MSC_Process(&hUsbDeviceFS);
+}
+
+void usbMscSetMounted (bool on)
+{
+    if(mounted && !on)
+        probe = true; // Card released by FatFs
+
+    if((mounted = on) && medium != MSC_MediumNotPresent)
+        set_medium(MSC_MediumNotPresent);
+}
+
+void usbMscInit (void)
+{
+#if !SDCARD_SDIO && defined(SD_DETECT_PIN)
+
+    GPIO_InitTypeDef GPIO_InitStruct = {
+        .Pin = 1 << SD_DETECT_PIN,
+        .Mode = GPIO_MODE_INPUT,
+        .Pull = GPIO_PULLUP,
+        .Speed = GPIO_SPEED_FREQ_LOW
+    };
+
+    HAL_GPIO_Init(SD_DETECT_PORT, &GPIO_InitStruct);
+
+    static const periph_pin_t cd = {
+        .function = Input_SdCardDetect,
+        .group = PinGroup_SdCard,
+        .port = SD_DETECT_PORT,
+        .pin = SD_DETECT_PIN,
+        .mode = { .mask = PINMODE_PULLUP }
+    };
+
+    hal.periph_port.register_pin(&cd);
+
+#endif
+
+    task_add_delayed(msc_poll, NULL, POLL_INTERVAL);
+}
+
+#endif // USB_MSC_ENABLE
@@ -0,0 +1,35 @@
+/*
+
+  usbd_msc_if.h - USB mass storage access to the SD card
+
+  Part of grblHAL
+
+  Copyright (c) 2026 agent
+
+  grblHAL is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  grblHAL is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with grblHAL. If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#pragma once
+
+#include "usbd_cdc_msc.h"
+
+extern USBD_MSC_StorageTypeDef USBD_Storage_fops_FS;
+
+void usbMscInit (void);
+
+// Called when FatFs mounts or unmounts the card, the card is hidden from the host while mounted.
+void usbMscSetMounted (bool on);
+
+/*EOF*/
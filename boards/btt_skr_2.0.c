@@ -38,25 +38,115 @@ static spindle_set_state_ptr set_state;
 
 #if TRINAMIC_SPI_ENABLE
 
+#include <string.h>
+
 #include "trinamic/common.h"
 
-#define spi_get_byte() sw_spi_xfer(0)
-#define spi_put_byte(d) sw_spi_xfer(d)
+#define DATAGRAM_SIZE 5
 
 static struct {
     GPIO_TypeDef *port;
     uint16_t pin;
 } cs[TMC_N_MOTORS_MAX];
 
-// XXXXX replace with something better...
-inline static void delay (void)
+#if TRINAMIC_SOFT_SPI_DMA
+
+/*
+  The MOSI and SCK pins are driven by DMA writes to the GPIO BSRR register paced by the update event of TIM8,
+  two writes per bit: SCK low with the MOSI level then SCK high. MISO is sampled by DMA reads of the GPIO IDR register
+  triggered by TIM8 compare channel 3 half way between the writes. The pins are not routed to a SPI peripheral
+  on this board. DMA2 is used as it has access to the GPIO ports, MOSI and SCK must be on the same port.
+  The transfer is waited for, 20 us per datagram, since the Trinamic driver API is synchronous and expects the
+  reply on return. The clock is kept at 2 MHz, at 4 MHz the two streams would need 16 million GPIO accesses per
+  second from DMA2 and a late request would shift an edge.
+*/
+
+#define SOFT_SPI_CLOCK  2000000 // Hz, TMC2130 and TMC5160 allow up to 4 MHz with the internal clock
+#define XFER_TIMEOUT    100     // us
+
+#define TX_STREAM       DMA2_Stream1 // TIM8_UP
+#define RX_STREAM       DMA2_Stream4 // TIM8_CH3
+#define DMA_CHANNEL     (DMA_SxCR_CHSEL_2|DMA_SxCR_CHSEL_1|DMA_SxCR_CHSEL_0) // Channel 7
+
+static uint32_t bsrr[DATAGRAM_SIZE * 16];      // SCK low + MOSI, SCK high for each bit
+static uint16_t idr[DATAGRAM_SIZE * 16 + 1];   // One sample per write, the first is taken before the first write
+
+static void stream_start (DMA_Stream_TypeDef *stream, uint32_t cr, volatile void *periph, void *mem, uint16_t count)
+{
+  stream->CR = 0;
+  while(stream->CR & DMA_SxCR_EN);
+
+  stream->PAR = (uint32_t)periph;
+  stream->M0AR = (uint32_t)mem;
+  stream->NDTR = count;
+  stream->FCR = 0; // Direct mode
+  stream->CR = cr|DMA_SxCR_EN;
+}
+
+// Exchanges one datagram, data is replaced with the received bytes.
+static void spi_xfer (uint8_t *data)
 {
-    volatile uint32_t dly = 10;
+  uint_fast8_t idx, bit;
+  uint32_t *out = bsrr;
 
-    while(--dly)
-        __ASM volatile ("nop");
+  for(idx = 0; idx < DATAGRAM_SIZE; idx++) {
+    for(bit = 0x80; bit; bit >>= 1) {
+      *out++ = (1 << (TRINAMIC_SCK_PIN + 16)) | ((data[idx] & bit) ? 1 << TRINAMIC_MOSI_PIN : 1 << (TRINAMIC_MOSI_PIN + 16));
+      *out++ = 1 << TRINAMIC_SCK_PIN;
+    }
+  }
+
+  DMA2->LIFCR = DMA_LIFCR_CTCIF1|DMA_LIFCR_CHTIF1|DMA_LIFCR_CTEIF1|DMA_LIFCR_CDMEIF1|DMA_LIFCR_CFEIF1;
+  DMA2->HIFCR = DMA_HIFCR_CTCIF4|DMA_HIFCR_CHTIF4|DMA_HIFCR_CTEIF4|DMA_HIFCR_CDMEIF4|DMA_HIFCR_CFEIF4;
+
+  stream_start(TX_STREAM, DMA_CHANNEL|DMA_SxCR_PL|DMA_SxCR_MSIZE_1|DMA_SxCR_PSIZE_1|DMA_SxCR_MINC|DMA_SxCR_DIR_0,
+                &TRINAMIC_SCK_PORT->BSRR, bsrr, sizeof(bsrr) / sizeof(uint32_t));
+  stream_start(RX_STREAM, DMA_CHANNEL|DMA_SxCR_PL|DMA_SxCR_MSIZE_0|DMA_SxCR_PSIZE_0|DMA_SxCR_MINC,
+                &TRINAMIC_MISO_PORT->IDR, idr, sizeof(idr) / sizeof(uint16_t));
+
+  uint32_t start = DWT->CYCCNT, timeout = XFER_TIMEOUT * hal.f_mcu;
+
+  TIM8->CNT = 0;
+  TIM8->SR = 0;
+  TIM8->DIER = TIM_DIER_UDE|TIM_DIER_CC3DE;
+  TIM8->CR1 |= TIM_CR1_CEN;
+
+  while(!(DMA2->HISR & (DMA_HISR_TCIF4|DMA_HISR_TEIF4)) && DWT->CYCCNT - start < timeout);
+
+  TIM8->CR1 &= ~TIM_CR1_CEN;
+  TIM8->DIER = 0;
+  TX_STREAM->CR = 0;
+  RX_STREAM->CR = 0;
+
+  // The sample taken after the SCK low write of a bit holds the bit.
+  for(idx = 0; idx < DATAGRAM_SIZE; idx++) {
+    data[idx] = 0;
+    for(bit = 0; bit < 8; bit++)
+      data[idx] = (data[idx] << 1) | ((idr[(idx * 8 + bit) * 2 + 1] >> TRINAMIC_MISO_PIN) & 1);
+  }
 }
 
+static void soft_spi_init (void)
+{
+  RCC_ClkInitTypeDef clock;
+  uint32_t latency;
+
+  HAL_RCC_GetClockConfig(&clock, &latency);
+
+  __HAL_RCC_DMA2_CLK_ENABLE();
+  __HAL_RCC_TIM8_CLK_ENABLE();
+
+  TIM8->CR1 = 0;
+  TIM8->PSC = 0;
+  TIM8->ARR = HAL_RCC_GetPCLK2Freq() * TIMER_CLOCK_MUL(clock.APB2CLKDivider) / (SOFT_SPI_CLOCK * 2) - 1;
+  TIM8->CCR3 = (TIM8->ARR + 1) / 2;
+  TIM8->CCMR2 = 0; // Channel 3 frozen output compare, only used for its DMA request
+  TIM8->EGR = TIM_EGR_UG;
+  TIM8->SR = 0;
+}
+
+#else
+
 static uint8_t sw_spi_xfer (uint8_t byte)
 {
   uint_fast8_t msk = 0x80, res = 0;
@@ -66,10 +156,10 @@ static uint8_t sw_spi_xfer (uint8_t byte)
   do {
     DIGITAL_OUT(TRINAMIC_MOSI_PORT, TRINAMIC_MOSI_PIN, (byte & msk) != 0);
     msk >>= 1;
-    delay();
+    delay_ns(TMC_SPI_SCK_HALF_NS);
     res = (res << 1) | DIGITAL_IN(TRINAMIC_MISO_PORT, TRINAMIC_MISO_PIN);
     DIGITAL_OUT(TRINAMIC_SCK_PORT, TRINAMIC_SCK_PIN, 1);
-    delay();
+    delay_ns(TMC_SPI_SCK_HALF_NS);
     if (msk)
       DIGITAL_OUT(TRINAMIC_SCK_PORT, TRINAMIC_SCK_PIN, 0);
   } while (msk);
@@ -77,52 +167,61 @@ static uint8_t sw_spi_xfer (uint8_t byte)
   return (uint8_t)res;
 }
 
-TMC_spi_status_t tmc_spi_read (trinamic_motor_t driver, TMC_spi_datagram_t *datagram)
+// Exchanges one datagram, data is replaced with the received bytes.
+static void spi_xfer (uint8_t *data)
 {
-  TMC_spi_status_t status;
+  uint_fast8_t idx;
 
-  DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 0);
+  for(idx = 0; idx < DATAGRAM_SIZE; idx++)
+    data[idx] = sw_spi_xfer(data[idx]);
+}
+
+#endif // TRINAMIC_SOFT_SPI_DMA
 
-  datagram->payload.value = 0;
+TMC_spi_status_t tmc_spi_read (trinamic_motor_t driver, TMC_spi_datagram_t *datagram)
+{
+  uint8_t data[DATAGRAM_SIZE] = {0};
 
   datagram->addr.write = 0;
-  spi_put_byte(datagram->addr.value);
-  spi_put_byte(0);
-  spi_put_byte(0);
-  spi_put_byte(0);
-  spi_put_byte(0);
+  data[0] = datagram->addr.value;
 
-  DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 1);
-  delay();
   DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 0);
+  spi_xfer(data);
+  DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 1);
+
+  delay_ns(TMC_SPI_CSN_HIGH_NS);
 
-  status = spi_put_byte(datagram->addr.value);
-  datagram->payload.data[3] = spi_get_byte();
-  datagram->payload.data[2] = spi_get_byte();
-  datagram->payload.data[1] = spi_get_byte();
-  datagram->payload.data[0] = spi_get_byte();
+  memset(data, 0, sizeof(data));
+  data[0] = datagram->addr.value;
 
+  DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 0);
+  spi_xfer(data);
   DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 1);
 
-  return status;
+  datagram->payload.data[3] = data[1];
+  datagram->payload.data[2] = data[2];
+  datagram->payload.data[1] = data[3];
+  datagram->payload.data[0] = data[4];
+
+  return data[0];
 }
 
 TMC_spi_status_t tmc_spi_write (trinamic_motor_t driver, TMC_spi_datagram_t *datagram)
 {
-  TMC_spi_status_t status;
-
-  DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 0);
+  uint8_t data[DATAGRAM_SIZE];
 
   datagram->addr.write = 1;
-  status = spi_put_byte(datagram->addr.value);
-  spi_put_byte(datagram->payload.data[3]);
-  spi_put_byte(datagram->payload.data[2]);
-  spi_put_byte(datagram->payload.data[1]);
-  spi_put_byte(datagram->payload.data[0]);
+  data[0] = datagram->addr.value;
+  data[1] = datagram->payload.data[3];
+  data[2] = datagram->payload.data[2];
+  data[3] = datagram->payload.data[1];
+  data[4] = datagram->payload.data[0];
 
+  DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 0);
+  spi_xfer(data);
   DIGITAL_OUT(cs[driver.id].port, cs[driver.id].pin, 1);
 
-  return status;
+  return data[0];
 }
 
 static void add_cs_pin (xbar_t *gpio, void *data)
@@ -175,7 +274,11 @@ static void if_init(uint8_t motors, axes_signals_t enabled)
     GPIO_InitStruct.Pin = 1 << TRINAMIC_MOSI_PIN;
     GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
     GPIO_InitStruct.Pull = GPIO_NOPULL;
+#if TRINAMIC_SOFT_SPI_DMA
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_MEDIUM;
+#else
     GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
+#endif
     HAL_GPIO_Init(TRINAMIC_MOSI_PORT, &GPIO_InitStruct);
 
     GPIO_InitStruct.Pin = 1 << TRINAMIC_SCK_PIN;
@@ -189,6 +292,10 @@ static void if_init(uint8_t motors, axes_signals_t enabled)
     HAL_GPIO_Init(TRINAMIC_MISO_PORT, &GPIO_InitStruct);
 
     hal.enumerate_pins(true, add_cs_pin, NULL);
+
+#if TRINAMIC_SOFT_SPI_DMA
+    soft_spi_init();
+#endif
   }
 }
 
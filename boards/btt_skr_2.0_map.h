@@ -180,6 +180,8 @@
 
 #if SDCARD_ENABLE
 #define SDCARD_SDIO                 1
+#define SD_DETECT_PORT              GPIOC
+#define SD_DETECT_PIN               4
 #endif
 
 #if ETHERNET_ENABLE
@@ -52,7 +52,6 @@ TMC_spi_status_t tmc_spi_read (trinamic_motor_t driver, TMC_spi_datagram_t *reg)
     uint8_t res;
     uint_fast8_t idx = n_motors;
     uint32_t f_spi = spi_set_speed(SPI_BAUDRATEPRESCALER_32);
-    volatile uint32_t dly = 100;
 
     datagram[driver.seq].addr.value = reg->addr.value;
     datagram[driver.seq].addr.write = 0;
@@ -67,12 +66,11 @@ TMC_spi_status_t tmc_spi_read (trinamic_motor_t driver, TMC_spi_datagram_t *reg)
         spi_put_byte(0);
     } while(idx);
 
-    while(--dly) {};
+    delay_ns(TMC_SPI_CSN_HOLD_NS);
 
     DIGITAL_OUT(cs.port, cs.pin, 1);
 
-    dly = 50;
-    while(--dly) {};
+    delay_ns(TMC_SPI_CSN_HIGH_NS);
 
     DIGITAL_OUT(cs.port, cs.pin, 0);
 
@@ -94,13 +92,11 @@ TMC_spi_status_t tmc_spi_read (trinamic_motor_t driver, TMC_spi_datagram_t *reg)
         }
     } while(idx);
 
-    dly = 100;
-    while(--dly) {};
+    delay_ns(TMC_SPI_CSN_HOLD_NS);
 
     DIGITAL_OUT(cs.port, cs.pin, 1);
 
-    dly = 50;
-    while(--dly) {};
+    delay_ns(TMC_SPI_CSN_HIGH_NS);
 
     spi_set_speed(f_spi);
 
@@ -114,7 +110,6 @@ TMC_spi_status_t tmc_spi_write (trinamic_motor_t driver, TMC_spi_datagram_t *reg
     uint8_t res;
     uint_fast8_t idx = n_motors;
     uint32_t f_spi = spi_set_speed(SPI_BAUDRATEPRESCALER_32);
-    volatile uint32_t dly = 100;
 
     memcpy(&datagram[driver.seq], reg, sizeof(TMC_spi_datagram_t));
     datagram[driver.seq].addr.write = 1;
@@ -135,12 +130,11 @@ TMC_spi_status_t tmc_spi_write (trinamic_motor_t driver, TMC_spi_datagram_t *reg
         }
     } while(idx);
 
-    while(--dly) {};
+    delay_ns(TMC_SPI_CSN_HOLD_NS);
 
     DIGITAL_OUT(cs.port, cs.pin, 1);
 
-    dly = 50;
-    while(--dly) {};
+    delay_ns(TMC_SPI_CSN_HIGH_NS);
 
     spi_set_speed(f_spi);
 
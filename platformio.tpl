@@ -11,16 +11,12 @@ build_flags =
   -I .
   -I boards
   -I FatFs
-  -I FatFs/STM
   -I Drivers/FATFS/Target
   -I Middlewares/ST/STM32_USB_Device_Library/Class/CDC/Inc
   -I Middlewares/ST/STM32_USB_Device_Library/Core/Inc
   -I USB_DEVICE/App
   -I USB_DEVICE/Target
   -D OVERRIDE_MY_MACHINE
-  -D _USE_IOCTL=1
-  -D _USE_WRITE=1
-  -D _VOLUMES=1
   -Wl,-u,_printf_float
   -Wl,-u,_scanf_float
 lib_deps =
@@ -37,7 +33,6 @@ lib_deps =
   sdcard
   spindle
   embroidery
-  Drivers/FATFS/App
   Drivers/FATFS/Target
   # USB serial support
   Middlewares/ST/STM32_USB_Device_Library/Core